@@ -0,0 +1,340 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+#include "app_config.hpp"
+
+#include <algorithm>
+#include <system_error>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "file.hpp"
+
+// dotted quad, returns end of address or nullptr
+static const char *parse_ipv4(const char *p, const char *end, uint32_t *addr)
+{
+    uint32_t value = 0;
+    for(int part = 0; part < 4; ++part) {
+        if(part > 0) {
+            if(p == end || *p != '.') {
+                return nullptr;
+            }
+            ++p;
+        }
+        const char *digits = p;
+        unsigned octet = 0;
+        while(p != end && *p >= '0' && *p <= '9' && p - digits < 3) {
+            octet = octet * 10 + (*p - '0');
+            ++p;
+        }
+        if(p == digits || octet > 255) {
+            return nullptr;
+        }
+        value = (value << 8) | octet;
+    }
+    *addr = value;
+    return p;
+}
+
+// comma separated dotted quads, empty for none
+static bool parse_ipv4_list(const std::string &text, std::vector<uint32_t> *addrs)
+{
+    std::vector<uint32_t> parsed;
+    const char *p = text.data();
+    const char *end = p + text.size();
+    while(p != end) {
+        uint32_t addr;
+        p = parse_ipv4(p, end, &addr);
+        if(!p || (p != end && *p != ',')) {
+            return false;
+        }
+        parsed.push_back(addr);
+        if(p != end) {
+            ++p;
+        }
+    }
+    addrs->swap(parsed);
+    return true;
+}
+
+// comma separated <destination>/<prefix length>:<router>, empty for none
+static bool parse_routes(const std::string &text, std::vector<ndhcpd::pool_options::route> *routes)
+{
+    std::vector<ndhcpd::pool_options::route> parsed;
+    const char *p = text.data();
+    const char *end = p + text.size();
+    while(p != end) {
+        ndhcpd::pool_options::route route;
+        p = parse_ipv4(p, end, &route.destination);
+        if(!p || p == end || *p != '/') {
+            return false;
+        }
+        char *len_end;
+        unsigned long len = strtoul(p + 1, &len_end, 10);
+        if(len_end == p + 1 || len > 32 || len_end == end || *len_end != ':') {
+            return false;
+        }
+        route.prefixLength = static_cast<uint8_t>(len);
+        p = parse_ipv4(len_end + 1, end, &route.router);
+        if(!p || (p != end && *p != ',')) {
+            return false;
+        }
+        parsed.push_back(route);
+        if(p != end) {
+            ++p;
+        }
+    }
+    routes->swap(parsed);
+    return true;
+}
+
+bool set_pool_option(ndhcpd::pool_options &options, const std::string &option)
+{
+    std::string::size_type pos = option.find('=');
+    if(pos == std::string::npos) {
+        return false;
+    }
+    std::string key(option, 0, pos);
+    std::string strValue(option, pos+1);
+    unsigned long value = strtoul(strValue.c_str(), nullptr, 10);
+    if(key == "lease") {
+        options.leaseTime = std::chrono::seconds(value);
+    }
+    else if(key == "offer") {
+        options.offerTime = std::chrono::seconds(value);
+    }
+    else if(key == "t1") {
+        options.t1 = std::chrono::seconds(value);
+    }
+    else if(key == "t2") {
+        options.t2 = std::chrono::seconds(value);
+    }
+    else if(key == "jitter") {
+        options.leaseJitter = value;
+    }
+    else if(key == "allocation" && strValue == "sequential") {
+        options.allocation = ndhcpd::allocation_policy::sequential;
+    }
+    else if(key == "allocation" && strValue == "hash") {
+        options.allocation = ndhcpd::allocation_policy::hash;
+    }
+    else if(key == "probes") {
+        options.hashProbes = value;
+    }
+    else if(key == "probe" && strValue == "none") {
+        options.conflictProbe = ndhcpd::conflict_probe::none;
+    }
+    else if(key == "probe" && strValue == "arp") {
+        options.conflictProbe = ndhcpd::conflict_probe::arp;
+    }
+    else if(key == "probe" && strValue == "icmp") {
+        options.conflictProbe = ndhcpd::conflict_probe::icmp;
+    }
+    else if(key == "probe_timeout") {
+        options.probeTimeout = std::chrono::milliseconds(value);
+    }
+    else if(key == "quarantine") {
+        options.quarantineTime = std::chrono::seconds(value);
+    }
+    else if(key == "rapid_commit") {
+        options.rapidCommit = (value != 0);
+    }
+    else if(key == "router") {
+        return parse_ipv4_list(strValue, &options.routers);
+    }
+    else if(key == "dns") {
+        return parse_ipv4_list(strValue, &options.dnsServers);
+    }
+    else if(key == "domain") {
+        options.domainName = strValue;
+    }
+    else if(key == "broadcast") {
+        uint32_t addr = 0;
+        if(!strValue.empty()
+                && parse_ipv4(strValue.data(), strValue.data() + strValue.size(), &addr) != strValue.data() + strValue.size()) {
+            return false;
+        }
+        options.broadcastAddress = addr;
+    }
+    else if(key == "ntp") {
+        return parse_ipv4_list(strValue, &options.ntpServers);
+    }
+    else if(key == "routes") {
+        return parse_routes(strValue, &options.classlessRoutes);
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+
+app_config::app_config()
+    : start(false)
+    , invalid(0)
+    , context_changed(false)
+{
+}
+
+void app_config::load(const std::string &path)
+{
+    File file(open(path.c_str(), O_RDONLY|O_CLOEXEC));
+    if(!file.isValid()) {
+        throw std::system_error(errno, std::system_category(), "open(" + path + ")");
+    }
+    struct stat st;
+    if(fstat(file, &st) < 0) {
+        throw std::system_error(errno, std::system_category(), "fstat(" + path + ")");
+    }
+    std::vector<char> text(st.st_size);
+    size_t size = 0;
+    while(size < text.size()) {
+        ssize_t len = read(file, text.data() + size, text.size() - size);
+        if(len < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            throw std::system_error(errno, std::system_category(), "read(" + path + ")");
+        }
+        if(len == 0) {
+            break;
+        }
+        size += len;
+    }
+    *this = app_config();
+    parse(text.data(), text.data() + size);
+}
+
+void app_config::parse(const char *begin, const char *end)
+{
+    ranges.reserve(std::count(begin, end, '\n') + 1);
+    for(const char *line = begin; line < end; ) {
+        const char *next = static_cast<const char *>(memchr(line, '\n', end - line));
+        const char *line_end = next ? next : end;
+        next = next ? next + 1 : end;
+        while(line < line_end && (*line == ' ' || *line == '\t')) {
+            ++line;
+        }
+        while(line_end > line && (line_end[-1] == ' ' || line_end[-1] == '\t' || line_end[-1] == '\r')) {
+            --line_end;
+        }
+        if(line == line_end || *line == '#') {
+            line = next;
+            continue;
+        }
+        ndhcpd::range range;
+        switch(*line) {
+        case 'a':
+            if(!parse_range(line + 1, line_end, &range)) {
+                ++invalid;
+                break;
+            }
+            if(contexts.empty() || context_changed) {
+                contexts.push_back(last);
+                context_changed = false;
+            }
+            ranges.push_back(range_entry{range, static_cast<uint32_t>(contexts.size() - 1)});
+            break;
+        case 'o':
+        case 'n':
+        case 'm':
+            parse_setting(line, line_end);
+            break;
+        default:
+        {
+            std::string cmd(line, line_end);
+            if(cmd == "start") {
+                start = true;
+            }
+            else if(cmd != "stop" && cmd != "quit" && cmd != "stats") {
+                commands.push_back(cmd);
+            }
+        }
+            break;
+        }
+        line = next;
+    }
+}
+
+// <from>[-<to>][/<mask>], mask is dotted quad or prefix length
+bool app_config::parse_range(const char *begin, const char *end, ndhcpd::range *range) const
+{
+    const char *p = parse_ipv4(begin, end, &range->from);
+    if(!p) {
+        return false;
+    }
+    range->to = range->from;
+    if(p != end && *p == '-') {
+        p = parse_ipv4(p + 1, end, &range->to);
+        if(!p) {
+            return false;
+        }
+    }
+    range->mask = 0xffffff00;
+    if(p != end && *p == '/') {
+        const char *mask = parse_ipv4(p + 1, end, &range->mask);
+        if(!mask) {
+            char *len_end;
+            unsigned long len = strtoul(p + 1, &len_end, 10);
+            if(len_end == p + 1 || len > 32) {
+                return false;
+            }
+            // prefix length is converted by ndhcpd
+            range->mask = len;
+            mask = len_end;
+        }
+        p = mask;
+    }
+    return p == end;
+}
+
+void app_config::parse_setting(const char *begin, const char *end)
+{
+    std::string param(begin + 1, end);
+    switch(*begin) {
+    case 'o':
+        if(!set_pool_option(last.options, param)) {
+            ++invalid;
+            return;
+        }
+        break;
+    case 'n':
+    {
+        std::string::size_type pos = param.find('=');
+        if(pos != std::string::npos) {
+            // server id of the interface is a setting of its own
+            commands.emplace_back(begin, end);
+            param.erase(pos);
+        }
+        last.iface = param;
+    }
+        break;
+    case 'm':
+        last.classes.clear();
+        for(std::string::size_type pos = 0; pos <= param.size(); ) {
+            std::string::size_type comma = std::min(param.find(',', pos), param.size());
+            if(comma > pos) {
+                last.classes.emplace_back(param, pos, comma - pos);
+            }
+            pos = comma + 1;
+        }
+        break;
+    }
+    // options in effect make the key, whatever lines set them
+    if(*begin == 'o') {
+        std::string::size_type pos = param.find('=');
+        option_values[param.substr(0, pos)] = param.substr(pos + 1);
+    }
+    last.key.clear();
+    for(const auto &option : option_values) {
+        last.key.append(option.first).append(1, '=').append(option.second).append(1, ';');
+    }
+    last.key.append("\nn").append(last.iface).append("\nm");
+    for(const std::string &name : last.classes) {
+        last.key.append(name).append(1, ',');
+    }
+    context_changed = true;
+}
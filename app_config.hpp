@@ -0,0 +1,53 @@
+#ifndef NDHCPD_APP_CONFIG_HPP
+#define NDHCPD_APP_CONFIG_HPP
+
+#include <ndhcpd.hpp>
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+
+// Applies "key=value" pool option. Returns false for unknown option.
+bool set_pool_option(ndhcpd::pool_options &options, const std::string &option);
+
+// Configuration file of ndhcpd-app. It holds FIFO commands, one per line,
+// empty lines and lines starting with # are skipped. File is read at once
+// and parsed in place: address lines become ranges tagged with the pool
+// settings (o, n and m lines) in effect, so they can be bulk loaded, other
+// lines are kept as commands.
+class app_config
+{
+public:
+    app_config();
+
+    // throws std::system_error when file cannot be read
+    void load(const std::string &path);
+
+    // pool settings in effect for some ranges
+    struct pool_context {
+        std::string key; // setting lines in effect, equal for equal settings
+        ndhcpd::pool_options options;
+        std::string iface; // empty for any
+        std::vector<std::string> classes;
+    };
+    struct range_entry {
+        ndhcpd::range range;
+        uint32_t context; // index in contexts
+    };
+    std::vector<pool_context> contexts;
+    std::vector<range_entry> ranges; // in file order
+    std::vector<std::string> commands; // other lines in file order, without start, stop and quit
+    pool_context last; // pool settings at end of file, for pools added later
+    bool start; // file has start line
+    size_t invalid; // lines skipped
+
+private:
+    void parse(const char *begin, const char *end);
+    bool parse_range(const char *begin, const char *end, ndhcpd::range *range) const;
+    void parse_setting(const char *begin, const char *end);
+
+    std::map<std::string, std::string> option_values; // pool options set so far by key
+    bool context_changed; // since the last context was added
+};
+
+#endif//NDHCPD_APP_CONFIG_HPP
@@ -0,0 +1,252 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+#include "client_classifier.hpp"
+
+#include <algorithm>
+#include <system_error>
+
+#include <string.h>
+
+namespace {
+// relay agent information sub-options, RFC 3046
+const uint8_t agent_circuit_id = 1;
+const uint8_t agent_remote_id = 2;
+
+int hex_digit(char c)
+{
+    if(c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if(c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if(c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+// hex bytes, optionally separated by ':', '-' or '.'
+bool parse_hex(const std::string &text, std::vector<uint8_t> *bytes)
+{
+    bytes->clear();
+    int high = -1;
+    for(char c : text) {
+        if(c == ':' || c == '-' || c == '.') {
+            if(high >= 0) {
+                return false;
+            }
+            continue;
+        }
+        int digit = hex_digit(c);
+        if(digit < 0) {
+            return false;
+        }
+        if(high < 0) {
+            high = digit;
+        }
+        else {
+            bytes->push_back(static_cast<uint8_t>((high << 4) | digit));
+            high = -1;
+        }
+    }
+    return high < 0;
+}
+}
+
+const int client_classifier::none;
+
+client_classifier::client_classifier()
+    : rule_count(0)
+{
+    clear_rules();
+}
+
+bool client_classifier::parse_value(const std::string &text, std::vector<uint8_t> *value)
+{
+    if(text.size() > 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X')) {
+        return parse_hex(text.substr(2), value);
+    }
+    value->assign(text.begin(), text.end());
+    return true;
+}
+
+int client_classifier::add_rule(const std::string &class_name, const std::string &rule)
+{
+    std::string::size_type pos = rule.find('=');
+    if(class_name.empty() || pos == std::string::npos) {
+        throw std::system_error(std::make_error_code(std::errc::invalid_argument), "add_rule()");
+    }
+    static const char *const field_names[field_count] = {"mac", "vendor", "user", "circuit", "remote"};
+    const char *const *name = std::find(field_names, field_names + field_count, rule.substr(0, pos));
+    if(name == field_names + field_count) {
+        throw std::system_error(std::make_error_code(std::errc::invalid_argument), "add_rule(): unknown field");
+    }
+    field f = static_cast<field>(name - field_names);
+    std::string text(rule, pos+1);
+    bool prefix = (f == mac);
+    if(!prefix && !text.empty() && text.back() == '*') {
+        prefix = true;
+        text.pop_back();
+    }
+    std::vector<uint8_t> value;
+    bool valid = (f == mac) ? parse_hex(text, &value) && !value.empty() && value.size() <= 6
+                            : parse_value(text, &value) && (prefix || !value.empty());
+    if(!valid || value.size() > 255) {
+        throw std::system_error(std::make_error_code(std::errc::invalid_argument), "add_rule(): invalid value");
+    }
+
+    match m = {rule_count, intern(class_name)};
+    if(prefix) {
+        add_prefix(f, value, m);
+    }
+    else {
+        add_exact(f, value, m);
+    }
+    ++rule_count;
+    return m.id;
+}
+
+void client_classifier::clear_rules()
+{
+    rule_count = 0;
+    trie.assign(1, trie_node{{}, match{0, none}});
+    exact.clear();
+    std::fill(has_prefix, has_prefix + field_count, false);
+    std::fill(has_exact, has_exact + field_count, false);
+}
+
+int client_classifier::intern(const std::string &class_name)
+{
+    auto iter = ids.find(class_name);
+    if(iter != ids.end()) {
+        return iter->second;
+    }
+    names.push_back(class_name);
+    ids.emplace(class_name, static_cast<int>(names.size() - 1));
+    return static_cast<int>(names.size() - 1);
+}
+
+int client_classifier::find(const std::string &class_name) const
+{
+    auto iter = ids.find(class_name);
+    return iter == ids.end() ? none : iter->second;
+}
+
+uint64_t client_classifier::exact_key(field f, const uint8_t *value, size_t len)
+{
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ull;
+    hash ^= f;
+    hash *= 1099511628211ull;
+    for(size_t i = 0; i < len; ++i) {
+        hash ^= value[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+void client_classifier::add_prefix(field f, const std::vector<uint8_t> &value, const match &m)
+{
+    // nodes are referred to by index, trie may grow while walking it
+    auto child = [this](uint32_t node, uint8_t byte) {
+        std::vector<std::pair<uint8_t, uint32_t>> &children = trie[node].children;
+        auto iter = std::lower_bound(children.begin(), children.end(), std::make_pair(byte, uint32_t(0)));
+        if(iter != children.end() && iter->first == byte) {
+            return iter->second;
+        }
+        uint32_t index = static_cast<uint32_t>(trie.size());
+        children.insert(iter, std::make_pair(byte, index));
+        trie.push_back(trie_node{{}, match{0, none}});
+        return index;
+    };
+    uint32_t node = child(0, f);
+    for(uint8_t byte : value) {
+        node = child(node, byte);
+    }
+    if(trie[node].found.id == none) {
+        trie[node].found = m;
+    }
+    has_prefix[f] = true;
+}
+
+void client_classifier::add_exact(field f, const std::vector<uint8_t> &value, const match &m)
+{
+    uint64_t key = exact_key(f, value.data(), value.size());
+    auto range = exact.equal_range(key);
+    for(auto iter = range.first; iter != range.second; ++iter) {
+        if(iter->second.f == f && iter->second.value == value) {
+            // earlier rule wins
+            return;
+        }
+    }
+    exact.emplace(key, exact_rule{f, value, m});
+    has_exact[f] = true;
+}
+
+void client_classifier::lookup(field f, const uint8_t *value, size_t len, match *best) const
+{
+    if(has_exact[f]) {
+        auto range = exact.equal_range(exact_key(f, value, len));
+        for(auto iter = range.first; iter != range.second; ++iter) {
+            const exact_rule &r = iter->second;
+            if(r.f == f && r.value.size() == len && memcmp(r.value.data(), value, len) == 0
+                    && r.found.rule < best->rule) {
+                *best = r.found;
+            }
+        }
+    }
+    if(!has_prefix[f]) {
+        return;
+    }
+    auto child = [this](uint32_t node, uint8_t byte) {
+        const std::vector<std::pair<uint8_t, uint32_t>> &children = trie[node].children;
+        auto iter = std::lower_bound(children.begin(), children.end(), std::make_pair(byte, uint32_t(0)));
+        return (iter != children.end() && iter->first == byte) ? iter->second : 0;
+    };
+    uint32_t node = child(0, f);
+    for(size_t i = 0; node != 0; ) {
+        const match &found = trie[node].found;
+        if(found.id != none && found.rule < best->rule) {
+            *best = found;
+        }
+        if(i == len) {
+            break;
+        }
+        node = child(node, value[i++]);
+    }
+}
+
+int client_classifier::classify(const dhcp_packet &packet) const
+{
+    if(rule_count == 0) {
+        return none;
+    }
+    match best = {UINT32_MAX, none};
+    if(packet.hlen > 0) {
+        lookup(mac, packet.chaddr, std::min<size_t>(packet.hlen, sizeof(packet.chaddr)), &best);
+    }
+    const dhcp_option *option = dhcp_find_option(packet, dhcp_option::_code::vendor_class);
+    if(option) {
+        lookup(vendor, reinterpret_cast<const uint8_t *>(option->value), option->len, &best);
+    }
+    option = dhcp_find_option(packet, dhcp_option::_code::user_class);
+    if(option) {
+        lookup(user, reinterpret_cast<const uint8_t *>(option->value), option->len, &best);
+    }
+    option = dhcp_find_option(packet, dhcp_option::_code::relay_agent_info);
+    if(option && (has_prefix[circuit] || has_exact[circuit] || has_prefix[remote] || has_exact[remote])) {
+        const uint8_t *sub = reinterpret_cast<const uint8_t *>(option->value);
+        const uint8_t *end = sub + option->len;
+        while(sub + 2 <= end && sub + 2 + sub[1] <= end) {
+            if(sub[0] == agent_circuit_id) {
+                lookup(circuit, sub + 2, sub[1], &best);
+            }
+            else if(sub[0] == agent_remote_id) {
+                lookup(remote, sub + 2, sub[1], &best);
+            }
+            sub += 2 + sub[1];
+        }
+    }
+    return best.id;
+}
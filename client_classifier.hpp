@@ -0,0 +1,79 @@
+#ifndef NDHCPD_CLIENT_CLASSIFIER_HPP
+#define NDHCPD_CLIENT_CLASSIFIER_HPP
+
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "dhcp_packet.hpp"
+
+// Client classes by hardware address prefix, vendor class (option 60),
+// user class (option 77) and relay agent circuit and remote id (option 82).
+// Rules are compiled when added: prefixes into one byte trie, exact values
+// into one hash table, both keyed by field, so a packet is classified by a
+// few lookups however many rules there are. First matching rule wins.
+class client_classifier
+{
+public:
+    static const int none = -1;
+
+    client_classifier();
+
+    // Rule is <field>=<value>, field one of mac, vendor, user, circuit,
+    // remote. Value is text or 0x<hex>, mac is 1 to 6 hex bytes and always
+    // matches as prefix, other values match as prefix when ending with *.
+    // Returns class id, throws std::system_error on invalid rule.
+    int add_rule(const std::string &class_name, const std::string &rule);
+    void clear_rules(); // class ids stay valid
+    size_t rules() const { return rule_count; }
+
+    // class id of name, added if unknown
+    int intern(const std::string &class_name);
+    int find(const std::string &class_name) const; // none if unknown
+    const std::string &name(int id) const { return names[id]; }
+    size_t classes() const { return names.size(); }
+
+    int classify(const struct dhcp_packet &packet) const; // none if no rule matches
+
+    // text or 0x<hex>
+    static bool parse_value(const std::string &text, std::vector<uint8_t> *value);
+
+private:
+    enum field : uint8_t {
+        mac,
+        vendor,
+        user,
+        circuit,
+        remote,
+        field_count
+    };
+    struct match {
+        uint32_t rule; // lower wins
+        int id;
+    };
+    struct trie_node {
+        std::vector<std::pair<uint8_t, uint32_t>> children; // sorted by byte
+        match found; // rule ending here, id none if no rule
+    };
+    struct exact_rule {
+        field f;
+        std::vector<uint8_t> value;
+        match found;
+    };
+    static uint64_t exact_key(field f, const uint8_t *value, size_t len);
+
+    void add_prefix(field f, const std::vector<uint8_t> &value, const match &m);
+    void add_exact(field f, const std::vector<uint8_t> &value, const match &m);
+    void lookup(field f, const uint8_t *value, size_t len, match *best) const;
+
+    std::vector<std::string> names;
+    std::unordered_map<std::string, int> ids;
+    uint32_t rule_count;
+    std::vector<trie_node> trie; // node 0 is root, its children are fields
+    std::unordered_multimap<uint64_t, exact_rule> exact;
+    bool has_prefix[field_count];
+    bool has_exact[field_count];
+};
+
+#endif//NDHCPD_CLIENT_CLASSIFIER_HPP
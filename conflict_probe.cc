@@ -0,0 +1,201 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+#include "conflict_probe.hpp"
+
+#include <system_error>
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <net/if.h>
+#include <net/if_arp.h>
+#include <net/ethernet.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/ip_icmp.h>
+#include <linux/if_packet.h>
+#include <arpa/inet.h>
+
+namespace {
+// ARP payload for IPv4 over Ethernet
+struct arp_packet {
+    struct arphdr hdr;
+    uint8_t sha[6];
+    uint8_t spa[4];
+    uint8_t tha[6];
+    uint8_t tpa[4];
+} __attribute__((packed));
+
+uint16_t inet_checksum(const void *data, size_t len)
+{
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    uint32_t sum = 0;
+    for(size_t i=0; i+1<len; i+=2) {
+        sum += (bytes[i] << 8) | bytes[i+1];
+    }
+    if(len & 1) {
+        sum += bytes[len-1] << 8;
+    }
+    while(sum >> 16) {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    return htons(~sum);
+}
+}
+
+conflict_prober::conflict_prober()
+    : ifindex(0)
+    , echo_id(getpid() & 0xffff)
+    , echo_seq(0)
+{
+    memset(hwaddr, 0, sizeof(hwaddr));
+}
+
+void conflict_prober::open_arp(const std::string &ifaceName)
+{
+    Socket _arp(PF_PACKET, SOCK_DGRAM|SOCK_NONBLOCK, htons(ETH_P_ARP));
+
+    struct ifreq ifr;
+    memset(&ifr, 0, sizeof(ifr));
+    ifaceName.copy(ifr.ifr_name, sizeof(ifr.ifr_name)-1);
+    if(ioctl(_arp, SIOCGIFINDEX, &ifr) != 0) {
+        throw std::system_error(errno, std::system_category(), "ioctl(SIOCGIFINDEX)");
+    }
+    ifindex = ifr.ifr_ifindex;
+    if(ioctl(_arp, SIOCGIFHWADDR, &ifr) != 0) {
+        throw std::system_error(errno, std::system_category(), "ioctl(SIOCGIFHWADDR)");
+    }
+    memcpy(hwaddr, ifr.ifr_hwaddr.sa_data, sizeof(hwaddr));
+
+    struct sockaddr_ll addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sll_family = AF_PACKET;
+    addr.sll_protocol = htons(ETH_P_ARP);
+    addr.sll_ifindex = ifindex;
+    _arp.bind(addr);
+
+    std::swap(arp_socket, _arp);
+}
+
+void conflict_prober::open_icmp(const std::string &ifaceName)
+{
+    Socket _icmp(PF_INET, SOCK_RAW|SOCK_NONBLOCK, IPPROTO_ICMP);
+    if(!ifaceName.empty()) {
+        struct ifreq ifr;
+        memset(&ifr, 0, sizeof(ifr));
+        ifaceName.copy(ifr.ifr_name, sizeof(ifr.ifr_name)-1);
+        _icmp.setsockopt(SOL_SOCKET, SO_BINDTODEVICE, ifr);
+    }
+    std::swap(icmp_socket, _icmp);
+}
+
+void conflict_prober::close()
+{
+    arp_socket.close();
+    icmp_socket.close();
+}
+
+void conflict_prober::probe_arp(uint32_t ip)
+{
+    // RFC 5227 probe: sender protocol address is zero
+    arp_packet packet;
+    memset(&packet, 0, sizeof(packet));
+    packet.hdr.ar_hrd = htons(ARPHRD_ETHER);
+    packet.hdr.ar_pro = htons(ETH_P_IP);
+    packet.hdr.ar_hln = 6;
+    packet.hdr.ar_pln = 4;
+    packet.hdr.ar_op = htons(ARPOP_REQUEST);
+    memcpy(packet.sha, hwaddr, sizeof(packet.sha));
+    uint32_t n_ip = htonl(ip);
+    memcpy(packet.tpa, &n_ip, sizeof(packet.tpa));
+
+    struct sockaddr_ll addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sll_family = AF_PACKET;
+    addr.sll_protocol = htons(ETH_P_ARP);
+    addr.sll_ifindex = ifindex;
+    addr.sll_halen = 6;
+    memset(addr.sll_addr, 0xff, 6);
+    if(sendto(arp_socket, &packet, sizeof(packet), 0, (const sockaddr*)&addr, sizeof(addr)) < 0) {
+        throw std::system_error(errno, std::system_category(), "sendto(arp)");
+    }
+}
+
+void conflict_prober::probe_icmp(uint32_t ip)
+{
+    struct icmphdr packet;
+    memset(&packet, 0, sizeof(packet));
+    packet.type = ICMP_ECHO;
+    packet.un.echo.id = htons(echo_id);
+    packet.un.echo.sequence = htons(++echo_seq);
+    packet.checksum = inet_checksum(&packet, sizeof(packet));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(ip);
+    if(sendto(icmp_socket, &packet, sizeof(packet), 0, (const sockaddr*)&addr, sizeof(addr)) < 0) {
+        throw std::system_error(errno, std::system_category(), "sendto(icmp)");
+    }
+}
+
+uint32_t conflict_prober::read_reply(int fd)
+{
+    if(fd == arp_socket) {
+        return read_arp_reply();
+    }
+    if(fd == icmp_socket) {
+        return read_icmp_reply();
+    }
+    return 0;
+}
+
+uint32_t conflict_prober::read_arp_reply()
+{
+    arp_packet packet;
+    ssize_t len = recv(arp_socket, &packet, sizeof(packet), 0);
+    if(len < 0) {
+        if(errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+            return 0;
+        }
+        throw std::system_error(errno, std::system_category(), "recv(arp)");
+    }
+    if(len < (ssize_t)sizeof(packet)
+            || packet.hdr.ar_hrd != htons(ARPHRD_ETHER)
+            || packet.hdr.ar_pro != htons(ETH_P_IP)) {
+        return 0;
+    }
+    // Any host claiming the address, either by reply or by own request
+    uint32_t n_ip;
+    memcpy(&n_ip, packet.spa, sizeof(n_ip));
+    return ntohl(n_ip);
+}
+
+uint32_t conflict_prober::read_icmp_reply()
+{
+    uint8_t buf[128];
+    struct sockaddr_in addr;
+    socklen_t addrLen = sizeof(addr);
+    ssize_t len = recvfrom(icmp_socket, buf, sizeof(buf), 0, (sockaddr*)&addr, &addrLen);
+    if(len < 0) {
+        if(errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+            return 0;
+        }
+        throw std::system_error(errno, std::system_category(), "recvfrom(icmp)");
+    }
+    // raw socket delivers IP header too
+    if(len < (ssize_t)sizeof(struct iphdr)) {
+        return 0;
+    }
+    const struct iphdr *ip = reinterpret_cast<const struct iphdr *>(buf);
+    size_t ipLen = ip->ihl*4;
+    if(len < (ssize_t)(ipLen + sizeof(struct icmphdr))) {
+        return 0;
+    }
+    struct icmphdr icmp;
+    memcpy(&icmp, buf + ipLen, sizeof(icmp));
+    if(icmp.type != ICMP_ECHOREPLY || icmp.un.echo.id != htons(echo_id)) {
+        return 0;
+    }
+    return ntohl(addr.sin_addr.s_addr);
+}
@@ -0,0 +1,47 @@
+#ifndef NDHCPD_CONFLICT_PROBE_HPP
+#define NDHCPD_CONFLICT_PROBE_HPP
+
+#include <stdint.h>
+#include <string>
+
+#include "socket.hpp"
+
+// Sends ARP probes and ICMP echo requests for addresses about to be
+// offered and recognizes replies from them. Never blocks.
+class conflict_prober
+{
+public:
+    conflict_prober();
+
+    conflict_prober(const conflict_prober&) = delete;
+    conflict_prober& operator=(const conflict_prober&) = delete;
+
+public:
+    void open_arp(const std::string &ifaceName);
+    void open_icmp(const std::string &ifaceName);
+    void close();
+
+    bool can_arp() const { return arp_socket.isValid(); }
+    bool can_icmp() const { return icmp_socket.isValid(); }
+
+    void probe_arp(uint32_t ip);  // in host endiannes
+    void probe_icmp(uint32_t ip); // in host endiannes
+
+    // Reads one reply from socket fd.
+    // Returns address that answered (in host endiannes), 0 if none.
+    uint32_t read_reply(int fd);
+
+    Socket arp_socket;
+    Socket icmp_socket;
+
+private:
+    uint32_t read_arp_reply();
+    uint32_t read_icmp_reply();
+
+    int ifindex;
+    uint8_t hwaddr[6];
+    uint16_t echo_id;
+    uint16_t echo_seq;
+};
+
+#endif//NDHCPD_CONFLICT_PROBE_HPP
@@ -0,0 +1,713 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+#include "ddns_updater.hpp"
+#include "sha256.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/eventfd.h>
+
+#include <algorithm>
+#include <random>
+#include <system_error>
+
+// RFC 2136 UPDATE message: header, zone section with one SOA question of the
+// zone, prerequisite section and update section. Owner names point to the
+// zone name by compression pointer, prerequisites are
+//   name not in use:     type ANY, class NONE, ttl 0, no rdata
+//   RR exists:           class IN, ttl 0, rdata
+// and records to the update section are
+//   delete RRset:        class ANY, ttl 0, no rdata
+//   delete one RR:       class NONE, ttl 0, rdata
+//   add RR:              class IN
+// Forward names follow RFC 4703: added with DHCID when not in use, replaced
+// and removed only when DHCID of the client is there. PTR records of the
+// served addresses belong to this server and are written without checks.
+static const size_t header_size = 12;
+static const uint16_t opcode_update = 5 << 11;
+static const uint16_t flag_response = 0x8000;
+static const uint16_t type_a = 1;
+static const uint16_t type_ptr = 12;
+static const uint16_t type_soa = 6;
+static const uint16_t type_dhcid = 49;
+static const uint16_t type_any = 255;
+static const uint16_t class_in = 1;
+static const uint16_t class_none = 254;
+static const uint16_t class_any = 255;
+static const uint8_t zone_pointer[2] = { 0xc0, header_size }; // zone name follows header
+enum : uint8_t {
+    rcode_noerror = 0,
+    rcode_servfail = 2,
+    rcode_yxdomain = 6, // name in use
+    rcode_nxrrset = 8   // DHCID of the client not there
+};
+// RFC 4701 identifier type of htype and chaddr, digest type SHA-256
+static const uint8_t dhcid_chaddr[2] = { 0x00, 0x00 };
+static const uint8_t dhcid_sha256 = 1;
+static const uint8_t htype_ethernet = 1;
+
+static void put_u16(std::vector<uint8_t> *out, uint16_t value)
+{
+    out->push_back(value >> 8);
+    out->push_back(value & 0xff);
+}
+
+static void put_u32(std::vector<uint8_t> *out, uint32_t value)
+{
+    put_u16(out, value >> 16);
+    put_u16(out, value & 0xffff);
+}
+
+static void put_rr(std::vector<uint8_t> *out, const std::vector<uint8_t> &owner, uint16_t type, uint16_t rr_class,
+                   uint32_t ttl, const uint8_t *rdata, size_t rdata_len)
+{
+    out->insert(out->end(), owner.begin(), owner.end());
+    put_u16(out, type);
+    put_u16(out, rr_class);
+    put_u32(out, ttl);
+    put_u16(out, rdata_len);
+    out->insert(out->end(), rdata, rdata + rdata_len);
+}
+
+static std::string lower_name(const std::string &name)
+{
+    std::string lower(name);
+    std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+    if(!lower.empty() && lower.back() == '.') {
+        lower.pop_back();
+    }
+    return lower;
+}
+
+static std::vector<std::string> split_labels(const std::string &name)
+{
+    std::vector<std::string> labels;
+    for(std::string::size_type pos = 0; pos < name.size(); ) {
+        std::string::size_type dot = std::min(name.find('.', pos), name.size());
+        labels.emplace_back(name, pos, dot - pos);
+        pos = dot + 1;
+    }
+    return labels;
+}
+
+// appends labels, terminated by root unless pointer follows
+static bool encode_labels(const std::vector<std::string> &labels, bool terminate, std::vector<uint8_t> *out)
+{
+    size_t len = 0;
+    for(const std::string &label : labels) {
+        if(label.empty() || label.size() > 63) {
+            return false;
+        }
+        out->push_back(label.size());
+        out->insert(out->end(), label.begin(), label.end());
+        len += 1 + label.size();
+    }
+    if(terminate) {
+        out->push_back(0);
+    }
+    return len < 255;
+}
+
+ddns_updater::ddns_updater()
+    : ring(ring_size)
+    , is_active(false)
+    , overflowed(false)
+    , sleeping(false)
+    , stop_thread(false)
+    , queued_count(0)
+    , dropped_count(0)
+    , sent_count(0)
+    , retried_count(0)
+    , failed_count(0)
+    , pending_count(0)
+    , next_id(0)
+    , log(log4cpp::Category::getInstance("ndhcpd.lib"))
+{
+}
+
+ddns_updater::~ddns_updater()
+{
+    stop();
+}
+
+void ddns_updater::start(const ndhcpd::ddns_options &_options, const snapshot_function &_snapshot)
+{
+    stop();
+    ndhcpd::ddns_options normalized = _options;
+    normalized.forwardZone = lower_name(_options.forwardZone);
+    normalized.reverseZone = lower_name(_options.reverseZone);
+    normalized.timeout = std::max(_options.timeout, std::chrono::milliseconds(1));
+    // PTR records point to names in forward zone
+    std::vector<uint8_t> _forward_zone;
+    std::vector<uint8_t> _reverse_zone;
+    if(normalized.forwardZone.empty()
+            || !encode_labels(split_labels(normalized.forwardZone), true, &_forward_zone)
+            || (!normalized.reverseZone.empty() && !encode_labels(split_labels(normalized.reverseZone), true, &_reverse_zone))) {
+        throw std::system_error(std::make_error_code(std::errc::invalid_argument), "ddns_updater::start()");
+    }
+    sockaddr_in addr = resolve(normalized.server, normalized.port);
+    Socket _socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if(connect(_socket, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0) {
+        throw std::system_error(errno, std::system_category(), "connect()");
+    }
+    File _wakeup(eventfd(0, EFD_NONBLOCK));
+
+    options = normalized;
+    snapshot = _snapshot;
+    forward_zone.swap(_forward_zone);
+    reverse_zone.swap(_reverse_zone);
+    std::swap(socket, _socket);
+    std::swap(wakeup, _wakeup);
+    pending.clear();
+    forward.clear();
+    reverse.clear();
+    single.clear();
+    conflicts.clear();
+    in_flight.clear();
+    messages.clear();
+    next_id = static_cast<uint16_t>(std::random_device()());
+    stop_thread = false;
+    overflowed = false;
+    is_active = true;
+    thread = std::thread(std::mem_fn(&ddns_updater::run), this);
+    log.infoStream() << "Updating DNS zone " << options.forwardZone
+                     << (options.reverseZone.empty() ? "" : " and ") << options.reverseZone
+                     << " on " << options.server << ":" << options.port;
+}
+
+void ddns_updater::stop()
+{
+    is_active = false;
+    if(thread.joinable()) {
+        stop_thread = true;
+        eventfd_write(wakeup, 1);
+        thread.join();
+    }
+    socket.close();
+    wakeup.close();
+    change discarded;
+    while(ring.pop(&discarded, 1)) {
+    }
+}
+
+ndhcpd::ddns_statistics ddns_updater::stats() const
+{
+    ndhcpd::ddns_statistics result;
+    result.queued = queued_count.load(std::memory_order_relaxed);
+    result.dropped = dropped_count.load(std::memory_order_relaxed);
+    result.sent = sent_count.load(std::memory_order_relaxed);
+    result.retried = retried_count.load(std::memory_order_relaxed);
+    result.failed = failed_count.load(std::memory_order_relaxed);
+    result.pending = pending_count.load(std::memory_order_relaxed);
+    return result;
+}
+
+void ddns_updater::push(const change &value)
+{
+    if(!ring.push(value)) {
+        dropped_count.fetch_add(1, std::memory_order_relaxed);
+        overflowed.store(true, std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(sleeping.load(std::memory_order_relaxed)) {
+        eventfd_write(wakeup, 1);
+    }
+}
+
+std::string ddns_updater::host_name(const change &value)
+{
+    // first label, letters, digits and hyphens only
+    std::string name;
+    for(size_t i = 0; i < std::min<size_t>(value.name_len, sizeof(value.name)) && value.name[i] != '.'; ++i) {
+        char c = static_cast<char>(tolower(static_cast<unsigned char>(value.name[i])));
+        if((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9')) {
+            name.push_back(c);
+        }
+        else if(!name.empty() && name.back() != '-') {
+            name.push_back('-');
+        }
+    }
+    while(!name.empty() && name.back() == '-') {
+        name.pop_back();
+    }
+    if(name.empty()) {
+        char generated[20];
+        snprintf(generated, sizeof(generated), "ip-%u-%u-%u-%u",
+                 value.ip >> 24, (value.ip >> 16) & 0xff, (value.ip >> 8) & 0xff, value.ip & 0xff);
+        name = generated;
+    }
+    return name;
+}
+
+void ddns_updater::run()
+{
+    std::vector<change> batch(batch_size);
+
+    while(!stop_thread) {
+        if(overflowed.exchange(false)) {
+            resync();
+        }
+        bool was_pending = !pending.empty();
+        size_t count = ring.pop(batch.data(), batch.size());
+        for(size_t i = 0; i < count; ++i) {
+            take(batch[i]);
+        }
+        queued_count.fetch_add(count, std::memory_order_relaxed);
+
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if(!was_pending && !pending.empty()) {
+            // collect changes for a while, so they are coalesced and batched
+            flush_at = now + options.delay;
+        }
+        receive();
+        check_timeouts(now);
+        if(!pending.empty() && (now >= flush_at || pending.size() >= flush_threshold)) {
+            flush(now);
+        }
+        pending_count.store(pending.size(), std::memory_order_relaxed);
+        if(count == batch.size()) {
+            continue;
+        }
+
+        std::chrono::steady_clock::time_point wake = std::chrono::steady_clock::time_point::max();
+        if(!pending.empty()) {
+            wake = flush_at;
+        }
+        for(const message &msg : messages) {
+            wake = std::min(wake, msg.deadline);
+        }
+        int timeout = -1;
+        if(wake != std::chrono::steady_clock::time_point::max()) {
+            timeout = std::max<int64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(wake - now).count() + 1, 0);
+        }
+        sleeping.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(ring.empty() && !overflowed.load(std::memory_order_relaxed)) {
+            struct pollfd fds[2] = {
+                { wakeup, POLLIN, 0 },
+                { socket, POLLIN, 0 }
+            };
+            if(poll(fds, 2, timeout) > 0 && fds[0].revents) {
+                eventfd_t val;
+                eventfd_read(wakeup, &val);
+            }
+        }
+        sleeping.store(false, std::memory_order_relaxed);
+    }
+}
+
+void ddns_updater::take(const change &value)
+{
+    host wanted = host();
+    if(value.bound) {
+        wanted.name = host_name(value);
+        wanted.mac = value.mac;
+    }
+    auto conflict = conflicts.find(value.ip);
+    if(conflict != conflicts.end() && conflict->second != wanted) {
+        conflicts.erase(conflict);
+    }
+    pending[value.ip] = wanted;
+}
+
+void ddns_updater::resync()
+{
+    // dropped changes are lost, remove records of addresses not bound anymore,
+    // bound ones get their records on next renewal
+    std::vector<uint32_t> bound;
+    snapshot([&bound](const ndhcpd::lease_info &info) {
+        if(info.state == ndhcpd::lease_state::bound) {
+            bound.push_back(info.ip);
+        }
+    });
+    std::sort(bound.begin(), bound.end());
+    std::vector<uint32_t> recorded;
+    for(const auto &record : forward) {
+        recorded.push_back(record.first);
+    }
+    for(const auto &record : reverse) {
+        recorded.push_back(record.first);
+    }
+    size_t removed = 0;
+    for(uint32_t ip : recorded) {
+        if(!std::binary_search(bound.begin(), bound.end(), ip)
+                && pending.emplace(ip, host()).second) {
+            ++removed;
+        }
+    }
+    log.warnStream() << "DNS update queue overflow, " << dropped_count.load(std::memory_order_relaxed)
+                     << " changes dropped so far, removing records of " << removed << " unbound addresses";
+}
+
+void ddns_updater::flush(std::chrono::steady_clock::time_point now)
+{
+    message open[2];
+    bool is_open[2] = { false, false };
+    auto append = [&](int zone, const sections &records, const entry &value, bool alone) {
+        message &msg = open[zone];
+        if(is_open[zone] && (alone || msg.data.size() + msg.records.size() + records.size() > max_message_size)) {
+            send_message(&msg, now);
+            is_open[zone] = false;
+        }
+        if(!is_open[zone]) {
+            begin_message(&msg, zone != 0);
+            is_open[zone] = true;
+        }
+        msg.records.append(records);
+        msg.entries.push_back(value);
+        ++in_flight[value.ip];
+        if(alone) {
+            send_message(&msg, now);
+            is_open[zone] = false;
+        }
+    };
+
+    sections records;
+    for(auto it = pending.begin(); it != pending.end(); ) {
+        if(in_flight.count(it->first)) {
+            // sent when the previous update of the address is answered
+            ++it;
+            continue;
+        }
+        if(messages.size() + 2 > max_in_flight) {
+            break;
+        }
+        auto alone = single.find(it->first);
+        records.clear();
+        step action;
+        if(encode_forward(it->first, it->second, alone != single.end() && alone->second, &records, &action)) {
+            // name changes take more steps, PTR is written when the name is set
+            append(0, records, { it->first, it->second, action }, alone != single.end());
+            ++it;
+            continue;
+        }
+        auto record = forward.find(it->first);
+        host target = host();
+        if(record != forward.end() && record->second == it->second) {
+            target = it->second;
+        }
+        records.clear();
+        if(encode_reverse(it->first, target.name, &records)) {
+            append(1, records, { it->first, target, target.name.empty() ? step::remove : step::add }, false);
+        }
+        if(alone != single.end()) {
+            single.erase(alone);
+        }
+        it = pending.erase(it);
+    }
+    for(int zone = 0; zone < 2; ++zone) {
+        if(is_open[zone]) {
+            send_message(&open[zone], now);
+        }
+    }
+    // the rest waits for answers
+    flush_at = std::chrono::steady_clock::time_point::max();
+}
+
+void ddns_updater::begin_message(message *msg, bool reverse)
+{
+    const std::vector<uint8_t> &zone = reverse ? reverse_zone : forward_zone;
+    msg->id = next_id++;
+    msg->reverse = reverse;
+    msg->attempts = 0;
+    msg->records.clear();
+    msg->entries.clear();
+    msg->data.clear();
+    put_u16(&msg->data, msg->id);
+    put_u16(&msg->data, opcode_update);
+    put_u16(&msg->data, 1); // zone count
+    put_u16(&msg->data, 0); // prerequisite count, set when sent
+    put_u16(&msg->data, 0); // update count, set when sent
+    put_u16(&msg->data, 0); // additional count
+    msg->data.insert(msg->data.end(), zone.begin(), zone.end());
+    put_u16(&msg->data, type_soa);
+    put_u16(&msg->data, class_in);
+}
+
+void ddns_updater::send_message(message *msg, std::chrono::steady_clock::time_point now)
+{
+    msg->data[6] = msg->records.prerequisite_count >> 8;
+    msg->data[7] = msg->records.prerequisite_count & 0xff;
+    msg->data[8] = msg->records.update_count >> 8;
+    msg->data[9] = msg->records.update_count & 0xff;
+    msg->data.insert(msg->data.end(), msg->records.prerequisites.begin(), msg->records.prerequisites.end());
+    msg->data.insert(msg->data.end(), msg->records.updates.begin(), msg->records.updates.end());
+    msg->records.clear();
+    msg->attempts = 1;
+    msg->deadline = now + options.timeout;
+    if(send(socket, msg->data.data(), msg->data.size(), MSG_DONTWAIT) < 0) {
+        // resent on timeout
+        log.debugStream() << "DNS update to " << options.server << " not sent: "
+                          << std::system_error(errno, std::system_category(), "send()").what();
+    }
+    messages.push_back(std::move(*msg));
+}
+
+void ddns_updater::receive()
+{
+    uint8_t answer[512];
+    for(;;) {
+        ssize_t len = recv(socket, answer, sizeof(answer), MSG_DONTWAIT);
+        if(len < 0) {
+            if(errno == EINTR || errno == ECONNREFUSED) {
+                continue;
+            }
+            break;
+        }
+        if(static_cast<size_t>(len) < header_size) {
+            continue;
+        }
+        uint16_t id = get_u16(answer);
+        uint16_t flags = get_u16(answer + 2);
+        auto msg = std::find_if(messages.begin(), messages.end(), [id](const message &m) { return m.id == id; });
+        if(!(flags & flag_response) || msg == messages.end()) {
+            continue;
+        }
+        uint8_t rcode = flags & 0x0f;
+        if(rcode == rcode_noerror) {
+            sent_count.fetch_add(1, std::memory_order_relaxed);
+            complete(*msg, true);
+        }
+        else if(rcode == rcode_servfail) {
+            // resent on timeout
+            continue;
+        }
+        else if(!msg->reverse && (rcode == rcode_yxdomain || rcode == rcode_nxrrset)) {
+            complete(*msg, false);
+            resolve_conflict(*msg, rcode);
+        }
+        else {
+            log.warnStream() << "DNS server " << options.server << " refused update of "
+                             << (msg->reverse ? options.reverseZone : options.forwardZone)
+                             << " with rcode " << static_cast<unsigned>(rcode) << ", "
+                             << msg->entries.size() << " addresses not updated";
+            failed_count.fetch_add(1, std::memory_order_relaxed);
+            complete(*msg, false);
+            for(const entry &value : msg->entries) {
+                // not sent again until the name changes
+                auto wanted = pending.find(value.ip);
+                if(wanted != pending.end() && wanted->second == value.wanted) {
+                    pending.erase(wanted);
+                }
+            }
+        }
+        messages.erase(msg);
+    }
+}
+
+void ddns_updater::check_timeouts(std::chrono::steady_clock::time_point now)
+{
+    for(auto msg = messages.begin(); msg != messages.end(); ) {
+        if(msg->deadline > now) {
+            ++msg;
+            continue;
+        }
+        if(msg->attempts <= options.retries) {
+            msg->deadline = now + options.timeout * (1 << std::min(msg->attempts, 16u));
+            ++msg->attempts;
+            retried_count.fetch_add(1, std::memory_order_relaxed);
+            if(send(socket, msg->data.data(), msg->data.size(), MSG_DONTWAIT) < 0) {
+                log.debugStream() << "DNS update to " << options.server << " not sent: "
+                                  << std::system_error(errno, std::system_category(), "send()").what();
+            }
+            ++msg;
+            continue;
+        }
+        // server is down, try again later unless a newer change came meanwhile
+        log.warnStream() << "DNS server " << options.server << " does not answer, "
+                         << msg->entries.size() << " addresses queued again";
+        failed_count.fetch_add(1, std::memory_order_relaxed);
+        complete(*msg, false);
+        for(const entry &value : msg->entries) {
+            pending.emplace(value.ip, value.wanted);
+        }
+        flush_at = now + options.timeout * (1 << std::min(options.retries, 16u));
+        msg = messages.erase(msg);
+    }
+}
+
+void ddns_updater::complete(const message &msg, bool applied)
+{
+    for(const entry &value : msg.entries) {
+        if(applied && msg.reverse) {
+            if(value.wanted.name.empty()) {
+                reverse.erase(value.ip);
+            }
+            else {
+                reverse[value.ip] = value.wanted.name;
+            }
+        }
+        else if(applied) {
+            if(value.action == step::remove) {
+                forward.erase(value.ip);
+            }
+            else {
+                forward[value.ip] = value.wanted;
+            }
+        }
+        auto count = in_flight.find(value.ip);
+        if(count != in_flight.end() && --count->second == 0) {
+            in_flight.erase(count);
+        }
+    }
+    if(!pending.empty()) {
+        // addresses held back by this message
+        flush_at = std::chrono::steady_clock::time_point();
+    }
+}
+
+void ddns_updater::resolve_conflict(const message &msg, uint8_t rcode)
+{
+    // prerequisites are checked for the whole message, find the failing one
+    if(msg.entries.size() > 1) {
+        for(const entry &value : msg.entries) {
+            single.emplace(value.ip, false);
+        }
+        log.debugStream() << "DNS update prerequisites not met, sending " << msg.entries.size() << " names one by one";
+        return;
+    }
+    const entry &value = msg.entries.front();
+    if(value.action == step::remove) {
+        // DHCID is gone, the name is not the client's to remove anymore
+        forward.erase(value.ip);
+        return;
+    }
+    if(value.action == step::add && rcode == rcode_yxdomain) {
+        // name in use, replace it if it belongs to the client
+        single[value.ip] = true;
+        return;
+    }
+    char addr_str[INET_ADDRSTRLEN];
+    in_addr addr = { htonl(value.ip) };
+    log.warnStream() << "DNS name " << value.wanted.name << "." << options.forwardZone
+                     << " of " << inet_ntop(AF_INET, &addr, addr_str, sizeof(addr_str))
+                     << " is in use by another host, not updated";
+    failed_count.fetch_add(1, std::memory_order_relaxed);
+    conflicts[value.ip] = value.wanted;
+    single.erase(value.ip);
+}
+
+bool ddns_updater::encode_forward(uint32_t ip, const host &wanted, bool replace, sections *out, step *action) const
+{
+    uint8_t address[4] = { static_cast<uint8_t>(ip >> 24), static_cast<uint8_t>(ip >> 16),
+                           static_cast<uint8_t>(ip >> 8), static_cast<uint8_t>(ip) };
+    std::vector<uint8_t> owner;
+    auto record = forward.find(ip);
+    if(record != forward.end()) {
+        if(record->second == wanted) {
+            return false;
+        }
+        // old name goes first, the new one is added when it is answered
+        std::vector<uint8_t> id = dhcid(record->second);
+        encode_labels({ record->second.name }, false, &owner);
+        owner.insert(owner.end(), zone_pointer, zone_pointer + 2);
+        put_rr(&out->prerequisites, owner, type_dhcid, class_in, 0, id.data(), id.size());
+        put_rr(&out->updates, owner, type_a, class_none, 0, address, sizeof(address));
+        put_rr(&out->updates, owner, type_dhcid, class_none, 0, id.data(), id.size());
+        out->prerequisite_count += 1;
+        out->update_count += 2;
+        *action = step::remove;
+        return true;
+    }
+    auto conflict = conflicts.find(ip);
+    if(wanted.name.empty() || (conflict != conflicts.end() && conflict->second == wanted)) {
+        return false;
+    }
+    std::vector<uint8_t> id = dhcid(wanted);
+    encode_labels({ wanted.name }, false, &owner);
+    owner.insert(owner.end(), zone_pointer, zone_pointer + 2);
+    if(replace) {
+        put_rr(&out->prerequisites, owner, type_dhcid, class_in, 0, id.data(), id.size());
+        put_rr(&out->updates, owner, type_a, class_any, 0, nullptr, 0);
+        put_rr(&out->updates, owner, type_a, class_in, options.ttl.count(), address, sizeof(address));
+        *action = step::replace;
+    }
+    else {
+        put_rr(&out->prerequisites, owner, type_any, class_none, 0, nullptr, 0);
+        put_rr(&out->updates, owner, type_a, class_in, options.ttl.count(), address, sizeof(address));
+        put_rr(&out->updates, owner, type_dhcid, class_in, options.ttl.count(), id.data(), id.size());
+        *action = step::add;
+    }
+    out->prerequisite_count += 1;
+    out->update_count += 2;
+    return true;
+}
+
+bool ddns_updater::encode_reverse(uint32_t ip, const std::string &name, sections *out) const
+{
+    if(reverse_zone.empty()) {
+        return false;
+    }
+    auto record = reverse.find(ip);
+    const std::string &current = (record != reverse.end()) ? record->second : std::string();
+    if(current == name) {
+        return false;
+    }
+    // <d>.<c>.<b>.<a>.in-addr.arpa relative to reverse zone
+    std::vector<std::string> labels;
+    for(int shift = 0; shift < 32; shift += 8) {
+        labels.push_back(std::to_string((ip >> shift) & 0xff));
+    }
+    labels.push_back("in-addr");
+    labels.push_back("arpa");
+    std::vector<std::string> zone_labels = split_labels(options.reverseZone);
+    if(zone_labels.size() > labels.size()
+            || !std::equal(zone_labels.begin(), zone_labels.end(), labels.end() - zone_labels.size())) {
+        return false;
+    }
+    labels.resize(labels.size() - zone_labels.size());
+    std::vector<uint8_t> owner;
+    encode_labels(labels, false, &owner);
+    owner.insert(owner.end(), zone_pointer, zone_pointer + 2);
+    put_rr(&out->updates, owner, type_ptr, class_any, 0, nullptr, 0);
+    out->update_count += 1;
+    if(!name.empty()) {
+        std::vector<uint8_t> target = fqdn(name);
+        put_rr(&out->updates, owner, type_ptr, class_in, options.ttl.count(), target.data(), target.size());
+        out->update_count += 1;
+    }
+    return true;
+}
+
+std::vector<uint8_t> ddns_updater::fqdn(const std::string &name) const
+{
+    std::vector<uint8_t> out;
+    encode_labels({ name }, false, &out);
+    out.insert(out.end(), forward_zone.begin(), forward_zone.end());
+    return out;
+}
+
+std::vector<uint8_t> ddns_updater::dhcid(const host &client) const
+{
+    // RFC 4701 3.3: digest of identifier and name in canonical wire format
+    std::vector<uint8_t> name = fqdn(client.name);
+    sha256 hash;
+    hash.update(&htype_ethernet, 1);
+    hash.update(client.mac.data(), client.mac.size());
+    hash.update(name.data(), name.size());
+    sha256::digest_type digest = hash.finish();
+
+    std::vector<uint8_t> rdata(dhcid_chaddr, dhcid_chaddr + sizeof(dhcid_chaddr));
+    rdata.push_back(dhcid_sha256);
+    rdata.insert(rdata.end(), digest.begin(), digest.end());
+    return rdata;
+}
+
+void ddns_updater::sections::clear()
+{
+    prerequisites.clear();
+    updates.clear();
+    prerequisite_count = 0;
+    update_count = 0;
+}
+
+void ddns_updater::sections::append(const sections &other)
+{
+    prerequisites.insert(prerequisites.end(), other.prerequisites.begin(), other.prerequisites.end());
+    updates.insert(updates.end(), other.updates.begin(), other.updates.end());
+    prerequisite_count += other.prerequisite_count;
+    update_count += other.update_count;
+}
@@ -0,0 +1,159 @@
+#ifndef NDHCPD_DDNS_UPDATER_HPP
+#define NDHCPD_DDNS_UPDATER_HPP
+
+#include <ndhcpd.hpp>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "file.hpp"
+#include "socket.hpp"
+#include "spsc_ring.hpp"
+
+#include <log4cpp/Category.hh>
+
+// Dynamic DNS updates (RFC 2136) for bound leases.
+// Packet thread only pushes lease changes into a bounded ring. Updater thread
+// coalesces them per address, so only the latest wanted name of an address is
+// sent and renewals with unchanged name send nothing, and packs them into
+// UPDATE messages, one zone per message. A limited number of messages is in
+// flight, unanswered ones are resent with doubled timeout, and addresses of
+// messages given up are queued again. Address is not sent again while its
+// previous message is in flight, so updates of one name are never reordered.
+// On ring overflow records of leases that are no longer bound are removed.
+// Names are claimed with RFC 4703 conflict detection: a name is added only
+// if it is not in use, together with a DHCID record (RFC 4701) of the
+// client, and replaced or removed only while that DHCID is still there, so
+// names of other hosts and clients are never taken over or deleted.
+class ddns_updater
+{
+public:
+    struct change {
+        uint32_t ip;
+        bool bound; // false when lease is released, expired or taken
+        std::array<uint8_t,6> mac;
+        uint8_t name_len;
+        char name[63]; // client Host Name option as sent, cut
+    };
+    typedef std::function<void(const std::function<void(const ndhcpd::lease_info&)>&)> snapshot_function;
+
+    ddns_updater();
+    ~ddns_updater();
+
+    ddns_updater(const ddns_updater&) = delete;
+    ddns_updater& operator=(const ddns_updater&) = delete;
+
+public:
+    void start(const ndhcpd::ddns_options &options, const snapshot_function &snapshot);
+    void stop();
+    ndhcpd::ddns_statistics stats() const;
+
+    // packet thread
+    bool active() const { return is_active.load(std::memory_order_relaxed); }
+    void push(const change &value);
+
+    // name the records of the change get
+    static std::string host_name(const change &value);
+
+private:
+    struct host {
+        std::string name; // empty to remove records
+        std::array<uint8_t,6> mac;
+        bool operator==(const host &other) const { return name == other.name && mac == other.mac; }
+        bool operator!=(const host &other) const { return !(*this == other); }
+    };
+    enum class step : uint8_t {
+        add,     // name not in use
+        replace, // name with DHCID of the client
+        remove
+    };
+    struct entry {
+        uint32_t ip;
+        host wanted;
+        step action;
+    };
+    struct sections {
+        std::vector<uint8_t> prerequisites;
+        std::vector<uint8_t> updates;
+        uint16_t prerequisite_count;
+        uint16_t update_count;
+        void clear();
+        size_t size() const { return prerequisites.size() + updates.size(); }
+        void append(const sections &other);
+    };
+    struct message {
+        uint16_t id;
+        bool reverse; // PTR records in reverse zone
+        std::vector<uint8_t> data;
+        sections records; // moved to data when sent
+        std::vector<entry> entries;
+        unsigned attempts;
+        std::chrono::steady_clock::time_point deadline;
+    };
+
+    void run();
+    void take(const change &value);
+    void resync();
+    void flush(std::chrono::steady_clock::time_point now);
+    void begin_message(message *msg, bool reverse);
+    void send_message(message *msg, std::chrono::steady_clock::time_point now);
+    void receive();
+    void check_timeouts(std::chrono::steady_clock::time_point now);
+    void complete(const message &msg, bool applied);
+    void resolve_conflict(const message &msg, uint8_t rcode);
+
+    // append records changing records of address, return false when nothing changes
+    bool encode_forward(uint32_t ip, const host &wanted, bool replace, sections *out, step *action) const;
+    bool encode_reverse(uint32_t ip, const std::string &name, sections *out) const;
+    std::vector<uint8_t> fqdn(const std::string &name) const;
+    std::vector<uint8_t> dhcid(const host &client) const;
+
+    static const size_t ring_size = 16384;
+    static const size_t batch_size = 512;
+    static const size_t max_message_size = 512; // RFC 1035 UDP limit
+    static const size_t max_in_flight = 16;
+    static const size_t flush_threshold = 256; // pending addresses sent without waiting for delay
+
+    ndhcpd::ddns_options options;
+    snapshot_function snapshot;
+    std::vector<uint8_t> forward_zone; // encoded names
+    std::vector<uint8_t> reverse_zone;
+
+    spsc_ring<change> ring;
+    std::atomic<bool> is_active;
+    std::atomic<bool> overflowed;
+    std::atomic<bool> sleeping;
+    std::atomic<bool> stop_thread;
+
+    std::atomic<uint64_t> queued_count;
+    std::atomic<uint64_t> dropped_count;
+    std::atomic<uint64_t> sent_count;
+    std::atomic<uint64_t> retried_count;
+    std::atomic<uint64_t> failed_count;
+    std::atomic<uint64_t> pending_count;
+
+    // updater thread state, names by address
+    std::map<uint32_t, host> pending; // wanted
+    std::map<uint32_t, host> forward; // A and DHCID records set
+    std::map<uint32_t, std::string> reverse; // PTR records set
+    std::map<uint32_t, bool> single; // sent in own message after conflict, true to replace
+    std::map<uint32_t, host> conflicts; // names in use by other clients, not sent again
+    std::map<uint32_t, unsigned> in_flight; // messages per address
+    std::vector<message> messages; // in flight
+    std::chrono::steady_clock::time_point flush_at;
+    uint16_t next_id;
+
+    Socket socket;
+    File wakeup;
+    std::thread thread;
+
+    log4cpp::Category &log;
+};
+
+#endif//NDHCPD_DDNS_UPDATER_HPP
@@ -0,0 +1,245 @@
+#ifndef NDHCPD_DHCP_OPTIONS_HPP
+#define NDHCPD_DHCP_OPTIONS_HPP
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <arpa/inet.h>
+
+#include "dhcp_packet.hpp"
+
+// Typed DHCP options. Wire format of every option the server reads or writes
+// is fixed by dhcp_option_traits at compile time, so values are read with
+// length checks and without unaligned access, written without runtime type
+// dispatch, and using an option without format does not compile.
+//
+// Format has value_type and
+//   static bool decode(const uint8_t *data, size_t len, value_type *value);
+//   static size_t size(const value_type &value);
+//   static void encode(const value_type &value, uint8_t *out); // size(value) bytes
+
+// IPv4 address, in host endiannes
+struct dhcp_ip_format {
+    typedef uint32_t value_type;
+    static bool decode(const uint8_t *data, size_t len, value_type *value)
+    {
+        if(len != 4) {
+            return false;
+        }
+        uint32_t n_value;
+        memcpy(&n_value, data, 4);
+        *value = ntohl(n_value);
+        return true;
+    }
+    static size_t size(const value_type &) { return 4; }
+    static void encode(const value_type &value, uint8_t *out)
+    {
+        uint32_t n_value = htonl(value);
+        memcpy(out, &n_value, 4);
+    }
+};
+
+// 32-bit number, e.g. time in seconds, in host endiannes
+struct dhcp_u32_format : dhcp_ip_format {};
+
+// one byte enumeration
+template<typename T>
+struct dhcp_u8_format {
+    static_assert(sizeof(T) == 1, "One byte type expected");
+    typedef T value_type;
+    static bool decode(const uint8_t *data, size_t len, value_type *value)
+    {
+        if(len != 1) {
+            return false;
+        }
+        *value = static_cast<T>(data[0]);
+        return true;
+    }
+    static size_t size(const value_type &) { return 1; }
+    static void encode(const value_type &value, uint8_t *out) { out[0] = static_cast<uint8_t>(value); }
+};
+
+// option without value, present or not
+struct dhcp_flag_format {
+    typedef bool value_type;
+    static bool decode(const uint8_t *, size_t len, value_type *value)
+    {
+        *value = true;
+        return len == 0;
+    }
+    static size_t size(const value_type &) { return 0; }
+    static void encode(const value_type &, uint8_t *) {}
+};
+
+// one or more IPv4 addresses, in host endiannes
+struct dhcp_ip_list_format {
+    typedef std::vector<uint32_t> value_type;
+    static bool decode(const uint8_t *data, size_t len, value_type *value)
+    {
+        if(len == 0 || len % 4 != 0) {
+            return false;
+        }
+        value->resize(len / 4);
+        for(size_t i = 0; i < value->size(); ++i) {
+            dhcp_ip_format::decode(data + i * 4, 4, &(*value)[i]);
+        }
+        return true;
+    }
+    static size_t size(const value_type &value) { return value.size() * 4; }
+    static void encode(const value_type &value, uint8_t *out)
+    {
+        for(uint32_t ip : value) {
+            dhcp_ip_format::encode(ip, out);
+            out += 4;
+        }
+    }
+};
+
+// NVT ASCII text, not terminated
+struct dhcp_string_format {
+    typedef std::string value_type;
+    static bool decode(const uint8_t *data, size_t len, value_type *value)
+    {
+        value->assign(reinterpret_cast<const char *>(data), len);
+        return len != 0;
+    }
+    static size_t size(const value_type &value) { return value.size(); }
+    static void encode(const value_type &value, uint8_t *out) { value.copy(reinterpret_cast<char *>(out), value.size()); }
+};
+
+// opaque bytes
+struct dhcp_bytes_format {
+    typedef std::vector<uint8_t> value_type;
+    static bool decode(const uint8_t *data, size_t len, value_type *value)
+    {
+        value->assign(data, data + len);
+        return len != 0;
+    }
+    static size_t size(const value_type &value) { return value.size(); }
+    static void encode(const value_type &value, uint8_t *out) { std::copy(value.begin(), value.end(), out); }
+};
+
+// RFC 3442 classless static routes, addresses in host endiannes
+struct dhcp_route {
+    uint32_t destination;
+    uint8_t prefix_length;
+    uint32_t router;
+};
+struct dhcp_routes_format {
+    typedef std::vector<dhcp_route> value_type;
+    static size_t destination_size(const dhcp_route &route) { return (route.prefix_length + 7) / 8; }
+    static bool decode(const uint8_t *data, size_t len, value_type *value)
+    {
+        value->clear();
+        const uint8_t *end = data + len;
+        while(data < end) {
+            dhcp_route route = { 0, data[0], 0 };
+            size_t dst_size = destination_size(route);
+            if(route.prefix_length > 32 || static_cast<size_t>(end - data) < 1 + dst_size + 4) {
+                return false;
+            }
+            uint8_t destination[4] = {};
+            memcpy(destination, data + 1, dst_size);
+            dhcp_ip_format::decode(destination, 4, &route.destination);
+            dhcp_ip_format::decode(data + 1 + dst_size, 4, &route.router);
+            value->push_back(route);
+            data += 1 + dst_size + 4;
+        }
+        return !value->empty();
+    }
+    static size_t size(const value_type &value)
+    {
+        size_t len = 0;
+        for(const dhcp_route &route : value) {
+            len += 1 + destination_size(route) + 4;
+        }
+        return len;
+    }
+    static void encode(const value_type &value, uint8_t *out)
+    {
+        for(const dhcp_route &route : value) {
+            uint8_t destination[4];
+            dhcp_ip_format::encode(route.destination, destination);
+            *out++ = route.prefix_length;
+            memcpy(out, destination, destination_size(route));
+            out += destination_size(route);
+            dhcp_ip_format::encode(route.router, out);
+            out += 4;
+        }
+    }
+};
+
+// Option registry, format of option by code
+template<dhcp_option::_code code>
+struct dhcp_option_traits;
+
+#define NDHCPD_DHCP_OPTION_FORMAT(code, format) \
+    template<> struct dhcp_option_traits<dhcp_option::_code::code> : format {}
+
+NDHCPD_DHCP_OPTION_FORMAT(subnet_mask, dhcp_ip_format);
+NDHCPD_DHCP_OPTION_FORMAT(router, dhcp_ip_list_format);
+NDHCPD_DHCP_OPTION_FORMAT(dns_servers, dhcp_ip_list_format);
+NDHCPD_DHCP_OPTION_FORMAT(host_name, dhcp_string_format);
+NDHCPD_DHCP_OPTION_FORMAT(domain_name, dhcp_string_format);
+NDHCPD_DHCP_OPTION_FORMAT(broadcast_address, dhcp_ip_format);
+NDHCPD_DHCP_OPTION_FORMAT(ntp_servers, dhcp_ip_list_format);
+NDHCPD_DHCP_OPTION_FORMAT(requested_ip, dhcp_ip_format);
+NDHCPD_DHCP_OPTION_FORMAT(lease_time, dhcp_u32_format);
+NDHCPD_DHCP_OPTION_FORMAT(message_type, dhcp_u8_format<dhcp_message_type>);
+NDHCPD_DHCP_OPTION_FORMAT(server_id, dhcp_ip_format);
+NDHCPD_DHCP_OPTION_FORMAT(renewal_time, dhcp_u32_format);
+NDHCPD_DHCP_OPTION_FORMAT(rebinding_time, dhcp_u32_format);
+NDHCPD_DHCP_OPTION_FORMAT(vendor_class, dhcp_string_format);
+NDHCPD_DHCP_OPTION_FORMAT(client_id, dhcp_bytes_format);
+NDHCPD_DHCP_OPTION_FORMAT(tftp_server, dhcp_string_format);
+NDHCPD_DHCP_OPTION_FORMAT(boot_file, dhcp_string_format);
+NDHCPD_DHCP_OPTION_FORMAT(user_class, dhcp_bytes_format);
+NDHCPD_DHCP_OPTION_FORMAT(rapid_commit, dhcp_flag_format);
+NDHCPD_DHCP_OPTION_FORMAT(relay_agent_info, dhcp_bytes_format);
+NDHCPD_DHCP_OPTION_FORMAT(client_arch, dhcp_bytes_format);
+NDHCPD_DHCP_OPTION_FORMAT(classless_routes, dhcp_routes_format);
+
+#undef NDHCPD_DHCP_OPTION_FORMAT
+
+// Reads option value, false if option is missing or malformed
+template<dhcp_option::_code code>
+inline bool dhcp_get(const dhcp_packet &packet, typename dhcp_option_traits<code>::value_type *value)
+{
+    const dhcp_option *option = dhcp_find_option(packet, code);
+    return option && dhcp_option_traits<code>::decode(reinterpret_cast<const uint8_t *>(option->value), option->len, value);
+}
+
+// Appends option to packet, false if value or packet has no room for it
+template<dhcp_option::_code code>
+inline bool dhcp_put(dhcp_packet *packet, const typename dhcp_option_traits<code>::value_type &value)
+{
+    size_t len = dhcp_option_traits<code>::size(value);
+    uint8_t *out = dhcp_reserve_option(packet, code, len);
+    if(!out) {
+        return false;
+    }
+    dhcp_option_traits<code>::encode(value, out);
+    return true;
+}
+
+// Appends encoded option to buffer, for options encoded once and copied into
+// replies by dhcp_append_options(). False if value is too long for an option.
+template<dhcp_option::_code code>
+inline bool dhcp_encode(const typename dhcp_option_traits<code>::value_type &value, std::vector<uint8_t> *out)
+{
+    size_t len = dhcp_option_traits<code>::size(value);
+    if(len > 255) {
+        return false;
+    }
+    size_t pos = out->size();
+    out->resize(pos + 2 + len);
+    (*out)[pos] = static_cast<uint8_t>(code);
+    (*out)[pos+1] = static_cast<uint8_t>(len);
+    dhcp_option_traits<code>::encode(value, out->data() + pos + 2);
+    return true;
+}
+
+#endif//NDHCPD_DHCP_OPTIONS_HPP
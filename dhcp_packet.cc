@@ -5,9 +5,16 @@
 
 struct dhcp_option* dhcp_find_option(const dhcp_packet &packet, dhcp_option::_code code)
 {
+    // options area may come from the wire, so never walk past its end
+    const uint8_t *options_end = packet.options + sizeof(packet.options);
     struct dhcp_option *option;
     option = (struct dhcp_option *)packet.options;
-    while(option->code != dhcp_option::_code::end) {
+    while((const uint8_t*)option < options_end && option->code != dhcp_option::_code::end) {
+        if(option->code != dhcp_option::_code::padding
+                && ((const uint8_t*)option->value > options_end
+                    || (const uint8_t*)option->value + option->len > options_end)) {
+            return nullptr;
+        }
         if(option->code == code) {
             return option;
         }
@@ -20,7 +27,7 @@ struct dhcp_option* dhcp_find_option(const dhcp_packet &packet, dhcp_option::_co
             break;
         }
     }
-    if(code == dhcp_option::_code::end) {
+    if(code == dhcp_option::_code::end && (const uint8_t*)option < options_end) {
         return option;
     }
     return nullptr;
@@ -42,7 +49,9 @@ void dhcp_add_option(dhcp_packet *packet, dhcp_option::_code code, uint8_t len,
 
     option->code = code;
     option->len = len;
-    memcpy(option->value, value, option->len);
+    if(len != 0) {
+        memcpy(option->value, value, option->len);
+    }
 
     // append END tag;
     option = (struct dhcp_option *)(((char*)option)+option->len+2);
@@ -50,6 +59,32 @@ void dhcp_add_option(dhcp_packet *packet, dhcp_option::_code code, uint8_t len,
 
 }
 
+uint8_t *dhcp_reserve_option(dhcp_packet *packet, dhcp_option::_code code, size_t len)
+{
+    struct dhcp_option *option = dhcp_find_option(*packet, dhcp_option::_code::end);
+    const uint8_t *options_end = packet->options + sizeof(packet->options);
+    // option and END tag after it
+    if(!option || len > 255 || (uint8_t*)option + 2 + len + 1 > options_end) {
+        return nullptr;
+    }
+    option->code = code;
+    option->len = static_cast<uint8_t>(len);
+    ((uint8_t*)option)[2 + len] = (uint8_t)dhcp_option::_code::end;
+    return (uint8_t*)option->value;
+}
+
+bool dhcp_append_options(dhcp_packet *packet, const uint8_t *options, size_t len)
+{
+    struct dhcp_option *option = dhcp_find_option(*packet, dhcp_option::_code::end);
+    const uint8_t *options_end = packet->options + sizeof(packet->options);
+    if(!option || (uint8_t*)option + len + 1 > options_end) {
+        return false;
+    }
+    memcpy(option, options, len);
+    ((uint8_t*)option)[len] = (uint8_t)dhcp_option::_code::end;
+    return true;
+}
+
 const char *dhcp_message_type_name(dhcp_message_type type)
 {
     switch (type) {
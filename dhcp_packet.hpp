@@ -2,6 +2,7 @@
 #define NDHCPD_DHCP_PACKET_HPP
 
 #include <stdint.h>
+#include <stddef.h>
 
 enum class dhcp_message_type : uint8_t {
     minval = 1,
@@ -22,10 +23,27 @@ struct dhcp_option {
     enum class _code : uint8_t {
         padding = 0,
         subnet_mask = 1,
+        router = 3,
+        dns_servers = 6,
+        host_name = 12,
+        domain_name = 15,
+        broadcast_address = 28,
+        ntp_servers = 42,
         requested_ip = 50,
         lease_time = 51,
         message_type = 53,
         server_id = 54,
+        renewal_time = 58,
+        rebinding_time = 59,
+        vendor_class = 60,
+        client_id = 61,
+        tftp_server = 66,
+        boot_file = 67,
+        user_class = 77,
+        rapid_commit = 80,
+        relay_agent_info = 82,
+        client_arch = 93, // RFC 4578
+        classless_routes = 121, // RFC 3442
         end = 255
     } code;
     uint8_t len;
@@ -58,10 +76,17 @@ struct dhcp_packet {
         uint8_t options[308];
 };
 
+struct dhcp_option *dhcp_find_option(const dhcp_packet &packet, dhcp_option::_code code);
 const void *dhcp_get_option(const dhcp_packet &packet, dhcp_option::_code code);
 
 void dhcp_add_option(dhcp_packet *packet, dhcp_option::_code code, uint8_t len, const void *value);
 
+// Appends option of len bytes, returns its value to be filled in, nullptr if
+// it does not fit into packet
+uint8_t *dhcp_reserve_option(dhcp_packet *packet, dhcp_option::_code code, size_t len);
+// Appends encoded options, false if they do not fit into packet
+bool dhcp_append_options(dhcp_packet *packet, const uint8_t *options, size_t len);
+
 template<typename T>
 inline void dhcp_add_option(dhcp_packet *packet, dhcp_option::_code code, const T& value) {
     static_assert(sizeof(value) < 256, "Value too big");
@@ -7,15 +7,187 @@
 extern "C" {
 
 typedef struct {int unused;} *ndhcpd_t;
+typedef struct {int unused;} *ndhcpd_executor_t;
 
+#define NDHCPD_DEFAULT_POOL (-1)
+#define NDHCPD_ANY_ARCHITECTURE (-1)
+
+enum {
+    NDHCPD_ALLOCATE_SEQUENTIAL = 0,
+    NDHCPD_ALLOCATE_HASH
+};
+
+enum {
+    NDHCPD_PROBE_NONE = 0,
+    NDHCPD_PROBE_ARP,
+    NDHCPD_PROBE_ICMP
+};
+
+enum {
+    NDHCPD_CLOCK_REAL = 0,
+    NDHCPD_CLOCK_COARSE,
+    NDHCPD_CLOCK_SIMULATED
+};
+
+enum {
+    NDHCPD_TRANSPORT_UDP = 0,
+    NDHCPD_TRANSPORT_PACKET_RING
+};
+
+typedef struct {
+    int ifindex;
+    uint32_t addr;
+    uint16_t port;
+    uint64_t timestamp;
+    uint32_t local_addr;
+} ndhcpd_packet_info_t;
+
+typedef struct {
+    uint32_t from;
+    uint32_t to;
+    uint32_t mask;
+} ndhcpd_range_t;
+
+typedef struct {
+    uint32_t destination;
+    uint8_t prefix_length;
+    uint32_t router;
+} ndhcpd_route_t;
+
+enum {
+    NDHCPD_LEASE_FREE = 0,
+    NDHCPD_LEASE_OFFERED,
+    NDHCPD_LEASE_BOUND,
+    NDHCPD_LEASE_EXPIRED,
+    NDHCPD_LEASE_QUARANTINED
+};
+
+typedef struct {
+    uint32_t ip;
+    uint8_t mac[6];
+    uint8_t state;
+    uint32_t remaining;
+} ndhcpd_lease_t;
+
+enum {
+    NDHCPD_EVENT_OFFERED = 0,
+    NDHCPD_EVENT_BOUND,
+    NDHCPD_EVENT_RENEWED,
+    NDHCPD_EVENT_RELEASED,
+    NDHCPD_EVENT_EXPIRED
+};
+
+typedef struct {
+    uint8_t type;
+    uint32_t ip;
+    uint8_t mac[6];
+    uint32_t lease_time;
+    uint64_t timestamp;
+} ndhcpd_lease_event_t;
+
+typedef struct {
+    uint64_t received;
+    uint64_t replied;
+    uint64_t dropped;
+    uint64_t latency_count;
+    uint64_t latency_total_ns;
+    uint64_t latency_max_ns;
+    uint64_t latency_histogram[16];
+    uint64_t shed;
+    uint64_t kernel_dropped;
+    uint64_t backlog;
+    uint64_t ignored;
+} ndhcpd_stats_t;
+
+typedef struct {
+    uint64_t queued;
+    uint64_t dropped;
+    uint64_t sent;
+    uint64_t retried;
+    uint64_t failed;
+    uint64_t pending;
+} ndhcpd_ddns_stats_t;
+
+typedef void (*ndhcpd_lease_event_cb)(const ndhcpd_lease_event_t *events, size_t count, void *arg);
+
+// Functions returning status give 0 on success, error code (EINVAL, EBUSY...)
+// on failure or -1 on unexpected error. Functions returning length, count,
+// pool or id give -1 on failure with errno set to the error code.
 ndhcpd_t ndhcpd_create() __THROW;
 void ndhcpd_delete(ndhcpd_t _ndhcpd) __THROW;
 void ndhcpd_setInterfaceName(ndhcpd_t _ndhcpd, const char *ifaceName) __THROW;
-void ndhcpd_addRange_s(ndhcpd_t _ndhcpd, const char *from, const char *to, const char *mask) __THROW;
-void ndhcpd_addRange_i(ndhcpd_t _ndhcpd, uint32_t from, uint32_t to, uint32_t mask) __THROW;
-void ndhcpd_addIp_s(ndhcpd_t _ndhcpd, const char *ip, const char *mask) __THROW;
-void ndhcpd_addIp_i(ndhcpd_t _ndhcpd, uint32_t ip, uint32_t mask) __THROW;
+int ndhcpd_addRange_s(ndhcpd_t _ndhcpd, const char *from, const char *to, const char *mask) __THROW;
+int ndhcpd_addRange_i(ndhcpd_t _ndhcpd, uint32_t from, uint32_t to, uint32_t mask) __THROW;
+int ndhcpd_addIp_s(ndhcpd_t _ndhcpd, const char *ip, const char *mask) __THROW;
+int ndhcpd_addIp_i(ndhcpd_t _ndhcpd, uint32_t ip, uint32_t mask) __THROW;
+// Bulk load, see ndhcpd::addRanges(). Pool index of every range is stored to pools.
+int ndhcpd_addRanges(ndhcpd_t _ndhcpd, const ndhcpd_range_t *ranges, size_t rangesCount, int *pools) __THROW;
+int ndhcpd_setPoolEnabled(ndhcpd_t _ndhcpd, int pool, int enable) __THROW;
+// pool NDHCPD_DEFAULT_POOL sets options for pools added later, times in seconds,
+// EINVAL unless leaseTime and offerTime are above 0 and t1 < t2 < leaseTime
+// when t1 or t2 is set
+int ndhcpd_setPoolTimers(ndhcpd_t _ndhcpd, int pool, uint32_t leaseTime, uint32_t offerTime, uint32_t t1, uint32_t t2) __THROW;
+int ndhcpd_setPoolLeaseJitter(ndhcpd_t _ndhcpd, int pool, unsigned percent) __THROW;
+int ndhcpd_setPoolAllocation(ndhcpd_t _ndhcpd, int pool, int policy, unsigned hashProbes) __THROW;
+int ndhcpd_setPoolRapidCommit(ndhcpd_t _ndhcpd, int pool, int enable) __THROW;
+int ndhcpd_setPoolConflictProbe(ndhcpd_t _ndhcpd, int pool, int probe, uint32_t timeoutMs, uint32_t quarantineTime) __THROW;
+// network options of pool, addresses in host endiannes, empty list or 0 for none
+int ndhcpd_setPoolRouters(ndhcpd_t _ndhcpd, int pool, const uint32_t *routers, size_t routersCount) __THROW;
+int ndhcpd_setPoolDnsServers(ndhcpd_t _ndhcpd, int pool, const uint32_t *servers, size_t serversCount) __THROW;
+int ndhcpd_setPoolDomainName(ndhcpd_t _ndhcpd, int pool, const char *domainName) __THROW;
+int ndhcpd_setPoolBroadcastAddress(ndhcpd_t _ndhcpd, int pool, uint32_t broadcastAddress) __THROW;
+int ndhcpd_setPoolNtpServers(ndhcpd_t _ndhcpd, int pool, const uint32_t *servers, size_t serversCount) __THROW;
+int ndhcpd_setPoolClasslessRoutes(ndhcpd_t _ndhcpd, int pool, const ndhcpd_route_t *routes, size_t routesCount) __THROW;
+int ndhcpd_setPoolInterface(ndhcpd_t _ndhcpd, int pool, const char *ifaceName) __THROW;
+int ndhcpd_setInterfaceServerId_s(ndhcpd_t _ndhcpd, const char *ifaceName, const char *serverId) __THROW;
+int ndhcpd_setInterfaceServerId_i(ndhcpd_t _ndhcpd, const char *ifaceName, uint32_t serverId) __THROW;
+// Client classes, see ndhcpd::addClassRule()
+int ndhcpd_addClassRule(ndhcpd_t _ndhcpd, const char *className, const char *rule) __THROW;
+int ndhcpd_clearClassRules(ndhcpd_t _ndhcpd) __THROW;
+int ndhcpd_setPoolClasses(ndhcpd_t _ndhcpd, int pool, const char *const *classes, size_t classesCount) __THROW;
+int ndhcpd_setClassOption(ndhcpd_t _ndhcpd, const char *className, uint8_t code, const void *value, size_t valueLen) __THROW;
+// Network boot, see ndhcpd::setBootOptions(), nextServer in host endiannes
+int ndhcpd_setBootOptions(ndhcpd_t _ndhcpd, int architecture, uint32_t nextServer,
+                          const char *serverName, const char *bootFile) __THROW;
+void ndhcpd_clearBootOptions(ndhcpd_t _ndhcpd) __THROW;
 int ndhcpd_ips(const ndhcpd_t _ndhcpd, uint32_t *ips, size_t ipsCount) __THROW;
+int ndhcpd_leases(const ndhcpd_t _ndhcpd, ndhcpd_lease_t *leases, size_t leasesCount) __THROW;
+int ndhcpd_exportLeases(ndhcpd_t _ndhcpd, const char *shmName) __THROW;
+int ndhcpd_subscribe(ndhcpd_t _ndhcpd, ndhcpd_lease_event_cb cb, void *arg) __THROW;
+void ndhcpd_unsubscribe(ndhcpd_t _ndhcpd, int id) __THROW;
+uint64_t ndhcpd_eventsDropped(const ndhcpd_t _ndhcpd) __THROW;
+void ndhcpd_setServerId_s(ndhcpd_t _ndhcpd, const char *serverId) __THROW;
+void ndhcpd_setServerId_i(ndhcpd_t _ndhcpd, uint32_t serverId) __THROW;
+// RFC 3074 hash buckets served, empty set serves all clients
+int ndhcpd_setHashBuckets(ndhcpd_t _ndhcpd, const uint8_t *buckets, size_t bucketsCount) __THROW;
+
+// Returns reply length, 0 if no reply needed
+int ndhcpd_processPacket(ndhcpd_t _ndhcpd, const void *request, size_t requestLen, const ndhcpd_packet_info_t *requestInfo,
+                         void *reply, size_t replyLen, ndhcpd_packet_info_t *replyInfo) __THROW;
+uint64_t ndhcpd_processTimers(ndhcpd_t _ndhcpd, uint64_t timestamp) __THROW;
+int ndhcpd_replicateTo(ndhcpd_t _ndhcpd, const char *peer, uint16_t port, uint32_t resyncSec) __THROW;
+int ndhcpd_replicateFrom(ndhcpd_t _ndhcpd, const char *address, uint16_t port, const char *peer) __THROW;
+int ndhcpd_takeOver(ndhcpd_t _ndhcpd) __THROW;
+// Dynamic DNS, see ndhcpd::setDdns(). NULL or empty server stops updates, 0 for default port and ttl.
+int ndhcpd_setDdns(ndhcpd_t _ndhcpd, const char *server, uint16_t port, const char *forwardZone, const char *reverseZone,
+                   uint32_t ttl) __THROW;
+int ndhcpd_ddnsStats(const ndhcpd_t _ndhcpd, ndhcpd_ddns_stats_t *stats) __THROW;
+int ndhcpd_setClock(ndhcpd_t _ndhcpd, int type) __THROW;
+int ndhcpd_advanceClock(ndhcpd_t _ndhcpd, uint64_t stepNs) __THROW;
+uint64_t ndhcpd_clockTime(const ndhcpd_t _ndhcpd) __THROW;
+
+int ndhcpd_setLowLatency(ndhcpd_t _ndhcpd, const int *cpus, size_t cpusCount, int priority,
+                         uint32_t busyPollUs, int preferBusyPoll, uint32_t spinUs) __THROW;
+int ndhcpd_stats(const ndhcpd_t _ndhcpd, ndhcpd_stats_t *stats) __THROW;
+int ndhcpd_dumpTrace(const ndhcpd_t _ndhcpd, const char *path) __THROW;
+
+// Event loop shared by many servers, see ndhcpd_executor
+ndhcpd_executor_t ndhcpd_executor_create(size_t threads) __THROW;
+void ndhcpd_executor_delete(ndhcpd_executor_t _executor) __THROW;
+size_t ndhcpd_executor_servers(const ndhcpd_executor_t _executor) __THROW;
+// NULL executor for own server thread
+int ndhcpd_setExecutor(ndhcpd_t _ndhcpd, ndhcpd_executor_t _executor) __THROW;
+int ndhcpd_setTransport(ndhcpd_t _ndhcpd, int type) __THROW;
 
 int ndhcpd_start(ndhcpd_t _ndhcpd) __THROW;
 int ndhcpd_stop(ndhcpd_t _ndhcpd) __THROW;
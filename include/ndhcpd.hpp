@@ -2,12 +2,36 @@
 #define NDHCPD_HPP
 
 #include <stdint.h>
+#include <array>
+#include <chrono>
 #include <string>
 #include <vector>
 #include <functional>
 #include <memory>
 
 class ndhcpd_private;
+class ndhcpd_executor_private;
+
+// Event loop shared by many servers in one process.
+// Fixed set of threads waits on sockets of all attached servers with epoll,
+// every server is served by one of them, so servers stay isolated.
+// Servers attached must be stopped before executor is destroyed.
+class ndhcpd_executor {
+public:
+    explicit ndhcpd_executor(size_t threads = 1);
+    ~ndhcpd_executor();
+
+    ndhcpd_executor(const ndhcpd_executor&) = delete;
+    ndhcpd_executor& operator=(const ndhcpd_executor&) = delete;
+
+public:
+    size_t threads() const;
+    size_t servers() const; // started servers attached
+
+private:
+    friend class ndhcpd;
+    std::unique_ptr<ndhcpd_executor_private> d;
+};
 
 class ndhcpd {
 public:
@@ -17,18 +41,302 @@ public:
     ndhcpd(const ndhcpd&) = delete;
     ndhcpd& operator=(const ndhcpd&) = delete;
 
+public:
+    enum class allocation_policy : uint8_t {
+        sequential, // first free address of the pool
+        hash        // address derived from client MAC
+    };
+    enum class conflict_probe : uint8_t {
+        none,
+        arp, // ARP probe on the bound interface
+        icmp // ICMP echo request
+    };
+    struct pool_options {
+        pool_options();
+        std::chrono::seconds leaseTime;
+        std::chrono::seconds offerTime; // how long offered address is held
+        std::chrono::seconds t1; // renewal time, 0 for 1/2 of lease time
+        std::chrono::seconds t2; // rebinding time, 0 for 7/8 of lease time
+        // Granted lease time is shortened by up to leaseJitter percent,
+        // derived from client MAC, to spread renewals of clients over time.
+        unsigned leaseJitter;
+        allocation_policy allocation;
+        unsigned hashProbes; // addresses tried after preferred one is taken
+        // Address is checked before it is offered by the started server,
+        // offer is sent if nobody answers within probeTimeout.
+        // Conflicting or declined addresses are not offered for quarantineTime.
+        conflict_probe conflictProbe;
+        std::chrono::milliseconds probeTimeout;
+        std::chrono::seconds quarantineTime;
+        // Answer DISCOVER with Rapid Commit option by ACK right away (RFC 4039)
+        bool rapidCommit;
+        // Network configuration sent with leases of the pool, addresses in
+        // host endiannes, empty or 0 for none. Encoded once when set.
+        std::vector<uint32_t> routers; // option 3
+        std::vector<uint32_t> dnsServers; // option 6
+        std::string domainName; // option 15
+        uint32_t broadcastAddress; // option 28
+        std::vector<uint32_t> ntpServers; // option 42
+        struct route {
+            uint32_t destination;
+            uint8_t prefixLength;
+            uint32_t router;
+        };
+        std::vector<route> classlessRoutes; // option 121, RFC 3442
+    };
+
 public:
     void setInterfaceName(const std::string& ifaceName);
-    void addRange(const std::string &from, const std::string &to, const std::string &mask);
-    void addRange(uint32_t from, uint32_t to, uint32_t mask); // in host endiannes
-    void addIp(const std::string &ip, const std::string &mask);
-    void addIp(uint32_t ip, uint32_t mask);
+    // Every range or ip added forms a pool, pool index is returned
+    int addRange(const std::string &from, const std::string &to, const std::string &mask);
+    int addRange(uint32_t from, uint32_t to, uint32_t mask); // in host endiannes
+    int addIp(const std::string &ip, const std::string &mask);
+    int addIp(uint32_t ip, uint32_t mask);
+    // Bulk load, one pool per range in given order. Addresses are inserted in
+    // ascending order, which is much faster than adding ranges one by one.
+    struct range {
+        uint32_t from; // in host endiannes
+        uint32_t to;
+        uint32_t mask;
+    };
+    std::vector<int> addRanges(const std::vector<range> &ranges);
+    // Disabled pool offers nothing and NAKs requests for its addresses,
+    // its leases are kept. Pools are enabled when added.
+    void setPoolEnabled(int pool, bool enabled);
+    pool_options defaultPoolOptions() const;
+    // Setters throw std::system_error with EINVAL unless lease and offer
+    // time are above 0 and, when T1 or T2 is set, T1 < T2 < lease time.
+    void setDefaultPoolOptions(const pool_options &options); // for pools added later
+    pool_options poolOptions(int pool) const;
+    void setPoolOptions(int pool, const pool_options &options);
+    // Multi-interface mode, when no interface name is set: one socket serves
+    // all interfaces. Pool bound to interface serves clients of that interface
+    // only, unbound pools serve all. Replies leave through the interface request
+    // arrived on, server_id is the address request arrived to, unless set for
+    // the interface. Interfaces are looked up again on start().
+    void setPoolInterface(int pool, const std::string &ifaceName); // empty for any
+    void setInterfaceServerId(const std::string &ifaceName, const std::string &serverId);
+    void setInterfaceServerId(const std::string &ifaceName, uint32_t serverId); // in host endiannes, INADDR_NONE to unset
+    // Client classes. Rule <field>=<value> puts matching clients into class:
+    //   mac=<aa:bb:cc>  hardware address prefix of 1 to 6 bytes
+    //   vendor=<value>  vendor class identifier (option 60)
+    //   user=<value>    user class (option 77)
+    //   circuit=<value> relay agent circuit id (option 82)
+    //   remote=<value>  relay agent remote id (option 82)
+    // Value is text or 0x<hex>, value ending with * matches as prefix.
+    // First matching rule wins. Rules are compiled when added, so classifying
+    // takes a few lookups however many rules there are. Set before start().
+    void addClassRule(const std::string &className, const std::string &rule);
+    void clearClassRules();
+    // Pool serves clients of these classes only, empty for all clients
+    void setPoolClasses(int pool, const std::vector<std::string> &classes);
+    // Option added to replies to clients of the class, replaces earlier value
+    void setClassOption(const std::string &className, uint8_t code, const std::vector<uint8_t> &value);
+    // Network boot (PXE). Client sending its architecture (option 93) or
+    // PXEClient vendor class gets next server (siaddr), server name (sname and
+    // option 66) and boot file (file and option 67) set for its architecture,
+    // or the ones set for any architecture. Boot replies are pre-rendered per
+    // architecture, so a boot storm is answered by copying templates.
+    static const int any_architecture = -1;
+    struct boot_options {
+        boot_options();
+        uint32_t nextServer; // in host endiannes, 0 for none
+        std::string serverName; // up to 63 characters
+        std::string bootFile; // up to 127 characters
+    };
+    void setBootOptions(int architecture, const boot_options &options);
+    void clearBootOptions();
     std::vector<uint32_t> ips() const;
 
+    enum class lease_state : uint8_t {
+        free,
+        offered, // not reported, unconfirmed offers are kept apart from leases
+        bound,
+        expired,
+        quarantined
+    };
+    struct lease_info {
+        uint32_t ip; // in host endiannes
+        std::array<uint8_t,6> mac;
+        lease_state state;
+        std::chrono::seconds remaining;
+    };
+    // Lease snapshot. Safe to call while the server is running and never
+    // blocks packet processing. Every lease is read consistently.
+    std::vector<lease_info> leases() const;
+    void forEachLease(const std::function<void(const lease_info&)> &fn) const;
+    // Mirrors lease table into named shared memory segment, see ndhcpd_shm.h.
+    // Empty name stops exporting. Applied like update(), so it must not be
+    // called from changes passed to it.
+    void exportLeases(const std::string &shmName);
+
+    enum class lease_event_type : uint8_t {
+        offered,
+        bound,
+        renewed,
+        released,
+        expired
+    };
+    struct lease_event {
+        lease_event_type type;
+        uint32_t ip; // in host endiannes
+        std::array<uint8_t,6> mac;
+        std::chrono::seconds lease_time;
+        uint64_t timestamp; // CLOCK_MONOTONIC nanoseconds
+    };
+    typedef std::function<void(const lease_event *events, size_t count)> lease_event_handler;
+    // Handlers are called in batches on a separate dispatcher thread.
+    // Events that do not fit into the queue are dropped and counted.
+    // Handlers must not call unsubscribe().
+    int subscribe(const lease_event_handler &handler);
+    void unsubscribe(int id);
+    uint64_t eventsDropped() const;
+    void setServerId(const std::string &serverId);
+    void setServerId(uint32_t serverId); // in host endiannes
+    // RFC 3074 load balancing between servers on one segment. Clients are
+    // hashed into 256 buckets by client identifier or MAC, DISCOVER and
+    // INIT-REBOOT REQUEST are answered for served buckets only. Empty set
+    // serves all clients. May be changed while the server is running.
+    void setHashBuckets(const std::vector<uint8_t> &buckets);
+    std::vector<uint8_t> hashBuckets() const;
+
+    // Lease replication between active and standby server.
+    // Active server streams lease changes to the standby over TCP and resends
+    // the full table every resyncInterval. Standby keeps a warm copy and takes
+    // the leases over on start(), or on takeOver() when driven by processPacket().
+    // Replication never blocks packet processing. Empty peer stops replication.
+    // Peer name is resolved here, connecting is retried in the background.
+    void replicateTo(const std::string &peer, uint16_t port,
+                     std::chrono::seconds resyncInterval = std::chrono::seconds(60));
+    // Standby listens on address, empty for any, and accepts leases from peer only.
+    void replicateFrom(const std::string &address, uint16_t port, const std::string &peer);
+    std::vector<lease_info> replicatedLeases() const;
+    void takeOver();
+
+    // Dynamic DNS (RFC 2136). Bound lease gets A record <name>.<forwardZone>
+    // and PTR record in reverseZone pointing to it, both are removed when the
+    // lease is released or expires. Name is the first label of client Host
+    // Name option (12) cut to letters, digits and hyphens, ip-<a>-<b>-<c>-<d>
+    // without one. Names are claimed as RFC 4703 describes: taken only when
+    // not in use and marked with a DHCID record of the client, names of
+    // other hosts or clients are left alone. Changes are coalesced per address
+    // and sent in batched UPDATE messages by a separate thread, packet
+    // processing never waits for DNS. Updates are not signed, DNS server has
+    // to allow them by address.
+    struct ddns_options {
+        ddns_options();
+        std::string server; // empty stops updates
+        uint16_t port;
+        std::string forwardZone;
+        std::string reverseZone; // e.g. 1.10.in-addr.arpa, empty for no PTR records
+        std::chrono::seconds ttl;
+        std::chrono::milliseconds delay; // changes are collected this long before sending
+        std::chrono::milliseconds timeout; // answer timeout, doubled with every retry
+        unsigned retries; // addresses of messages still unanswered are queued again
+    };
+    void setDdns(const ddns_options &options);
+    struct ddns_statistics {
+        uint64_t queued; // lease changes taken from server thread
+        uint64_t dropped; // lost on full queue
+        uint64_t sent; // UPDATE messages applied by DNS server
+        uint64_t retried; // UPDATE messages resent
+        uint64_t failed; // UPDATE messages refused or unanswered, names in use by others
+        uint64_t pending; // addresses waiting to be sent
+    };
+    ddns_statistics ddnsStats() const;
+
+public:
+    // Transport independent packet engine.
+    // Never does any I/O and never spawns threads, so it can be driven from
+    // a foreign event loop. Must not be used while the server is started.
+    struct packet_info {
+        int ifindex;        // interface index, 0 if unknown
+        uint32_t addr;      // IPv4 address, in host endiannes
+        uint16_t port;      // UDP port, in host endiannes
+        uint64_t timestamp; // CLOCK_MONOTONIC nanoseconds, 0 for current time
+        uint32_t localAddr; // address request arrived to or reply is sent from, 0 if unknown
+    };
+
+    // Processes raw request and writes reply into the caller-provided buffer.
+    // Returns reply length, or 0 if request does not need a reply. Reply
+    // destination is stored into replyInfo. Throws std::system_error if
+    // request is dropped.
+    size_t processPacket(const void *request, size_t requestLen, const packet_info &requestInfo,
+                         void *reply, size_t replyLen, packet_info *replyInfo);
+    // Runs lease timers up to timestamp (0 for current time).
+    // Returns timestamp of the next timer, or 0 if there is none.
+    uint64_t processTimers(uint64_t timestamp);
+
+    // Source of current time for leases. Coarse clock by default, real is
+    // steady_clock at full resolution. Simulated clock starts at current time
+    // and moves only by advanceClock(), for driving the engine through days
+    // of lease churn in seconds. Set before adding addresses, EBUSY is thrown
+    // while started.
+    enum class clock_type : uint8_t {
+        real,
+        coarse,
+        simulated
+    };
+    void setClock(clock_type type);
+    void advanceClock(std::chrono::nanoseconds step); // simulated clock only
+    uint64_t clockTime() const; // CLOCK_MONOTONIC nanoseconds
+
 public:
+    // Server thread tuning, applied on start()
+    struct low_latency_options {
+        low_latency_options();
+        std::vector<int> cpus; // pin server thread to these CPUs, empty to not pin
+        int priority; // SCHED_FIFO priority, 0 to keep default scheduling
+        std::chrono::microseconds busyPoll; // SO_BUSY_POLL, 0 to disable
+        bool preferBusyPoll; // SO_PREFER_BUSY_POLL
+        std::chrono::microseconds spin; // busy-spin before blocking, 0 to disable
+    };
+    void setLowLatency(const low_latency_options &options);
+
+    struct statistics {
+        static const size_t latency_buckets = 16;
+        uint64_t received;
+        uint64_t replied;
+        uint64_t dropped; // failed to process or send
+        uint64_t ignored; // served, no reply needed (foreign server id, unknown client...)
+        uint64_t shed; // DISCOVERs not served while overloaded
+        uint64_t kernelDropped; // lost on full socket buffer (SO_RXQ_OVFL)
+        uint64_t backlog; // bytes left queued on socket after last batch
+        // From kernel receive timestamp to reply sent
+        uint64_t latencyCount;
+        std::chrono::nanoseconds latencyTotal;
+        std::chrono::nanoseconds latencyMax;
+        // bucket i counts latencies below 2^i microseconds, last one the rest
+        std::array<uint64_t, latency_buckets> latencyHistogram;
+    };
+    statistics stats() const;
+    // Writes the last served packets to file, see ndhcpd_trace.h
+    void dumpTrace(const std::string &path) const;
+
+public:
+    // Started server is served by executor instead of its own thread,
+    // nullptr to go back to own thread. Low latency thread tuning and spin
+    // do not apply to executor threads. Set while server is stopped.
+    void setExecutor(ndhcpd_executor *executor);
+
+    // Packet ring reads requests from memory-mapped AF_PACKET ring of the
+    // bound interface and sends replies through tx ring, skipping the UDP
+    // stack. Needs interface name and CAP_NET_RAW. Applied on start().
+    enum class transport_type : uint8_t {
+        udp,
+        packet_ring
+    };
+    void setTransport(transport_type type);
+
     void start();
     void stop();
     bool isStarted() const;
+    // Runs changes on the thread serving the started server between packets
+    // and returns when they are applied, so pools, classes and options may be
+    // changed while it runs. Exception thrown by changes is rethrown here.
+    // Changes run right away when the server is stopped. Must not be called
+    // from changes.
+    void update(const std::function<void()> &changes);
 
 private:
     std::unique_ptr<ndhcpd_private> d;
@@ -0,0 +1,121 @@
+#ifndef NDHCPD_SHM_H
+#define NDHCPD_SHM_H
+
+/*
+ * Read-only client for the lease table exported by ndhcpd::exportLeases().
+ *
+ * Segment layout (version 1), all values in host endiannes:
+ *   ndhcpd_shm_header_t                     at offset 0
+ *   ndhcpd_shm_record_t[header.capacity]    at offset header.header_size
+ *
+ * Only the first header.count records are valid. Record is indexed by lease
+ * slot and its ip never changes. Every record is guarded by its own sequence
+ * lock: seq is odd while the server updates the record, so readers have to
+ * retry until they read the same even seq before and after the copy.
+ * The table may grow, readers should remap the segment when header.capacity
+ * exceeds the mapped size.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NDHCPD_SHM_MAGIC 0x4e444843u /* "NDHC" */
+#define NDHCPD_SHM_VERSION 1
+
+enum {
+    NDHCPD_SHM_LEASE_FREE = 0,
+    NDHCPD_SHM_LEASE_OFFERED,
+    NDHCPD_SHM_LEASE_BOUND,
+    NDHCPD_SHM_LEASE_EXPIRED,
+    NDHCPD_SHM_LEASE_QUARANTINED
+};
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t record_size;
+    uint32_t capacity;
+    uint32_t count;
+    uint64_t reserved;
+} ndhcpd_shm_header_t;
+
+typedef struct {
+    uint32_t seq;
+    uint32_t ip;
+    uint8_t mac[6];
+    uint8_t state;
+    uint8_t reserved;
+    uint64_t expires; /* CLOCK_MONOTONIC nanoseconds */
+} ndhcpd_shm_record_t;
+
+/* Maps segment read-only. Returns NULL on error. */
+static inline const ndhcpd_shm_header_t *ndhcpd_shm_attach(const char *name, size_t *mapped_size)
+{
+    int fd = shm_open(name, O_RDONLY, 0);
+    if(fd < 0) {
+        return NULL;
+    }
+    struct stat st;
+    if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ndhcpd_shm_header_t)) {
+        close(fd);
+        return NULL;
+    }
+    void *addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(addr == MAP_FAILED) {
+        return NULL;
+    }
+    const ndhcpd_shm_header_t *header = (const ndhcpd_shm_header_t *)addr;
+    if(header->magic != NDHCPD_SHM_MAGIC || header->version != NDHCPD_SHM_VERSION) {
+        munmap(addr, st.st_size);
+        return NULL;
+    }
+    *mapped_size = st.st_size;
+    return header;
+}
+
+static inline void ndhcpd_shm_detach(const ndhcpd_shm_header_t *header, size_t mapped_size)
+{
+    munmap((void *)header, mapped_size);
+}
+
+static inline uint32_t ndhcpd_shm_count(const ndhcpd_shm_header_t *header)
+{
+    return __atomic_load_n(&header->count, __ATOMIC_ACQUIRE);
+}
+
+static inline const ndhcpd_shm_record_t *ndhcpd_shm_records(const ndhcpd_shm_header_t *header)
+{
+    return (const ndhcpd_shm_record_t *)((const char *)header + header->header_size);
+}
+
+/* Copies record consistently */
+static inline void ndhcpd_shm_read(const ndhcpd_shm_record_t *record, ndhcpd_shm_record_t *out)
+{
+    uint32_t seq;
+    do {
+        seq = __atomic_load_n(&record->seq, __ATOMIC_ACQUIRE);
+        out->ip = __atomic_load_n(&record->ip, __ATOMIC_RELAXED);
+        uint64_t mac_state = __atomic_load_n((const uint64_t *)record->mac, __ATOMIC_RELAXED);
+        memcpy(out->mac, &mac_state, sizeof(mac_state));
+        out->expires = __atomic_load_n(&record->expires, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while((seq & 1) || seq != __atomic_load_n(&record->seq, __ATOMIC_RELAXED));
+    out->seq = seq;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif//NDHCPD_SHM_H
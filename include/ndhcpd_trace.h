@@ -0,0 +1,61 @@
+#ifndef NDHCPD_TRACE_H
+#define NDHCPD_TRACE_H
+
+/*
+ * Packet trace dump written by ndhcpd::dumpTrace().
+ *
+ * File layout (version 1), all values in host endiannes:
+ *   ndhcpd_trace_header_t                   at offset 0
+ *   ndhcpd_trace_record_t[header.count]     at offset header.header_size
+ *
+ * Records are ordered from oldest to newest. Timestamps are CLOCK_REALTIME
+ * nanoseconds, zero when the step did not happen.
+ */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NDHCPD_TRACE_MAGIC 0x4e445452u /* "NDTR" */
+#define NDHCPD_TRACE_VERSION 1
+#define NDHCPD_TRACE_NO_SLOT 0xffffffffu
+
+enum {
+    NDHCPD_TRACE_IGNORED = 0, /* processed, nothing to answer */
+    NDHCPD_TRACE_OFFER,
+    NDHCPD_TRACE_ACK,
+    NDHCPD_TRACE_NAK,
+    NDHCPD_TRACE_PARKED,      /* reply waits for conflict probe */
+    NDHCPD_TRACE_SHED,        /* not processed due to overload */
+    NDHCPD_TRACE_ERROR        /* error holds error code */
+};
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t record_size;
+    uint64_t count;
+} ndhcpd_trace_header_t;
+
+typedef struct {
+    uint64_t received;   /* kernel receive time */
+    uint64_t decided;
+    uint64_t sent;
+    uint32_t xid;        /* as on the wire */
+    uint32_t ip;         /* offered or acknowledged address */
+    uint32_t slot;       /* lease slot of ip, NDHCPD_TRACE_NO_SLOT if none */
+    uint8_t mac[6];
+    uint8_t message_type;
+    uint8_t decision;
+    uint16_t error;
+    uint8_t reserved[2];
+} ndhcpd_trace_record_t;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* NDHCPD_TRACE_H */
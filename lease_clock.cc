@@ -0,0 +1,32 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+#include "lease_clock.hpp"
+
+#include <time.h>
+
+lease_clock::time_point real_clock::now() const
+{
+    return std::chrono::steady_clock::now();
+}
+
+lease_clock::time_point coarse_clock::now() const
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return time_point(std::chrono::seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec));
+}
+
+simulated_clock::simulated_clock()
+    : time(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count())
+{
+}
+
+lease_clock::time_point simulated_clock::now() const
+{
+    return time_point(std::chrono::nanoseconds(time.load(std::memory_order_acquire)));
+}
+
+void simulated_clock::advance(std::chrono::nanoseconds step)
+{
+    time.fetch_add(step.count(), std::memory_order_acq_rel);
+}
@@ -0,0 +1,45 @@
+#ifndef NDHCPD_LEASE_CLOCK_HPP
+#define NDHCPD_LEASE_CLOCK_HPP
+
+#include <atomic>
+#include <chrono>
+
+// Time source for lease timing. All clocks share the steady_clock epoch
+// (CLOCK_MONOTONIC), so time points taken from different clocks compare.
+class lease_clock
+{
+public:
+    typedef std::chrono::steady_clock::time_point time_point;
+
+    virtual ~lease_clock() {}
+    virtual time_point now() const = 0;
+};
+
+// steady_clock, full resolution
+class real_clock : public lease_clock
+{
+public:
+    time_point now() const override;
+};
+
+// CLOCK_MONOTONIC_COARSE: last kernel tick, read from vDSO without a syscall.
+// Resolution is a few milliseconds, which is plenty for lease timers.
+class coarse_clock : public lease_clock
+{
+public:
+    time_point now() const override;
+};
+
+// Stands still until advanced, so lease churn of days can be simulated in seconds
+class simulated_clock : public lease_clock
+{
+public:
+    simulated_clock();
+    time_point now() const override;
+    void advance(std::chrono::nanoseconds step);
+
+private:
+    std::atomic<int64_t> time; // nanoseconds since epoch
+};
+
+#endif//NDHCPD_LEASE_CLOCK_HPP
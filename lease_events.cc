@@ -0,0 +1,106 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+#include "lease_events.hpp"
+
+#include <sys/eventfd.h>
+#include <poll.h>
+
+#include <vector>
+
+lease_event_queue::lease_event_queue()
+    : ring(ring_size)
+    , dropped_count(0)
+    , has_subscribers(false)
+    , sleeping(false)
+    , stop_dispatcher(false)
+    , next_id(1)
+    , log(log4cpp::Category::getInstance("ndhcpd.lib"))
+{
+}
+
+lease_event_queue::~lease_event_queue()
+{
+    stop();
+}
+
+int lease_event_queue::subscribe(const ndhcpd::lease_event_handler &handler)
+{
+    std::lock_guard<std::mutex> lock(subscribers_mutex);
+    if(!dispatcher.joinable()) {
+        File _wakeup(eventfd(0, EFD_NONBLOCK));
+        std::swap(wakeup, _wakeup);
+        stop_dispatcher = false;
+        dispatcher = std::thread(std::mem_fn(&lease_event_queue::dispatch), this);
+    }
+    int id = next_id++;
+    subscribers.emplace(id, handler);
+    has_subscribers = true;
+    return id;
+}
+
+void lease_event_queue::unsubscribe(int id)
+{
+    std::lock_guard<std::mutex> lock(subscribers_mutex);
+    subscribers.erase(id);
+    has_subscribers = !subscribers.empty();
+}
+
+void lease_event_queue::push(const ndhcpd::lease_event &event)
+{
+    if(!ring.push(event)) {
+        dropped_count.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(sleeping.load(std::memory_order_relaxed)) {
+        eventfd_write(wakeup, 1);
+    }
+}
+
+void lease_event_queue::stop()
+{
+    if(dispatcher.joinable()) {
+        stop_dispatcher = true;
+        eventfd_write(wakeup, 1);
+        dispatcher.join();
+    }
+    wakeup.close();
+}
+
+void lease_event_queue::dispatch()
+{
+    std::vector<ndhcpd::lease_event> batch(batch_size);
+    uint64_t reported_dropped = 0;
+
+    while(!stop_dispatcher) {
+        size_t count = ring.pop(batch.data(), batch.size());
+        if(count == 0) {
+            sleeping.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if(ring.empty()) {
+                struct pollfd pollFd = { wakeup, POLLIN, 0 };
+                poll(&pollFd, 1, -1);
+                eventfd_t val;
+                eventfd_read(wakeup, &val);
+            }
+            sleeping.store(false, std::memory_order_relaxed);
+            continue;
+        }
+
+        uint64_t _dropped = dropped();
+        if(_dropped != reported_dropped) {
+            log.warnStream() << "Lease event queue overflow, " << (_dropped - reported_dropped) << " events dropped";
+            reported_dropped = _dropped;
+        }
+
+        std::lock_guard<std::mutex> lock(subscribers_mutex);
+        for(auto &subscriber : subscribers) {
+            try {
+                subscriber.second(batch.data(), count);
+            }
+            catch(const std::exception &err) {
+                log.error(err.what());
+            }
+        }
+    }
+}
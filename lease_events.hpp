@@ -0,0 +1,60 @@
+#ifndef NDHCPD_LEASE_EVENTS_HPP
+#define NDHCPD_LEASE_EVENTS_HPP
+
+#include <ndhcpd.hpp>
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#include "file.hpp"
+#include "spsc_ring.hpp"
+
+#include <log4cpp/Category.hh>
+
+// Delivers lease events from the packet thread to subscribers.
+// Packet thread only pushes into a bounded ring, events are handed out
+// in batches on the dispatcher thread.
+class lease_event_queue
+{
+public:
+    lease_event_queue();
+    ~lease_event_queue();
+
+    lease_event_queue(const lease_event_queue&) = delete;
+    lease_event_queue& operator=(const lease_event_queue&) = delete;
+
+public:
+    int subscribe(const ndhcpd::lease_event_handler &handler);
+    void unsubscribe(int id);
+    uint64_t dropped() const { return dropped_count.load(std::memory_order_relaxed); }
+
+    // packet thread
+    bool active() const { return has_subscribers.load(std::memory_order_relaxed); }
+    void push(const ndhcpd::lease_event &event);
+
+private:
+    void dispatch();
+    void stop();
+
+    static const size_t ring_size = 4096;
+    static const size_t batch_size = 256;
+
+    spsc_ring<ndhcpd::lease_event> ring;
+    std::atomic<uint64_t> dropped_count;
+    std::atomic<bool> has_subscribers;
+    std::atomic<bool> sleeping;
+    std::atomic<bool> stop_dispatcher;
+
+    std::mutex subscribers_mutex;
+    std::map<int, ndhcpd::lease_event_handler> subscribers;
+    int next_id;
+
+    File wakeup;
+    std::thread dispatcher;
+
+    log4cpp::Category &log;
+};
+
+#endif//NDHCPD_LEASE_EVENTS_HPP
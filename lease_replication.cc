@@ -0,0 +1,509 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+#include "lease_replication.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <time.h>
+
+#include <algorithm>
+#include <system_error>
+
+// Wire format, all values in network byte order:
+//   header: magic u32, type u8, reserved u8, count u16, seq u64
+//   count records: ip u32, mac[6], state u8, reserved u8, expires i64
+// expires is CLOCK_REALTIME nanoseconds, so peers do not need a common boot time.
+
+static void read_all(int fd, void *buf, size_t len)
+{
+    while(len) {
+        ssize_t ret = recv(fd, buf, len, MSG_WAITALL);
+        if(ret < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            throw std::system_error(errno, std::system_category(), "recv()");
+        }
+        if(ret == 0) {
+            throw std::system_error(std::make_error_code(std::errc::connection_aborted), "recv()");
+        }
+        buf = static_cast<uint8_t*>(buf) + ret;
+        len -= ret;
+    }
+}
+
+static void write_all(int fd, const void *buf, size_t len)
+{
+    while(len) {
+        ssize_t ret = send(fd, buf, len, MSG_NOSIGNAL);
+        if(ret < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            throw std::system_error(errno, std::system_category(), "send()");
+        }
+        buf = static_cast<const uint8_t*>(buf) + ret;
+        len -= ret;
+    }
+}
+
+// stalled peer must not hold the replication thread forever
+static void set_timeouts(Socket &socket)
+{
+    struct timeval timeout = { 5, 0 };
+    socket.setsockopt(SOL_SOCKET, SO_SNDTIMEO, timeout);
+    socket.setsockopt(SOL_SOCKET, SO_RCVTIMEO, timeout);
+}
+
+lease_replication::lease_replication()
+    : port(0)
+    , resync_interval(0)
+    , ring(ring_size)
+    , is_active(false)
+    , is_standby(false)
+    , overflowed(false)
+    , sleeping(false)
+    , stop_thread(false)
+    , next_seq(0)
+    , resync_requested(false)
+    , expected_seq(0)
+    , in_sync(false)
+    , log(log4cpp::Category::getInstance("ndhcpd.lib"))
+{
+}
+
+lease_replication::~lease_replication()
+{
+    stop();
+}
+
+void lease_replication::start_active(const std::string &_peer, uint16_t _port, std::chrono::seconds _resync_interval,
+                                     const snapshot_function &_snapshot, const clock_function &_now)
+{
+    stop();
+    // resolved once, name lookup can not be interrupted by stop()
+    peer_addr = resolve(_peer, _port);
+    peer = _peer;
+    port = _port;
+    resync_interval = std::max(_resync_interval, std::chrono::seconds(1));
+    snapshot = _snapshot;
+    now = _now;
+    File _wakeup(eventfd(0, EFD_NONBLOCK));
+    std::swap(wakeup, _wakeup);
+    stop_thread = false;
+    overflowed = false;
+    is_active = true;
+    thread = std::thread(std::mem_fn(&lease_replication::run_active), this);
+    log.infoStream() << "Replicating leases to " << peer << ":" << port;
+}
+
+void lease_replication::start_standby(const std::string &address, uint16_t _port, const std::string &_peer)
+{
+    stop();
+    if(_peer.empty()) {
+        throw std::system_error(std::make_error_code(std::errc::invalid_argument), "start_standby()");
+    }
+    // lease table is taken from the active server only
+    peer_addr = resolve(_peer, 0);
+    peer = _peer;
+    Socket _listener(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    _listener.setsockopt(SOL_SOCKET, SO_REUSEADDR, true);
+    _listener.bind(resolve(address, _port));
+    if(listen(_listener, 1) != 0) {
+        throw std::system_error(errno, std::system_category(), "listen()");
+    }
+    File _wakeup(eventfd(0, EFD_NONBLOCK));
+    std::swap(listener, _listener);
+    std::swap(wakeup, _wakeup);
+    {
+        std::lock_guard<std::mutex> lock(warm_mutex);
+        warm.clear();
+    }
+    staged.clear();
+    in_sync = false;
+    stop_thread = false;
+    is_standby = true;
+    thread = std::thread(std::mem_fn(&lease_replication::run_standby), this);
+    log.infoStream() << "Standby for lease replication from " << peer << " on port " << _port;
+}
+
+void lease_replication::stop()
+{
+    is_active = false;
+    if(thread.joinable()) {
+        stop_thread = true;
+        eventfd_write(wakeup, 1);
+        thread.join();
+    }
+    is_standby = false;
+    connection.close();
+    listener.close();
+    wakeup.close();
+    change discarded;
+    while(ring.pop(&discarded, 1)) {
+    }
+}
+
+void lease_replication::push(const change &value)
+{
+    if(!ring.push(value)) {
+        overflowed.store(true, std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(sleeping.load(std::memory_order_relaxed)) {
+        eventfd_write(wakeup, 1);
+    }
+}
+
+std::vector<ndhcpd::lease_info> lease_replication::warm_copy() const
+{
+    std::lock_guard<std::mutex> lock(warm_mutex);
+    int64_t wall = wall_now();
+    std::vector<ndhcpd::lease_info> out;
+    out.reserve(warm.size());
+    for(const auto &lease : warm) {
+        ndhcpd::lease_info info;
+        info.ip = lease.first;
+        info.mac = lease.second.mac;
+        info.state = lease.second.state;
+        info.remaining = std::chrono::seconds(0);
+        if(lease.second.expires > wall) {
+            info.remaining = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::nanoseconds(lease.second.expires - wall));
+        }
+        else if(info.state == ndhcpd::lease_state::bound) {
+            info.state = ndhcpd::lease_state::expired;
+        }
+        out.push_back(info);
+    }
+    return out;
+}
+
+void lease_replication::run_active()
+{
+    std::vector<change> batch(batch_size);
+    std::vector<uint8_t> records;
+    std::chrono::steady_clock::time_point next_resync;
+    bool resync = true;
+
+    while(!stop_thread) {
+        try {
+            if(!connection) {
+                connect_peer();
+                resync = true;
+            }
+            if(overflowed.exchange(false) || resync_requested
+                    || std::chrono::steady_clock::now() >= next_resync) {
+                resync = true;
+            }
+            if(resync) {
+                send_snapshot();
+                resync = false;
+                resync_requested = false;
+                next_resync = std::chrono::steady_clock::now() + resync_interval;
+                continue;
+            }
+
+            size_t count = ring.pop(batch.data(), batch.size());
+            if(count == 0) {
+                int timeout = std::chrono::duration_cast<std::chrono::milliseconds>(next_resync - std::chrono::steady_clock::now()).count() + 1;
+                sleeping.store(true, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                bool readable = false;
+                if(ring.empty() && !overflowed.load(std::memory_order_relaxed)) {
+                    readable = wait(connection, std::max(timeout, 0));
+                }
+                sleeping.store(false, std::memory_order_relaxed);
+                if(readable && !read_message(connection)) {
+                    throw std::system_error(std::make_error_code(std::errc::connection_reset), "replication");
+                }
+                continue;
+            }
+
+            int64_t wall = wall_now();
+            std::chrono::steady_clock::time_point steady = now();
+            records.resize(count * record_size);
+            for(size_t i=0; i<count; ++i) {
+                encode(batch[i], wall, steady, &records[i*record_size]);
+            }
+            send_message(changes, next_seq, records.data(), count);
+            next_seq += count;
+        }
+        catch(const std::system_error &err) {
+            if(stop_thread) {
+                break;
+            }
+            if(connection) {
+                log.warnStream() << "Replication to " << peer << " interrupted: " << err.what();
+                connection.close();
+            }
+            else {
+                log.debugStream() << "Replication peer " << peer << " not reachable: " << err.what();
+            }
+            // retry later, changes are not queued meanwhile
+            wait(-1, 1000);
+            change discarded;
+            while(ring.pop(&discarded, 1)) {
+            }
+        }
+    }
+}
+
+void lease_replication::run_standby()
+{
+    while(!stop_thread) {
+        struct pollfd fds[3] = {
+            { wakeup, POLLIN, 0 },
+            { listener, POLLIN, 0 },
+            { connection ? connection.get_fd() : -1, POLLIN, 0 }
+        };
+        if(poll(fds, 3, -1) < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            log.error(std::system_error(errno, std::system_category(), "poll()").what());
+            break;
+        }
+        if(fds[0].revents) {
+            eventfd_t val;
+            eventfd_read(wakeup, &val);
+            continue;
+        }
+        if(fds[1].revents & POLLIN) {
+            sockaddr_in addr;
+            socklen_t addrLen = sizeof(addr);
+            int fd = accept(listener, reinterpret_cast<sockaddr*>(&addr), &addrLen);
+            char addr_str[INET_ADDRSTRLEN];
+            if(fd >= 0 && addr.sin_addr.s_addr != peer_addr.sin_addr.s_addr) {
+                log.warnStream() << "Replication from " << inet_ntop(AF_INET, &addr.sin_addr, addr_str, sizeof(addr_str))
+                                 << " refused, only " << peer << " is accepted";
+                Socket refused(AF_INET, SOCK_STREAM, IPPROTO_TCP, fd);
+            }
+            else if(fd >= 0) {
+                // newest active server wins
+                Socket _connection(AF_INET, SOCK_STREAM, IPPROTO_TCP, fd);
+                set_timeouts(_connection);
+                std::swap(connection, _connection);
+                in_sync = false;
+                log.infoStream() << "Replication from " << inet_ntop(AF_INET, &addr.sin_addr, addr_str, sizeof(addr_str));
+            }
+            continue;
+        }
+        if(fds[2].revents) {
+            try {
+                if(!read_message(connection)) {
+                    log.info("Replication peer disconnected");
+                    connection.close();
+                }
+            }
+            catch(const std::system_error &err) {
+                if(!stop_thread) {
+                    log.warnStream() << "Replication stream broken: " << err.what();
+                }
+                connection.close();
+            }
+        }
+    }
+}
+
+bool lease_replication::wait(int fd, int timeout, short events)
+{
+    struct pollfd fds[2] = {
+        { wakeup, POLLIN, 0 },
+        { fd, events, 0 }
+    };
+    int ret;
+    do {
+        ret = poll(fds, 2, timeout);
+    } while(ret < 0 && errno == EINTR && !stop_thread);
+    if(ret <= 0) {
+        return false;
+    }
+    if(fds[0].revents) {
+        eventfd_t val;
+        eventfd_read(wakeup, &val);
+    }
+    return fds[1].revents != 0;
+}
+
+void lease_replication::connect_peer()
+{
+    // connect in progress is given up when the thread is stopped
+    Socket _connection(AF_INET, SOCK_STREAM|SOCK_NONBLOCK, IPPROTO_TCP);
+    if(connect(_connection, reinterpret_cast<const sockaddr*>(&peer_addr), sizeof(peer_addr)) != 0) {
+        if(errno != EINPROGRESS) {
+            throw std::system_error(errno, std::system_category(), "connect()");
+        }
+        if(!wait(_connection, connect_timeout, POLLOUT)) {
+            throw std::system_error(std::make_error_code(std::errc::timed_out), "connect()");
+        }
+        int err = 0;
+        _connection.getsockopt(SOL_SOCKET, SO_ERROR, &err);
+        if(err != 0) {
+            throw std::system_error(err, std::system_category(), "connect()");
+        }
+    }
+    // stream is written and read blocking, bound by socket timeouts
+    if(fcntl(_connection, F_SETFL, fcntl(_connection, F_GETFL) & ~O_NONBLOCK) != 0) {
+        throw std::system_error(errno, std::system_category(), "fcntl()");
+    }
+    set_timeouts(_connection);
+    std::swap(connection, _connection);
+    log.infoStream() << "Connected to replication peer " << peer << ":" << port;
+}
+
+void lease_replication::send_snapshot()
+{
+    // changes queued so far are covered by the snapshot
+    change discarded;
+    while(ring.pop(&discarded, 1)) {
+    }
+
+    // copied out first, snapshot holds the lease table lock and the peer may stall
+    std::vector<uint8_t> records;
+    size_t total = 0;
+    int64_t wall = wall_now();
+    snapshot([&](const ndhcpd::lease_info &info) {
+        if(info.state == ndhcpd::lease_state::free) {
+            return;
+        }
+        records.resize((total+1) * record_size);
+        uint8_t *record = &records[total * record_size];
+        put_u32(record, info.ip);
+        memcpy(record+4, info.mac.data(), 6);
+        record[10] = static_cast<uint8_t>(info.state);
+        record[11] = 0;
+        put_u64(record+12, wall + std::chrono::duration_cast<std::chrono::nanoseconds>(info.remaining).count());
+        ++total;
+    });
+
+    send_message(snapshot_begin, next_seq, nullptr, 0);
+    for(size_t sent = 0, count; sent < total; sent += count) {
+        count = std::min(total - sent, static_cast<size_t>(batch_size));
+        send_message(snapshot_leases, next_seq, &records[sent * record_size], count);
+    }
+    send_message(snapshot_end, next_seq, nullptr, 0);
+    log.debugStream() << "Sent " << total << " leases to replication peer";
+}
+
+void lease_replication::send_message(message_type type, uint64_t seq, const uint8_t *records, size_t count)
+{
+    std::vector<uint8_t> message(header_size + count * record_size);
+    put_u32(&message[0], magic);
+    message[4] = type;
+    message[5] = 0;
+    put_u16(&message[6], count);
+    put_u64(&message[8], seq);
+    if(count) {
+        memcpy(&message[header_size], records, count * record_size);
+    }
+    write_all(connection, message.data(), message.size());
+}
+
+bool lease_replication::read_message(int fd)
+{
+    uint8_t header[header_size];
+    ssize_t ret;
+    do {
+        ret = recv(fd, header, 1, 0);
+    } while(ret < 0 && errno == EINTR);
+    if(ret == 0) {
+        return false;
+    }
+    if(ret < 0) {
+        throw std::system_error(errno, std::system_category(), "recv()");
+    }
+    read_all(fd, header+1, header_size-1);
+    if(get_u32(header) != magic) {
+        throw std::system_error(std::make_error_code(std::errc::protocol_error), "replication");
+    }
+    message_type type = static_cast<message_type>(header[4]);
+    size_t count = get_u16(header+6);
+    uint64_t seq = get_u64(header+8);
+    std::vector<uint8_t> records(count * record_size);
+    if(count) {
+        read_all(fd, records.data(), records.size());
+    }
+
+    switch(type) {
+    case changes:
+        if(!in_sync) {
+            break;
+        }
+        if(seq != expected_seq) {
+            log.warnStream() << "Replication gap, expected " << expected_seq << " got " << seq << ", requesting resync";
+            in_sync = false;
+            send_message(resync_request, expected_seq, nullptr, 0);
+            break;
+        }
+        {
+            std::lock_guard<std::mutex> lock(warm_mutex);
+            apply_records(records.data(), count, &warm);
+        }
+        expected_seq += count;
+        break;
+    case snapshot_begin:
+        staged.clear();
+        break;
+    case snapshot_leases:
+        apply_records(records.data(), count, &staged);
+        break;
+    case snapshot_end:
+        {
+            std::lock_guard<std::mutex> lock(warm_mutex);
+            std::swap(warm, staged);
+        }
+        staged.clear();
+        expected_seq = seq;
+        in_sync = true;
+        log.debugStream() << "Replicated " << warm.size() << " leases";
+        break;
+    case resync_request:
+        resync_requested = true;
+        break;
+    default:
+        throw std::system_error(std::make_error_code(std::errc::protocol_error), "replication");
+    }
+    return true;
+}
+
+void lease_replication::apply_records(const uint8_t *records, size_t count, warm_table *table)
+{
+    for(size_t i=0; i<count; ++i) {
+        const uint8_t *record = records + i*record_size;
+        uint32_t ip = get_u32(record);
+        ndhcpd::lease_state state = static_cast<ndhcpd::lease_state>(record[10]);
+        if(state == ndhcpd::lease_state::free) {
+            table->erase(ip);
+            continue;
+        }
+        warm_lease &lease = (*table)[ip];
+        std::copy(record+4, record+10, lease.mac.begin());
+        lease.state = state;
+        lease.expires = get_u64(record+12);
+    }
+}
+
+void lease_replication::encode(const change &value, int64_t wall, std::chrono::steady_clock::time_point steady, uint8_t *record)
+{
+    put_u32(record, value.ip);
+    memcpy(record+4, value.mac.data(), 6);
+    record[10] = static_cast<uint8_t>(value.state);
+    record[11] = 0;
+    int64_t expires = 0;
+    if(value.state != ndhcpd::lease_state::free) {
+        expires = wall + std::chrono::duration_cast<std::chrono::nanoseconds>(value.expires - steady).count();
+    }
+    put_u64(record+12, expires);
+}
+
+int64_t lease_replication::wall_now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
@@ -0,0 +1,128 @@
+#ifndef NDHCPD_LEASE_REPLICATION_HPP
+#define NDHCPD_LEASE_REPLICATION_HPP
+
+#include <ndhcpd.hpp>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <netinet/in.h>
+#include <poll.h>
+
+#include "file.hpp"
+#include "socket.hpp"
+#include "spsc_ring.hpp"
+
+#include <log4cpp/Category.hh>
+
+// Lease replication between active and standby server.
+// Active side streams every lease change to the standby over TCP. Packet
+// thread only pushes into a bounded ring; batches are written by the
+// replication thread without waiting for the peer. Full table is resent on
+// connect, periodically, on ring overflow and when the standby sees a gap
+// in sequence numbers. Standby keeps the received table as a warm copy.
+class lease_replication
+{
+public:
+    struct change {
+        uint32_t ip;
+        std::array<uint8_t,6> mac;
+        ndhcpd::lease_state state;
+        std::chrono::steady_clock::time_point expires;
+    };
+    typedef std::function<void(const std::function<void(const ndhcpd::lease_info&)>&)> snapshot_function;
+    typedef std::function<std::chrono::steady_clock::time_point()> clock_function;
+
+    lease_replication();
+    ~lease_replication();
+
+    lease_replication(const lease_replication&) = delete;
+    lease_replication& operator=(const lease_replication&) = delete;
+
+public:
+    void start_active(const std::string &peer, uint16_t port, std::chrono::seconds resync_interval,
+                      const snapshot_function &snapshot, const clock_function &now);
+    void start_standby(const std::string &address, uint16_t port, const std::string &peer);
+    void stop();
+
+    // packet thread
+    bool active() const { return is_active.load(std::memory_order_relaxed); }
+    void push(const change &value);
+
+    // standby warm copy, remaining time relative to now
+    bool standby() const { return is_standby.load(std::memory_order_relaxed); }
+    std::vector<ndhcpd::lease_info> warm_copy() const;
+
+private:
+    enum message_type : uint8_t {
+        changes = 1,      // seq is sequence number of the first change
+        snapshot_begin,
+        snapshot_leases,
+        snapshot_end,     // seq is sequence number of the next change
+        resync_request    // standby to active
+    };
+    static const uint32_t magic = 0x4e445250; // "NDRP"
+    static const size_t header_size = 16;
+    static const size_t record_size = 20;
+    static const size_t ring_size = 16384;
+    static const size_t batch_size = 512;
+    static const int connect_timeout = 5000; // ms
+
+    struct warm_lease {
+        std::array<uint8_t,6> mac;
+        ndhcpd::lease_state state;
+        int64_t expires; // CLOCK_REALTIME nanoseconds
+    };
+    typedef std::map<uint32_t, warm_lease> warm_table;
+
+    void run_active();
+    void run_standby();
+    bool wait(int fd, int timeout, short events = POLLIN);
+    void connect_peer();
+    void send_snapshot();
+    void send_message(message_type type, uint64_t seq, const uint8_t *records, size_t count);
+    bool read_message(int fd);
+    void apply_records(const uint8_t *records, size_t count, warm_table *table);
+    static void encode(const change &value, int64_t wall, std::chrono::steady_clock::time_point steady, uint8_t *record);
+
+    static int64_t wall_now();
+
+    std::string peer; // standby accepts connections from this address only
+    uint16_t port;
+    sockaddr_in peer_addr;
+    std::chrono::seconds resync_interval;
+    snapshot_function snapshot;
+    clock_function now;
+
+    spsc_ring<change> ring;
+    std::atomic<bool> is_active;
+    std::atomic<bool> is_standby;
+    std::atomic<bool> overflowed;
+    std::atomic<bool> sleeping;
+    std::atomic<bool> stop_thread;
+    uint64_t next_seq;
+    bool resync_requested;
+
+    // standby state
+    mutable std::mutex warm_mutex;
+    warm_table warm;
+    warm_table staged; // snapshot being received
+    uint64_t expected_seq;
+    bool in_sync;
+
+    Socket listener;
+    Socket connection;
+    File wakeup;
+    std::thread thread;
+
+    log4cpp::Category &log;
+};
+
+#endif//NDHCPD_LEASE_REPLICATION_HPP
@@ -0,0 +1,132 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+#include "lease_shm.hpp"
+
+#include <system_error>
+
+#include <string.h>
+
+lease_shm_export::lease_shm_export()
+    : header(nullptr)
+    , mapped_size(0)
+{
+}
+
+lease_shm_export::~lease_shm_export()
+{
+    close();
+}
+
+size_t lease_shm_export::segment_size(uint32_t capacity)
+{
+    return sizeof(ndhcpd_shm_header_t) + capacity*sizeof(ndhcpd_shm_record_t);
+}
+
+ndhcpd_shm_record_t *lease_shm_export::records() const
+{
+    return reinterpret_cast<ndhcpd_shm_record_t *>(reinterpret_cast<char *>(header) + header->header_size);
+}
+
+void lease_shm_export::open(const std::string &_name)
+{
+    close();
+    File _fd(shm_open(_name.c_str(), O_RDWR|O_CREAT|O_TRUNC, S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH));
+    std::swap(fd, _fd);
+    name = _name;
+    try {
+        map(256);
+    }
+    catch(...) {
+        close();
+        throw;
+    }
+    header->magic = NDHCPD_SHM_MAGIC;
+    header->version = NDHCPD_SHM_VERSION;
+    header->header_size = sizeof(ndhcpd_shm_header_t);
+    header->record_size = sizeof(ndhcpd_shm_record_t);
+    header->count = 0;
+}
+
+void lease_shm_export::close()
+{
+    if(header) {
+        munmap(header, mapped_size);
+        header = nullptr;
+        mapped_size = 0;
+    }
+    if(fd) {
+        fd.close();
+        shm_unlink(name.c_str());
+    }
+}
+
+void lease_shm_export::map(uint32_t capacity)
+{
+    size_t size = segment_size(capacity);
+    if(ftruncate(fd, size) != 0) {
+        throw std::system_error(errno, std::system_category(), "ftruncate()");
+    }
+    void *addr;
+    if(header) {
+        addr = mremap(header, mapped_size, size, MREMAP_MAYMOVE);
+    }
+    else {
+        addr = mmap(nullptr, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if(addr == MAP_FAILED) {
+        throw std::system_error(errno, std::system_category(), "mmap()");
+    }
+    header = static_cast<ndhcpd_shm_header_t *>(addr);
+    mapped_size = size;
+    __atomic_store_n(&header->capacity, capacity, __ATOMIC_RELEASE);
+}
+
+void lease_shm_export::add(uint32_t slot, uint32_t ip)
+{
+    if(!header) {
+        return;
+    }
+    if(slot >= header->capacity) {
+        uint32_t capacity = header->capacity;
+        while(slot >= capacity) {
+            capacity *= 2;
+        }
+        map(capacity);
+    }
+    ndhcpd_shm_record_t &record = records()[slot];
+    memset(&record, 0, sizeof(record));
+    record.ip = ip;
+    if(slot >= header->count) {
+        __atomic_store_n(&header->count, slot+1, __ATOMIC_RELEASE);
+    }
+}
+
+void lease_shm_export::clear()
+{
+    if(header) {
+        __atomic_store_n(&header->count, 0, __ATOMIC_RELEASE);
+    }
+}
+
+void lease_shm_export::publish(uint32_t slot, const uint8_t *mac, ndhcpd::lease_state state,
+                               std::chrono::steady_clock::time_point expires)
+{
+    if(!header || slot >= header->count) {
+        return;
+    }
+    uint8_t mac_state[8] = {0};
+    if(mac) {
+        memcpy(mac_state, mac, 6);
+    }
+    mac_state[6] = static_cast<uint8_t>(state);
+    uint64_t mac_state_value;
+    memcpy(&mac_state_value, mac_state, sizeof(mac_state_value));
+
+    ndhcpd_shm_record_t &record = records()[slot];
+    uint32_t seq = __atomic_load_n(&record.seq, __ATOMIC_RELAXED);
+    __atomic_store_n(&record.seq, seq+1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(reinterpret_cast<uint64_t *>(record.mac), mac_state_value, __ATOMIC_RELAXED);
+    __atomic_store_n(&record.expires, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(expires.time_since_epoch()).count()), __ATOMIC_RELAXED);
+    __atomic_store_n(&record.seq, seq+2, __ATOMIC_RELEASE);
+}
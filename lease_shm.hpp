@@ -0,0 +1,46 @@
+#ifndef NDHCPD_LEASE_SHM_HPP
+#define NDHCPD_LEASE_SHM_HPP
+
+#include <ndhcpd.hpp>
+#include <ndhcpd_shm.h>
+
+#include <chrono>
+#include <string>
+
+#include "file.hpp"
+
+// Writer side of the shared-memory lease table, see ndhcpd_shm.h for layout.
+class lease_shm_export
+{
+public:
+    lease_shm_export();
+    ~lease_shm_export();
+
+    lease_shm_export(const lease_shm_export&) = delete;
+    lease_shm_export& operator=(const lease_shm_export&) = delete;
+
+public:
+    void open(const std::string &name);
+    void close();
+    bool isOpen() const { return header != nullptr; }
+
+    // control path
+    void add(uint32_t slot, uint32_t ip);
+    void clear();
+
+    // packet path
+    void publish(uint32_t slot, const uint8_t *mac, ndhcpd::lease_state state,
+                 std::chrono::steady_clock::time_point expires);
+
+private:
+    void map(uint32_t capacity);
+    static size_t segment_size(uint32_t capacity);
+    ndhcpd_shm_record_t *records() const;
+
+    std::string name;
+    File fd;
+    ndhcpd_shm_header_t *header;
+    size_t mapped_size;
+};
+
+#endif//NDHCPD_LEASE_SHM_HPP
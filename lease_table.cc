@@ -0,0 +1,75 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+#include "lease_table.hpp"
+
+uint32_t lease_table::append(uint32_t ip)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    records.emplace_back(ip);
+    return records.size()-1;
+}
+
+void lease_table::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    records.clear();
+}
+
+size_t lease_table::size() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return records.size();
+}
+
+void lease_table::publish(uint32_t slot, const uint8_t *mac, ndhcpd::lease_state state,
+                          std::chrono::steady_clock::time_point expires)
+{
+    uint64_t mac_state = static_cast<uint64_t>(state) << 56;
+    if(mac) {
+        for(int i=0; i<6; ++i) {
+            mac_state |= static_cast<uint64_t>(mac[i]) << (8*(5-i));
+        }
+    }
+
+    record &r = records[slot];
+    uint32_t seq = r.seq.load(std::memory_order_relaxed);
+    r.seq.store(seq+1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    r.mac_state.store(mac_state, std::memory_order_relaxed);
+    r.expires.store(std::chrono::duration_cast<std::chrono::nanoseconds>(expires.time_since_epoch()).count(), std::memory_order_relaxed);
+    r.seq.store(seq+2, std::memory_order_release);
+}
+
+void lease_table::for_each(std::chrono::steady_clock::time_point now, const std::function<void (const ndhcpd::lease_info &)> &fn) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    for(const record &r : records) {
+        uint32_t seq;
+        uint64_t mac_state;
+        int64_t expires;
+        do {
+            seq = r.seq.load(std::memory_order_acquire);
+            mac_state = r.mac_state.load(std::memory_order_relaxed);
+            expires = r.expires.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+        } while((seq & 1) || seq != r.seq.load(std::memory_order_relaxed));
+
+        ndhcpd::lease_info info;
+        info.ip = r.ip.load(std::memory_order_relaxed);
+        for(int i=0; i<6; ++i) {
+            info.mac[i] = static_cast<uint8_t>(mac_state >> (8*(5-i)));
+        }
+        info.state = static_cast<ndhcpd::lease_state>(mac_state >> 56);
+        info.remaining = std::chrono::seconds(0);
+        if(info.state != ndhcpd::lease_state::free) {
+            std::chrono::steady_clock::time_point expires_at{std::chrono::nanoseconds(expires)};
+            if(expires_at > now) {
+                info.remaining = std::chrono::duration_cast<std::chrono::seconds>(expires_at - now);
+            }
+            else {
+                info.state = ndhcpd::lease_state::expired;
+            }
+        }
+        fn(info);
+    }
+}
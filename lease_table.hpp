@@ -0,0 +1,46 @@
+#ifndef NDHCPD_LEASE_TABLE_HPP
+#define NDHCPD_LEASE_TABLE_HPP
+
+#include <ndhcpd.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <mutex>
+
+// Lease state mirror readable from any thread.
+// Packet thread updates records without locking, every record is guarded
+// by its own sequence lock. Readers only lock against table reconfiguration.
+class lease_table
+{
+public:
+    // control path
+    uint32_t append(uint32_t ip);
+    void clear();
+    size_t size() const;
+
+    // packet path, never blocks
+    void publish(uint32_t slot, const uint8_t *mac, ndhcpd::lease_state state,
+                 std::chrono::steady_clock::time_point expires);
+
+    // readers
+    void for_each(std::chrono::steady_clock::time_point now, const std::function<void(const ndhcpd::lease_info&)> &fn) const;
+
+private:
+    struct record {
+        explicit record(uint32_t _ip)
+            : seq(0), ip(_ip), mac_state(0), expires(0)
+        {}
+
+        std::atomic<uint32_t> seq;
+        std::atomic<uint32_t> ip;
+        std::atomic<uint64_t> mac_state; // MAC in lower 48 bits, state in upper 8 bits
+        std::atomic<int64_t> expires; // steady_clock nanoseconds
+    };
+
+    mutable std::mutex mutex;
+    std::deque<record> records;
+};
+
+#endif//NDHCPD_LEASE_TABLE_HPP
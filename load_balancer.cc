@@ -0,0 +1,83 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+#include "load_balancer.hpp"
+
+#include <algorithm>
+
+// Pearson mixing table of RFC 3074, section 6
+const uint8_t load_balancer::mix_table[buckets] = {
+    251, 175, 119, 215,  81,  14,  79, 191, 103,  49, 181, 143, 186, 157,   0, 232,
+     31,  32,  55,  60, 152,  58,  17, 237, 174,  70, 160, 144, 220,  90,  57, 223,
+     59,   3,  18, 140, 111, 166, 203, 196, 134, 243, 124,  95, 222, 179, 197,  65,
+    180,  48,  36,  15, 107,  46, 233, 130, 165,  30, 123, 161, 209,  23,  97,  16,
+     40,  91, 219,  61, 100,  10, 210, 109, 250, 127,  22, 138,  29, 108, 244,  67,
+    207,   9, 178, 204,  74,  98, 126, 249, 167, 116,  34,  77, 193, 200, 121,   5,
+     20, 113,  71,  35, 128,  13, 182,  94,  25, 226, 227, 199,  75,  27,  41, 245,
+    230, 224,  43, 225, 177,  26, 155, 150, 212, 142, 218, 115, 241,  73,  88, 105,
+     39, 114,  62, 255, 192, 201, 145, 214, 168, 158, 221, 148, 154, 122,  12,  84,
+     82, 163,  44, 139, 228, 236, 205, 242, 217,  11, 187, 146, 159,  64,  86, 239,
+    195,  42, 106, 198, 118, 112, 184, 172,  87,   2, 173, 117, 176, 229, 247, 253,
+    137, 185,  99, 164, 102, 147,  45,  66, 231,  52, 141, 211, 194, 206, 246, 238,
+     56, 110,  78, 248,  63, 240, 189,  93,  92,  51,  53, 183,  19, 171,  72,  50,
+     33, 104, 101,  69,   8, 252,  83, 120,  76, 135,  85,  54, 202, 125, 188, 213,
+     96, 235, 136, 208, 162, 129, 190, 132, 156,  38,  47,   1,   7, 254,  24,   4,
+    216, 131,  89,  21,  28, 133,  37, 153, 149,  80, 170,  68,   6, 169, 234, 151
+};
+
+load_balancer::load_balancer()
+    : all(true)
+{
+    for(std::atomic<uint64_t> &word : bitmap) {
+        word.store(~uint64_t(0), std::memory_order_relaxed);
+    }
+}
+
+void load_balancer::set_buckets(const std::vector<uint8_t> &served)
+{
+    std::array<uint64_t, buckets/64> words;
+    words.fill(served.empty() ? ~uint64_t(0) : 0);
+    for(uint8_t bucket : served) {
+        words[bucket/64] |= uint64_t(1) << (bucket%64);
+    }
+    for(size_t i = 0; i < words.size(); ++i) {
+        bitmap[i].store(words[i], std::memory_order_relaxed);
+    }
+    all.store(served.empty(), std::memory_order_relaxed);
+}
+
+std::vector<uint8_t> load_balancer::served_buckets() const
+{
+    std::vector<uint8_t> served;
+    if(serves_all()) {
+        return served;
+    }
+    for(size_t bucket = 0; bucket < buckets; ++bucket) {
+        if(serves(static_cast<uint8_t>(bucket))) {
+            served.push_back(static_cast<uint8_t>(bucket));
+        }
+    }
+    return served;
+}
+
+bool load_balancer::serves(uint8_t bucket) const
+{
+    return bitmap[bucket/64].load(std::memory_order_relaxed) & (uint64_t(1) << (bucket%64));
+}
+
+uint8_t load_balancer::bucket(const dhcp_packet &packet)
+{
+    const struct dhcp_option *client_id = dhcp_find_option(packet, dhcp_option::_code::client_id);
+    if(client_id && client_id->len != 0) {
+        return hash(reinterpret_cast<const uint8_t *>(client_id->value), client_id->len);
+    }
+    return hash(packet.chaddr, std::min<size_t>(packet.hlen, sizeof(packet.chaddr)));
+}
+
+uint8_t load_balancer::hash(const uint8_t *key, size_t len)
+{
+    uint8_t value = static_cast<uint8_t>(len);
+    while(len > 0) {
+        value = mix_table[value ^ key[--len]];
+    }
+    return value;
+}
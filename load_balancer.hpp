@@ -0,0 +1,38 @@
+#ifndef NDHCPD_LOAD_BALANCER_HPP
+#define NDHCPD_LOAD_BALANCER_HPP
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+#include "dhcp_packet.hpp"
+
+// RFC 3074 load balancing.
+// Client identifier, or hardware address when there is none, is hashed into
+// one of 256 buckets. Server answers clients of its own buckets only.
+// Bucket set may be changed while the server is running.
+class load_balancer
+{
+public:
+    static const size_t buckets = 256;
+
+    load_balancer(); // serves all buckets
+
+    // empty set serves all buckets
+    void set_buckets(const std::vector<uint8_t> &served);
+    std::vector<uint8_t> served_buckets() const;
+    bool serves_all() const { return all.load(std::memory_order_relaxed); }
+    bool serves(uint8_t bucket) const;
+
+    static uint8_t bucket(const struct dhcp_packet &packet);
+    static uint8_t hash(const uint8_t *key, size_t len);
+
+private:
+    static const uint8_t mix_table[buckets];
+
+    std::array<std::atomic<uint64_t>, buckets/64> bitmap;
+    std::atomic<bool> all;
+};
+
+#endif//NDHCPD_LOAD_BALANCER_HPP
@@ -10,6 +10,11 @@
 #include <algorithm>
 #include <sstream>
 #include <functional>
+#include <chrono>
+#include <map>
+#include <set>
+#include <tuple>
+#include <iterator>
 
 #include <sys/stat.h>
 #include <errno.h>
@@ -18,14 +23,19 @@
 #include <fcntl.h>
 #include <signal.h>
 #include <poll.h>
+#include <arpa/inet.h>
 #include <string.h>
+#include <ctype.h>
 
 #include "file.hpp"
+#include "app_config.hpp"
 
 #include <log4cpp/PropertyConfigurator.hh>
 #include <log4cpp/Category.hh>
 
 static bool volatile sStop = false;
+static bool volatile sDumpTrace = false;
+static bool volatile sReload = false;
 
 
 template<typename T>
@@ -59,6 +69,541 @@ scope_exit<T> make_scope_exit(T&& exitFn)
     return scope_exit<T>(std::forward<T>(exitFn));
 }
 
+// pool of range loaded from configuration file
+struct loaded_range {
+    int pool;
+    uint32_t context; // in loaded configuration, no_context when range is removed and its pool disabled
+    bool seen; // during reload
+};
+static const uint32_t no_context = UINT32_MAX;
+typedef std::tuple<uint32_t, uint32_t, uint32_t> range_key;
+
+// FIFO command state and configuration file as loaded
+struct app_state {
+    ndhcpd::pool_options poolOptions;
+    ndhcpd::low_latency_options lowLatency;
+    std::string poolIface;
+    std::vector<std::string> poolClasses;
+    app_config config;
+    std::map<range_key, loaded_range> ranges;
+};
+
+// Applies "key=value" server thread tuning. Returns false for unknown option.
+static bool set_low_latency_option(ndhcpd::low_latency_options &options, const std::string &option)
+{
+    std::string::size_type pos = option.find('=');
+    if(pos == std::string::npos) {
+        return false;
+    }
+    std::string key(option, 0, pos);
+    std::string strValue(option, pos+1);
+    unsigned long value = strtoul(strValue.c_str(), nullptr, 10);
+    if(key == "cpus") {
+        // comma separated list of CPUs
+        options.cpus.clear();
+        std::istringstream cpus(strValue);
+        std::string cpu;
+        while(std::getline(cpus, cpu, ',')) {
+            if(!cpu.empty()) {
+                options.cpus.push_back(strtol(cpu.c_str(), nullptr, 10));
+            }
+        }
+    }
+    else if(key == "priority") {
+        options.priority = value;
+    }
+    else if(key == "busy_poll") {
+        options.busyPoll = std::chrono::microseconds(value);
+    }
+    else if(key == "prefer_busy_poll") {
+        options.preferBusyPoll = (value != 0);
+    }
+    else if(key == "spin") {
+        options.spin = std::chrono::microseconds(value);
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+
+// comma separated list of buckets and bucket ranges, e.g. 0-127,200
+static bool parse_hash_buckets(const std::string &list, std::vector<uint8_t> *buckets)
+{
+    std::istringstream items(list);
+    std::string item;
+    while(std::getline(items, item, ',')) {
+        if(item.empty()) {
+            continue;
+        }
+        char *end;
+        unsigned long from = strtoul(item.c_str(), &end, 10);
+        unsigned long to = from;
+        if(*end == '-') {
+            to = strtoul(end+1, &end, 10);
+        }
+        if(*end != '\0' || from > to || to > 255) {
+            return false;
+        }
+        for(unsigned long bucket = from; bucket <= to; ++bucket) {
+            buckets->push_back(static_cast<uint8_t>(bucket));
+        }
+    }
+    return true;
+}
+
+// text or 0x<hex>
+static bool parse_option_value(const std::string &text, std::vector<uint8_t> *value)
+{
+    if(text.compare(0, 2, "0x") != 0) {
+        value->assign(text.begin(), text.end());
+        return true;
+    }
+    if(text.size() % 2 != 0) {
+        return false;
+    }
+    for(size_t i = 2; i < text.size(); i += 2) {
+        std::string byte(text, i, 2);
+        char *end;
+        unsigned long val = strtoul(byte.c_str(), &end, 16);
+        if(*end != '\0' || !isxdigit(static_cast<unsigned char>(byte[0]))) {
+            return false;
+        }
+        value->push_back(static_cast<uint8_t>(val));
+    }
+    return true;
+}
+
+// Runs FIFO or configuration file command. Returns false on quit.
+static bool run_command(ndhcpd &srv, app_state &state, const std::string &cmd)
+{
+    log4cpp::Category &log = log4cpp::Category::getInstance("ndhcpd.app");
+    if(cmd.empty()) {
+        return true;
+    }
+    log.debugStream() << "Command \"" << cmd << "\"";
+    std::string cmdParam(cmd, 1);
+    std::string::size_type pos;
+    switch (cmd[0]) {
+    case 'i': // set interface name
+        log.infoStream() << "Set interface " << cmdParam;
+        srv.setInterfaceName(cmdParam);
+        break;
+    case 'a':
+    {
+        std::string subnet="255.255.255.0";
+        if((pos = cmdParam.find('/')) != std::string::npos) {
+            subnet.assign(cmdParam, pos+1, std::string::npos);
+            cmdParam.erase(pos);
+        }
+        if((pos = cmdParam.find('-')) != std::string::npos) {
+            std::string ipFrom(cmdParam, 0, pos);
+            std::string ipTo(cmdParam, pos+1);
+            log.infoStream() << "Add IP range " << ipFrom << "-" << ipTo << "/" << subnet;
+            int pool = srv.addRange(ipFrom, ipTo, subnet);
+            if(!state.poolIface.empty()) {
+                srv.setPoolInterface(pool, state.poolIface);
+            }
+            if(!state.poolClasses.empty()) {
+                srv.setPoolClasses(pool, state.poolClasses);
+            }
+        }
+        else {
+            log.infoStream() << "Add IP address " << cmdParam << "/" << subnet;
+            int pool = srv.addIp(cmdParam,subnet);
+            if(!state.poolIface.empty()) {
+                srv.setPoolInterface(pool, state.poolIface);
+            }
+            if(!state.poolClasses.empty()) {
+                srv.setPoolClasses(pool, state.poolClasses);
+            }
+        }
+    }
+        break;
+    case 'n': // pools added later serve interface, optionally with its server_id
+        if((pos = cmdParam.find('=')) != std::string::npos) {
+            state.poolIface.assign(cmdParam, 0, pos);
+            log.infoStream() << "Server id of " << state.poolIface << " is " << cmdParam.substr(pos+1);
+            srv.setInterfaceServerId(state.poolIface, cmdParam.substr(pos+1));
+        }
+        else {
+            state.poolIface = cmdParam;
+        }
+        log.infoStream() << "Add pools for interface " << (state.poolIface.empty() ? "any" : state.poolIface);
+        break;
+    case 'c': // client class rule <class> <field>=<value>
+        if((pos = cmdParam.find(' ')) != std::string::npos) {
+            try {
+                srv.addClassRule(cmdParam.substr(0, pos), cmdParam.substr(pos+1));
+                log.infoStream() << "Add class rule " << cmdParam;
+            }
+            catch(const std::system_error &err) {
+                log.warnStream() << "Invalid class rule " << cmdParam << ": " << err.what();
+            }
+        }
+        else if(cmdParam.empty()) {
+            log.info("Clear class rules");
+            srv.clearClassRules();
+        }
+        else {
+            log.warnStream() << "Invalid class rule " << cmdParam;
+        }
+        break;
+    case 'm': // pools added later serve members of these classes only
+    {
+        state.poolClasses.clear();
+        std::istringstream items(cmdParam);
+        std::string item;
+        while(std::getline(items, item, ',')) {
+            if(!item.empty()) {
+                state.poolClasses.push_back(item);
+            }
+        }
+        log.infoStream() << "Add pools for classes " << (cmdParam.empty() ? "all" : cmdParam);
+    }
+        break;
+    case 'x': // option for clients of class <class> <code>=<value>
+    {
+        std::string::size_type eq;
+        std::vector<uint8_t> value;
+        if((pos = cmdParam.find(' ')) != std::string::npos
+                && (eq = cmdParam.find('=', pos)) != std::string::npos
+                && parse_option_value(cmdParam.substr(eq+1), &value)) {
+            unsigned long code = strtoul(cmdParam.c_str()+pos+1, nullptr, 10);
+            try {
+                srv.setClassOption(cmdParam.substr(0, pos), static_cast<uint8_t>(code), value);
+                log.infoStream() << "Set class option " << cmdParam;
+            }
+            catch(const std::system_error &err) {
+                log.warnStream() << "Invalid class option " << cmdParam << ": " << err.what();
+            }
+        }
+        else {
+            log.warnStream() << "Invalid class option " << cmdParam;
+        }
+    }
+        break;
+    case 'p': // network boot <arch|*> <next_server> <boot_file> [<server_name>]
+    {
+        std::istringstream fields(cmdParam);
+        std::string arch, nextServer;
+        ndhcpd::boot_options boot;
+        fields >> arch >> nextServer >> boot.bootFile >> boot.serverName;
+        struct in_addr addr;
+        if(cmdParam.empty()) {
+            log.info("Clear network boot");
+            srv.clearBootOptions();
+        }
+        else if(!boot.bootFile.empty() && inet_aton(nextServer.c_str(), &addr)) {
+            boot.nextServer = ntohl(addr.s_addr);
+            try {
+                srv.setBootOptions(arch == "*" ? ndhcpd::any_architecture : atoi(arch.c_str()), boot);
+                log.infoStream() << "Set network boot " << cmdParam;
+            }
+            catch(const std::system_error &err) {
+                log.warnStream() << "Invalid network boot " << cmdParam << ": " << err.what();
+            }
+        }
+        else {
+            log.warnStream() << "Invalid network boot " << cmdParam;
+        }
+    }
+        break;
+    case 'o': // set option for pools added later
+    {
+        ndhcpd::pool_options options = state.poolOptions;
+        if(set_pool_option(options, cmdParam)) {
+            try {
+                srv.setDefaultPoolOptions(options);
+                state.poolOptions = options;
+                log.infoStream() << "Set pool option " << cmdParam;
+            }
+            catch(const std::system_error &err) {
+                log.warnStream() << "Invalid pool option " << cmdParam << ": " << err.what();
+            }
+        }
+        else {
+            log.warnStream() << "Unknown pool option " << cmdParam;
+        }
+    }
+        break;
+    case 'r': // replicate leases to standby <host>:<port>
+    case 'b': // be standby, receive leases on [<address>]:<port> from <active server>
+    {
+        std::string peer;
+        if(cmd[0] == 'b' && (pos = cmdParam.find(' ')) != std::string::npos) {
+            peer.assign(cmdParam, pos+1, std::string::npos);
+            cmdParam.erase(pos);
+        }
+        if((pos = cmdParam.rfind(':')) != std::string::npos) {
+            std::string host(cmdParam, 0, pos);
+            uint16_t port = strtoul(cmdParam.c_str()+pos+1, nullptr, 10);
+            try {
+                if(cmd[0] == 'r') {
+                    log.infoStream() << "Replicate leases to " << cmdParam;
+                    srv.replicateTo(host, port);
+                }
+                else {
+                    log.infoStream() << "Standby for leases on " << cmdParam << " from " << peer;
+                    srv.replicateFrom(host, port, peer);
+                }
+            }
+            catch(const std::system_error &err) {
+                log.warnStream() << "Invalid replication peer " << cmdParam << ": " << err.what();
+            }
+        }
+        else if(cmd[0] == 'r' && cmdParam.empty()) {
+            log.info("Stop lease replication");
+            srv.replicateTo(std::string(), 0);
+        }
+        else {
+            log.warnStream() << "Invalid replication peer " << cmdParam;
+        }
+    }
+        break;
+    case 'd': // dynamic DNS <server>[:<port>] <forward zone> [<reverse zone>]
+        if(cmdParam.empty()) {
+            log.info("Stop DNS updates");
+            srv.setDdns(ndhcpd::ddns_options());
+        }
+        else {
+            std::istringstream params(cmdParam);
+            std::string server;
+            ndhcpd::ddns_options options;
+            params >> server >> options.forwardZone >> options.reverseZone;
+            if((pos = server.rfind(':')) != std::string::npos) {
+                options.port = strtoul(server.c_str()+pos+1, nullptr, 10);
+                server.erase(pos);
+            }
+            options.server = server;
+            try {
+                srv.setDdns(options);
+                log.infoStream() << "Update DNS on " << cmdParam;
+            }
+            catch(const std::system_error &err) {
+                log.warnStream() << "Invalid DNS updates " << cmdParam << ": " << err.what();
+            }
+        }
+        break;
+    case 'h': // serve RFC 3074 hash buckets, empty for all
+    {
+        std::vector<uint8_t> buckets;
+        if(parse_hash_buckets(cmdParam, &buckets)) {
+            log.infoStream() << "Serve hash buckets " << (cmdParam.empty() ? "all" : cmdParam);
+            srv.setHashBuckets(buckets);
+        }
+        else {
+            log.warnStream() << "Invalid hash buckets " << cmdParam;
+        }
+    }
+        break;
+    case 't': // packet transport, applied on start
+        if(cmdParam == "udp") {
+            log.info("Use UDP transport");
+            srv.setTransport(ndhcpd::transport_type::udp);
+        }
+        else if(cmdParam == "packet_ring") {
+            log.info("Use packet ring transport");
+            srv.setTransport(ndhcpd::transport_type::packet_ring);
+        }
+        else {
+            log.warnStream() << "Unknown transport " << cmdParam;
+        }
+        break;
+    case 'l': // tune server thread latency
+        if(set_low_latency_option(state.lowLatency, cmdParam)) {
+            log.infoStream() << "Set latency option " << cmdParam;
+            srv.setLowLatency(state.lowLatency);
+        }
+        else {
+            log.warnStream() << "Unknown latency option " << cmdParam;
+        }
+        break;
+    case 's':
+        if(cmd == "stats") {
+            ndhcpd::statistics stats = srv.stats();
+            log.infoStream() << "Received " << stats.received << ", replied " << stats.replied
+                             << ", dropped " << stats.dropped << ", ignored " << stats.ignored
+                             << ", shed " << stats.shed
+                             << ", kernel dropped " << stats.kernelDropped << ", latency avg "
+                             << (stats.latencyCount ? (stats.latencyTotal / stats.latencyCount).count() : 0)
+                             << "ns max " << stats.latencyMax.count() << "ns";
+            ndhcpd::ddns_statistics ddns = srv.ddnsStats();
+            if(ddns.queued != 0 || ddns.dropped != 0) {
+                log.infoStream() << "DNS updates sent " << ddns.sent << ", retried " << ddns.retried
+                                 << ", failed " << ddns.failed << ", pending " << ddns.pending
+                                 << ", dropped " << ddns.dropped;
+            }
+            break;
+        }
+        else if(cmd == "start") {
+            log.info("Start service");
+            srv.start();
+        }
+        else if(cmd == "stop"){
+            log.info("Stop service");
+            srv.stop();
+            // pools are gone, configuration file is loaded anew on reload
+            state.config = app_config();
+            state.ranges.clear();
+        }
+    case 'q':
+        if(cmd == "quit") {
+            log.info("Caught 'quit' command. Exiting...");
+            return false;
+        }
+    default:
+        break;
+    }
+    return true;
+}
+
+static void set_pool_context(ndhcpd &srv, int pool, const app_config::pool_context &context)
+{
+    srv.setPoolOptions(pool, context.options);
+    srv.setPoolInterface(pool, context.iface);
+    srv.setPoolClasses(pool, context.classes);
+}
+
+// Replication, DNS updates, hash buckets and transport start threads,
+// resolve names or open sockets, they are not run by the server thread
+static bool is_server_setting(const std::string &cmd)
+{
+    return cmd[0] == 'r' || cmd[0] == 'b' || cmd[0] == 'd' || cmd[0] == 'h' || cmd[0] == 't';
+}
+
+// Runs server setting lines added to configuration file
+static void apply_server_settings(ndhcpd &srv, app_state &state, const app_config &config)
+{
+    log4cpp::Category &log = log4cpp::Category::getInstance("ndhcpd.app");
+    std::set<std::string> old_settings(state.config.commands.begin(), state.config.commands.end());
+    for(const std::string &cmd : config.commands) {
+        if(is_server_setting(cmd) && old_settings.count(cmd) == 0) {
+            try {
+                run_command(srv, state, cmd);
+            }
+            catch(const std::system_error &err) {
+                log.warnStream() << "Command " << cmd << " failed: " << err.what();
+            }
+        }
+    }
+}
+
+// Applies configuration file, changes against the one loaded before only.
+// Class rules and network boot are set anew when any of their lines change.
+// Ranges removed from the file are disabled, so their leases are kept.
+// Server settings are left to apply_server_settings().
+static void apply_config(ndhcpd &srv, app_state &state, app_config &config)
+{
+    log4cpp::Category &log = log4cpp::Category::getInstance("ndhcpd.app");
+    const std::vector<std::string> &old_commands = state.config.commands;
+    for(char kind : {'c', 'p'}) {
+        auto is_kind = [kind](const std::string &cmd) { return cmd[0] == kind; };
+        std::vector<std::string> old_lines, new_lines;
+        std::copy_if(old_commands.begin(), old_commands.end(), std::back_inserter(old_lines), is_kind);
+        std::copy_if(config.commands.begin(), config.commands.end(), std::back_inserter(new_lines), is_kind);
+        if(old_lines == new_lines) {
+            continue;
+        }
+        if(kind == 'c') {
+            srv.clearClassRules();
+        }
+        else {
+            srv.clearBootOptions();
+        }
+        for(const std::string &cmd : new_lines) {
+            run_command(srv, state, cmd);
+        }
+    }
+    std::set<std::string> old_settings(old_commands.begin(), old_commands.end());
+    std::set<std::string> new_settings(config.commands.begin(), config.commands.end());
+    for(const std::string &cmd : config.commands) {
+        if(cmd[0] != 'c' && cmd[0] != 'p' && !is_server_setting(cmd) && old_settings.count(cmd) == 0) {
+            try {
+                run_command(srv, state, cmd);
+            }
+            catch(const std::system_error &err) {
+                log.warnStream() << "Command " << cmd << " failed: " << err.what();
+            }
+        }
+    }
+    for(const std::string &cmd : old_commands) {
+        if(cmd[0] != 'c' && cmd[0] != 'p' && new_settings.count(cmd) == 0) {
+            log.warnStream() << "Removed " << cmd << " stays in effect until restart";
+        }
+    }
+
+    std::vector<ndhcpd::range> added;
+    std::vector<uint32_t> added_entries;
+    size_t changed = 0;
+    for(uint32_t i = 0; i < config.ranges.size(); ++i) {
+        const app_config::range_entry &entry = config.ranges[i];
+        auto loaded = state.ranges.find(range_key(entry.range.from, entry.range.to, entry.range.mask));
+        if(loaded == state.ranges.end()) {
+            added.push_back(entry.range);
+            added_entries.push_back(i);
+            continue;
+        }
+        if(loaded->second.seen) {
+            continue;
+        }
+        const app_config::pool_context &context = config.contexts[entry.context];
+        if(loaded->second.context == no_context || state.config.contexts[loaded->second.context].key != context.key) {
+            set_pool_context(srv, loaded->second.pool, context);
+            ++changed;
+        }
+        if(loaded->second.context == no_context) {
+            srv.setPoolEnabled(loaded->second.pool, true);
+        }
+        loaded->second.context = entry.context;
+        loaded->second.seen = true;
+    }
+    size_t removed = 0;
+    for(auto &loaded : state.ranges) {
+        if(!loaded.second.seen && loaded.second.context != no_context) {
+            srv.setPoolEnabled(loaded.second.pool, false);
+            loaded.second.context = no_context;
+            ++removed;
+        }
+        loaded.second.seen = false;
+    }
+    std::vector<int> pools = srv.addRanges(added);
+    for(size_t i = 0; i < pools.size(); ++i) {
+        const app_config::range_entry &entry = config.ranges[added_entries[i]];
+        set_pool_context(srv, pools[i], config.contexts[entry.context]);
+        state.ranges.emplace(range_key(entry.range.from, entry.range.to, entry.range.mask),
+                             loaded_range{pools[i], entry.context, false});
+    }
+    log.infoStream() << "Configuration applied: " << added.size() << " ranges added, "
+                     << changed << " changed, " << removed << " disabled";
+
+    // FIFO commands continue with settings at end of file
+    state.poolOptions = config.last.options;
+    state.poolIface = config.last.iface;
+    state.poolClasses = config.last.classes;
+    srv.setDefaultPoolOptions(state.poolOptions);
+    state.config = std::move(config);
+}
+
+// Loads configuration file, on reload while started pool, class, option and
+// network boot changes are applied by the server thread between packets
+static void load_config(ndhcpd &srv, app_state &state, const std::string &path)
+{
+    log4cpp::Category &log = log4cpp::Category::getInstance("ndhcpd.app");
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    app_config config;
+    config.load(path);
+    if(config.invalid > 0) {
+        log.warnStream() << "Skipped " << config.invalid << " invalid lines of " << path;
+    }
+    apply_server_settings(srv, state, config);
+    srv.update([&srv, &state, &config]() {
+        apply_config(srv, state, config);
+    });
+    log.infoStream() << "Configuration " << path << " loaded in "
+                     << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin).count() << "ms";
+}
+
 void sig_handler_exit(int signo, siginfo_t *siginfo, void *ctx)
 {
     log4cpp::Category::getInstance("ndhcpd.app").infoStream()
@@ -66,6 +611,16 @@ void sig_handler_exit(int signo, siginfo_t *siginfo, void *ctx)
     sStop = true;
 }
 
+void sig_handler_dump_trace(int signo)
+{
+    sDumpTrace = true;
+}
+
+void sig_handler_reload(int signo)
+{
+    sReload = true;
+}
+
 
 int main(int argc, char *argv[])
 {
@@ -93,16 +648,20 @@ int main(int argc, char *argv[])
         {"pipe", required_argument, nullptr, 'p'},
         {"group", required_argument, nullptr, 'g'},
         {"foreground", no_argument, nullptr, 'f'},
+        {"trace", required_argument, nullptr, 't'},
+        {"config", required_argument, nullptr, 'c'},
 	{0,0,0,0}
     };
 
     std::string pipe_path = "/var/tmp/ndhcpd";
     std::string pipe_group = "netdev";
+    std::string trace_path = "/var/tmp/ndhcpd.trace";
+    std::string config_path;
     bool daemonize = true;
 
     for(;;) {
         int opt_index;
-        int opt = getopt_long(argc, argv, "p:g:fvs:", options.data(), &opt_index);
+        int opt = getopt_long(argc, argv, "p:g:fvs:t:c:", options.data(), &opt_index);
         if(opt == -1) {
             break;
         }
@@ -116,6 +675,17 @@ int main(int argc, char *argv[])
         case 'f':
             daemonize = false;
             break;
+        case 't':
+            trace_path = optarg;
+            break;
+        case 'c':
+        {
+            // daemon() changes to root directory
+            char *path = realpath(optarg, nullptr);
+            config_path = path ? path : optarg;
+            free(path);
+        }
+            break;
         default:
             break;
         }
@@ -159,9 +729,17 @@ int main(int argc, char *argv[])
 
     sa.sa_handler = SIG_IGN;
     sa.sa_flags = SA_RESTART;
+    sigaction(SIGUSR2, &sa, NULL);
+
+    // SIGHUP reloads configuration file, no SA_RESTART to wake up poll()
+    sa.sa_handler = &sig_handler_reload;
+    sa.sa_flags = 0;
     sigaction(SIGHUP, &sa, NULL);
+
+    // SIGUSR1 dumps packet trace, no SA_RESTART to wake up poll()
+    sa.sa_handler = &sig_handler_dump_trace;
+    sa.sa_flags = 0;
     sigaction(SIGUSR1, &sa, NULL);
-    sigaction(SIGUSR2, &sa, NULL);
 
     try {
         const auto unlink_fifo(make_scope_exit(std::bind(&unlink, pipe_path.c_str())));
@@ -170,7 +748,40 @@ int main(int argc, char *argv[])
         File fifo(open(pipe_path.c_str(), O_RDWR|O_NONBLOCK));
         umask(oldUmask);
         ndhcpd srv;
+        app_state state;
+        if(!config_path.empty()) {
+            load_config(srv, state, config_path);
+            if(state.config.start) {
+                log.info("Start service");
+                srv.start();
+            }
+        }
         while(!sStop) {
+            if(sDumpTrace) {
+                sDumpTrace = false;
+                try {
+                    srv.dumpTrace(trace_path);
+                    log.infoStream() << "Packet trace written to " << trace_path;
+                }
+                catch(const std::system_error &err) {
+                    log.warn(err.what());
+                }
+            }
+            if(sReload) {
+                sReload = false;
+                if(config_path.empty()) {
+                    log.warn("No configuration file to reload");
+                }
+                else {
+                    try {
+                        log.infoStream() << "Reload " << config_path;
+                        load_config(srv, state, config_path);
+                    }
+                    catch(const std::system_error &err) {
+                        log.warn(err.what());
+                    }
+                }
+            }
             std::vector<char> buf(256);
 
             std::vector<struct pollfd> pollFds = {
@@ -214,50 +825,9 @@ int main(int argc, char *argv[])
                 }
             }
 
-            for(std::string cmd : cmds) {
-                log.debugStream() << "Command \"" << cmd << "\"";
-                std::string cmdParam(cmd, 1);
-                std::string::size_type pos;
-                switch (cmd[0]) {
-                case 'i': // set interface name
-                    log.infoStream() << "Set interface " << cmdParam;
-                    srv.setInterfaceName(cmdParam);
-                    break;
-                case 'a':
-                {
-                    std::string subnet="255.255.255.0";
-                    if((pos = cmdParam.find('/')) != std::string::npos) {
-                        subnet.assign(cmdParam, pos+1, std::string::npos);
-                        cmdParam.erase(pos);
-                    }
-                    if((pos = cmdParam.find('-')) != std::string::npos) {
-                        std::string ipFrom(cmdParam, 0, pos);
-                        std::string ipTo(cmdParam, pos+1);
-                        log.infoStream() << "Add IP range " << ipFrom << "-" << ipTo << "/" << subnet;
-                        srv.addRange(ipFrom, ipTo, subnet);
-                    }
-                    else {
-                        log.infoStream() << "Add IP address " << cmdParam << "/" << subnet;
-                        srv.addIp(cmdParam,subnet);
-                    }
-                }
-                    break;
-                case 's':
-                    if(cmd == "start") {
-                        log.info("Start service");
-                        srv.start();
-                    }
-                    else if(cmd == "stop"){
-                        log.info("Stop service");
-                        srv.stop();
-                    }
-                case 'q':
-                    if(cmd == "quit") {
-                        log.info("Caught 'quit' command. Exiting...");
-                        return EXIT_SUCCESS;
-                    }
-                default:
-                    break;
+            for(const std::string &cmd : cmds) {
+                if(!run_command(srv, state, cmd)) {
+                    return EXIT_SUCCESS;
                 }
             }
         }
@@ -0,0 +1,393 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+#include <ndhcpd.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <arpa/inet.h>
+
+// Drives the packet engine with simulated clients and reports replies per
+// second, packets per bound client or leases churned per second. Packets are
+// built here from the wire format, so only the public API is used.
+
+static const size_t packet_size = 548; // BOOTP header, cookie and options area
+static const size_t chaddr_offset = 28;
+static const size_t file_offset = 108;
+static const size_t options_offset = 240;
+static const uint32_t server_id = 0x0a000001; // 10.0.0.1
+
+enum : uint8_t {
+    DISCOVER = 1,
+    OFFER = 2,
+    REQUEST = 3,
+    ACK = 5
+};
+
+struct request {
+    std::vector<uint8_t> data;
+    size_t length;
+
+    explicit request(uint32_t client) : data(packet_size), length(options_offset) {
+        data[0] = 1; // BOOTREQUEST
+        data[1] = 1; // Ethernet
+        data[2] = 6;
+        uint32_t xid = htonl(client);
+        memcpy(&data[4], &xid, sizeof(xid));
+        data[chaddr_offset] = 0x02; // locally administered
+        data[chaddr_offset+1] = 0x00;
+        memcpy(&data[chaddr_offset+2], &xid, sizeof(xid));
+        static const uint8_t cookie[] = {0x63, 0x82, 0x53, 0x63};
+        memcpy(&data[236], cookie, sizeof(cookie));
+    }
+    void add(uint8_t code, const void *value, uint8_t len) {
+        data[length++] = code;
+        data[length++] = len;
+        if(len) {
+            memcpy(&data[length], value, len);
+        }
+        length += len;
+    }
+    void add_address(uint8_t code, uint32_t addr) {
+        addr = htonl(addr);
+        add(code, &addr, sizeof(addr));
+    }
+    void finish() {
+        data[length++] = 255;
+    }
+};
+
+static const uint8_t *find_option(const uint8_t *packet, size_t len, uint8_t code)
+{
+    for(size_t i=options_offset; i+1<len && packet[i] != 255; ) {
+        if(packet[i] == 0) {
+            ++i;
+            continue;
+        }
+        if(packet[i] == code) {
+            return packet + i;
+        }
+        i += 2 + packet[i+1];
+    }
+    return nullptr;
+}
+
+static uint8_t message_type(const uint8_t *packet, size_t len)
+{
+    const uint8_t *option = find_option(packet, len, 53);
+    return option && option[1] == 1 ? option[2] : 0;
+}
+
+static uint32_t your_address(const uint8_t *packet)
+{
+    uint32_t addr;
+    memcpy(&addr, packet + 16, sizeof(addr));
+    return ntohl(addr);
+}
+
+// Request broadcast by client without address
+static ndhcpd::packet_info client_broadcast()
+{
+    ndhcpd::packet_info info = ndhcpd::packet_info();
+    info.ifindex = 1;
+    info.addr = INADDR_BROADCAST;
+    info.port = 68;
+    return info;
+}
+
+// Network boot clients, half of them BIOS and half UEFI x64
+static request discover(uint32_t client, bool netboot, bool rapid_commit = false)
+{
+    request r(client);
+    uint8_t type = DISCOVER;
+    r.add(53, &type, 1);
+    if(rapid_commit) {
+        r.add(80, nullptr, 0);
+    }
+    if(netboot) {
+        uint8_t architecture[2] = {0, static_cast<uint8_t>(client % 2 ? 7 : 0)};
+        r.add(93, architecture, sizeof(architecture));
+        static const char vendor[] = "PXEClient:Arch:00000:UNDI:002001";
+        r.add(60, vendor, sizeof(vendor) - 1);
+    }
+    r.finish();
+    return r;
+}
+
+static request confirm(uint32_t client, bool netboot, uint32_t offered)
+{
+    request r(client);
+    uint8_t type = REQUEST;
+    r.add(53, &type, 1);
+    r.add_address(50, offered);
+    r.add_address(54, server_id);
+    if(netboot) {
+        uint8_t architecture[2] = {0, static_cast<uint8_t>(client % 2 ? 7 : 0)};
+        r.add(93, architecture, sizeof(architecture));
+    }
+    r.finish();
+    return r;
+}
+
+struct result {
+    size_t replies;
+    size_t bound;
+    size_t boot_replies; // carrying boot file
+    double seconds;
+};
+
+// Power-on of nodes at once: every node sends DISCOVER, then REQUEST for
+// the offered address. Requests are built before the clock starts.
+static result power_on(unsigned nodes, bool netboot)
+{
+    ndhcpd server;
+    ndhcpd::pool_options options = server.defaultPoolOptions();
+    options.allocation = ndhcpd::allocation_policy::hash;
+    server.setDefaultPoolOptions(options);
+    server.setServerId(server_id);
+    server.addRange(0x0a000100, 0x0a00ffff, 0xffff0000);
+    if(netboot) {
+        ndhcpd::boot_options boot;
+        boot.nextServer = server_id;
+        boot.serverName = "tftp";
+        boot.bootFile = "undionly.kpxe";
+        server.setBootOptions(0, boot);
+        boot.bootFile = "ipxe.efi";
+        server.setBootOptions(7, boot);
+    }
+
+    std::vector<request> discovers;
+    discovers.reserve(nodes);
+    for(unsigned i=0; i<nodes; ++i) {
+        discovers.push_back(discover(i+1, netboot));
+    }
+    std::vector<uint32_t> offered(nodes);
+    uint8_t reply[packet_size];
+    ndhcpd::packet_info in = client_broadcast();
+    ndhcpd::packet_info out;
+    result res = {0, 0, 0, 0};
+
+    auto start = std::chrono::steady_clock::now();
+    for(unsigned i=0; i<nodes; ++i) {
+        try {
+            size_t len = server.processPacket(discovers[i].data.data(), discovers[i].length, in, reply, sizeof(reply), &out);
+            if(len && message_type(reply, len) == OFFER) {
+                offered[i] = your_address(reply);
+                ++res.replies;
+                if(reply[file_offset]) {
+                    ++res.boot_replies;
+                }
+            }
+        }
+        catch(const std::system_error &) {
+        }
+    }
+    auto offered_at = std::chrono::steady_clock::now();
+    std::vector<request> requests;
+    requests.reserve(nodes);
+    for(unsigned i=0; i<nodes; ++i) {
+        requests.push_back(confirm(i+1, netboot, offered[i]));
+    }
+    auto requested_at = std::chrono::steady_clock::now();
+    for(unsigned i=0; i<nodes; ++i) {
+        if(!offered[i]) {
+            continue;
+        }
+        try {
+            size_t len = server.processPacket(requests[i].data.data(), requests[i].length, in, reply, sizeof(reply), &out);
+            if(len && message_type(reply, len) == ACK) {
+                ++res.replies;
+                ++res.bound;
+                if(reply[file_offset]) {
+                    ++res.boot_replies;
+                }
+            }
+        }
+        catch(const std::system_error &) {
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    res.seconds = std::chrono::duration<double>((offered_at - start) + (end - requested_at)).count();
+    return res;
+}
+
+static int boot_storm(unsigned nodes, unsigned rounds)
+{
+    printf("%u nodes powered on at once, best of %u rounds\n", nodes, rounds);
+    for(bool netboot : {false, true}) {
+        result best = {0, 0, 0, 0};
+        for(unsigned i=0; i<rounds; ++i) {
+            result res = power_on(nodes, netboot);
+            if(i == 0 || res.seconds < best.seconds) {
+                best = res;
+            }
+        }
+        if(best.bound != nodes || (netboot && best.boot_replies != best.replies)) {
+            fprintf(stderr, "%s: %zu of %u nodes bound, %zu boot replies\n",
+                    netboot ? "boot" : "plain", best.bound, nodes, best.boot_replies);
+            return EXIT_FAILURE;
+        }
+        printf("%-6s %zu replies in %.1f ms, %.0f replies/s\n", netboot ? "boot" : "plain",
+               best.replies, best.seconds * 1000, best.replies / best.seconds);
+    }
+    return EXIT_SUCCESS;
+}
+
+// Clients asking for Rapid Commit (RFC 4039) bind one by one, every packet
+// sent either way is counted. Pool allowing it ACKs the DISCOVER right away,
+// otherwise client goes on with REQUEST for the offered address.
+static int rapid_commit(unsigned clients)
+{
+    printf("%u clients asking for Rapid Commit\n", clients);
+    for(bool allowed : {false, true}) {
+        ndhcpd server;
+        ndhcpd::pool_options options = server.defaultPoolOptions();
+        options.rapidCommit = allowed;
+        server.setDefaultPoolOptions(options);
+        server.setServerId(server_id);
+        server.addRange(0x0a000100, 0x0a00ffff, 0xffff0000);
+
+        uint8_t reply[packet_size];
+        ndhcpd::packet_info in = client_broadcast();
+        ndhcpd::packet_info out;
+        size_t packets = 0;
+        size_t bound = 0;
+        size_t committed = 0; // ACKs with Rapid Commit option
+        for(unsigned i=0; i<clients; ++i) {
+            try {
+                request r = discover(i+1, false, true);
+                ++packets;
+                size_t len = server.processPacket(r.data.data(), r.length, in, reply, sizeof(reply), &out);
+                if(len) {
+                    ++packets;
+                }
+                uint8_t type = message_type(reply, len);
+                if(len && type == OFFER) {
+                    r = confirm(i+1, false, your_address(reply));
+                    ++packets;
+                    len = server.processPacket(r.data.data(), r.length, in, reply, sizeof(reply), &out);
+                    if(len) {
+                        ++packets;
+                    }
+                    type = message_type(reply, len);
+                }
+                if(len && type == ACK) {
+                    ++bound;
+                    if(find_option(reply, len, 80)) {
+                        ++committed;
+                    }
+                }
+            }
+            catch(const std::system_error &) {
+            }
+        }
+        if(bound != clients || committed != (allowed ? bound : 0)) {
+            fprintf(stderr, "%s: %zu of %u clients bound, %zu by Rapid Commit\n",
+                    allowed ? "rapid" : "normal", bound, clients, committed);
+            return EXIT_FAILURE;
+        }
+        printf("%-6s %zu packets, %.1f per bound client\n", allowed ? "rapid" : "normal",
+               packets, static_cast<double>(packets) / bound);
+    }
+    return EXIT_SUCCESS;
+}
+
+// Lease churn on simulated clock: every round a new generation of clients
+// binds all addresses of the pool, then the clock jumps past lease time and
+// timers expire the leases for the next round. Days of churn take seconds.
+static int lease_churn(unsigned clients, unsigned rounds)
+{
+    printf("%u clients per round, %u rounds of one hour leases\n", clients, rounds);
+    ndhcpd server;
+    server.setClock(ndhcpd::clock_type::simulated);
+    ndhcpd::pool_options options = server.defaultPoolOptions();
+    options.leaseTime = std::chrono::hours(1);
+    server.setDefaultPoolOptions(options);
+    server.setServerId(server_id);
+    server.addRange(0x0a000100, 0x0a000100 + clients - 1, 0xffff0000);
+
+    uint8_t reply[packet_size];
+    ndhcpd::packet_info in = client_broadcast();
+    ndhcpd::packet_info out;
+    size_t bound = 0;
+    size_t expired = 0;
+    std::chrono::duration<double> binding(0);
+    std::chrono::duration<double> expiring(0);
+    for(unsigned round=0; round<rounds; ++round) {
+        auto start = std::chrono::steady_clock::now();
+        for(unsigned i=0; i<clients; ++i) {
+            uint32_t client = round * clients + i + 1;
+            try {
+                request r = discover(client, false);
+                size_t len = server.processPacket(r.data.data(), r.length, in, reply, sizeof(reply), &out);
+                if(!len || message_type(reply, len) != OFFER) {
+                    continue;
+                }
+                r = confirm(client, false, your_address(reply));
+                len = server.processPacket(r.data.data(), r.length, in, reply, sizeof(reply), &out);
+                if(len && message_type(reply, len) == ACK) {
+                    ++bound;
+                }
+            }
+            catch(const std::system_error &) {
+            }
+        }
+        auto bound_at = std::chrono::steady_clock::now();
+        server.advanceClock(options.leaseTime + std::chrono::seconds(1));
+        server.processTimers(0);
+        auto end = std::chrono::steady_clock::now();
+        binding += bound_at - start;
+        expiring += end - bound_at;
+
+        size_t left = 0;
+        server.forEachLease([&](const ndhcpd::lease_info &info) {
+            if(info.state == ndhcpd::lease_state::bound) {
+                ++left;
+            }
+        });
+        expired += clients - left;
+    }
+    if(bound != static_cast<size_t>(clients) * rounds || expired != bound) {
+        fprintf(stderr, "churn: %zu of %zu leases bound, %zu expired\n",
+                bound, static_cast<size_t>(clients) * rounds, expired);
+        return EXIT_FAILURE;
+    }
+    double seconds = (binding + expiring).count();
+    printf("bound  %zu leases in %.1f ms, %.0f leases/s\n", bound, binding.count() * 1000, bound / binding.count());
+    printf("expiry %zu leases in %.1f ms, %.0f leases/s\n", expired, expiring.count() * 1000, expired / expiring.count());
+    printf("%u simulated hours in %.2f s\n", rounds, seconds);
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc < 2) {
+        fprintf(stderr, "Usage: %s boot [nodes [rounds]]\n"
+                        "       %s rapid [clients]\n"
+                        "       %s churn [clients [rounds]]\n", argv[0], argv[0], argv[0]);
+        return EXIT_FAILURE;
+    }
+    std::string scenario = argv[1];
+    unsigned count = argc > 2 ? strtoul(argv[2], nullptr, 10) : 5000;
+    unsigned rounds = argc > 3 ? strtoul(argv[3], nullptr, 10) : 5;
+    if(count == 0 || count > 0xfeff || rounds == 0) {
+        fprintf(stderr, "%s: 1 to %u clients and at least one round\n", argv[0], 0xfeff);
+        return EXIT_FAILURE;
+    }
+    if(scenario == "boot") {
+        return boot_storm(count, rounds);
+    }
+    if(scenario == "rapid") {
+        return rapid_commit(count);
+    }
+    if(scenario == "churn") {
+        return lease_churn(count, argc > 3 ? rounds : 24);
+    }
+    fprintf(stderr, "%s: unknown scenario %s\n", argv[0], scenario.c_str());
+    return EXIT_FAILURE;
+}
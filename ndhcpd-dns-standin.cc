@@ -0,0 +1,588 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+#include <cctype>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Stand-in DNS server for trying dynamic DNS updates without a real one.
+// Checks the wire format of every UPDATE message (RFC 2136) and applies it
+// with its prerequisites to records kept in memory. Reports messages resent
+// by the updater and updates changing nothing, which coalescing should have
+// left out. First messages can be dropped unanswered to see them resent, a
+// zone can be refused, and names of other hosts can be set up in advance to
+// see conflicts detected (RFC 4703). Prints records and totals on SIGINT or
+// SIGTERM, and fails if any message was malformed.
+
+static const size_t header_size = 12;
+static const size_t max_message_size = 512; // RFC 1035 UDP limit
+static const uint16_t opcode_update = 5;
+static const uint16_t flag_response = 0x8000;
+enum : uint16_t {
+    type_a = 1,
+    type_soa = 6,
+    type_ptr = 12,
+    type_dhcid = 49,
+    type_any = 255
+};
+enum : uint16_t {
+    class_in = 1,
+    class_none = 254,
+    class_any = 255
+};
+enum : uint8_t {
+    rcode_noerror = 0,
+    rcode_formerr = 1,
+    rcode_nxdomain = 3,
+    rcode_refused = 5,
+    rcode_yxdomain = 6,
+    rcode_yxrrset = 7,
+    rcode_nxrrset = 8,
+    rcode_notzone = 10
+};
+
+static const char *rcode_name(uint8_t rcode)
+{
+    switch(rcode) {
+    case rcode_noerror: return "NOERROR";
+    case rcode_formerr: return "FORMERR";
+    case rcode_nxdomain: return "NXDOMAIN";
+    case rcode_refused: return "REFUSED";
+    case rcode_yxdomain: return "YXDOMAIN";
+    case rcode_yxrrset: return "YXRRSET";
+    case rcode_nxrrset: return "NXRRSET";
+    case rcode_notzone: return "NOTZONE";
+    default: return "?";
+    }
+}
+
+static std::string type_name(uint16_t type)
+{
+    switch(type) {
+    case type_a: return "A";
+    case type_ptr: return "PTR";
+    case type_dhcid: return "DHCID";
+    default: return "TYPE" + std::to_string(type);
+    }
+}
+
+// names in lower case with trailing dot
+static std::string canonical(const std::string &name)
+{
+    std::string out;
+    for(char c : name) {
+        out.push_back(tolower(static_cast<unsigned char>(c)));
+    }
+    if(out.empty() || out.back() != '.') {
+        out.push_back('.');
+    }
+    return out;
+}
+
+static bool in_zone(const std::string &name, const std::string &zone)
+{
+    return name.size() >= zone.size()
+            && name.compare(name.size() - zone.size(), zone.size(), zone) == 0
+            && (name.size() == zone.size() || zone == "." || name[name.size() - zone.size() - 1] == '.');
+}
+
+struct resource_record {
+    std::string name;
+    uint16_t type;
+    uint16_t rr_class;
+    uint32_t ttl;
+    std::string rdata; // text form
+    size_t rdlength;
+};
+
+class message_reader
+{
+public:
+    message_reader(const uint8_t *data, size_t size) : data(data), size(size), pos(header_size) {}
+
+    const char *error = nullptr;
+
+    uint16_t u16(size_t at) const { return (data[at] << 8) | data[at+1]; }
+
+    bool name(std::string *out) {
+        size_t end = 0;
+        if(!name_at(pos, out, &end)) {
+            return false;
+        }
+        pos = end;
+        return true;
+    }
+
+    bool question(std::string *zone, uint16_t *type, uint16_t *zone_class) {
+        if(!name(zone)) {
+            return false;
+        }
+        if(pos + 4 > size) {
+            return fail("zone section cut");
+        }
+        *type = u16(pos);
+        *zone_class = u16(pos+2);
+        pos += 4;
+        return true;
+    }
+
+    bool record(resource_record *rr) {
+        if(!name(&rr->name)) {
+            return false;
+        }
+        if(pos + 10 > size) {
+            return fail("record cut");
+        }
+        rr->type = u16(pos);
+        rr->rr_class = u16(pos+2);
+        rr->ttl = (static_cast<uint32_t>(u16(pos+4)) << 16) | u16(pos+6);
+        rr->rdlength = u16(pos+8);
+        pos += 10;
+        if(pos + rr->rdlength > size) {
+            return fail("record data cut");
+        }
+        rr->rdata.clear();
+        if(rr->rdlength == 0) {
+            return true;
+        }
+        if(rr->type == type_a) {
+            if(rr->rdlength != 4) {
+                return fail("A record data is not 4 bytes");
+            }
+            char text[INET_ADDRSTRLEN];
+            inet_ntop(AF_INET, data + pos, text, sizeof(text));
+            rr->rdata = text;
+        }
+        else if(rr->type == type_ptr) {
+            size_t end = 0;
+            if(!name_at(pos, &rr->rdata, &end)) {
+                return false;
+            }
+            if(end != pos + rr->rdlength) {
+                return fail("PTR name does not fill record data");
+            }
+        }
+        else {
+            // RFC 4701: identifier type, digest type, SHA-256 digest
+            if(rr->type == type_dhcid && (rr->rdlength != 35 || data[pos+2] != 1)) {
+                return fail("DHCID is not a SHA-256 digest");
+            }
+            static const char digits[] = "0123456789abcdef";
+            for(size_t i=0; i<rr->rdlength; ++i) {
+                rr->rdata.push_back(digits[data[pos+i] >> 4]);
+                rr->rdata.push_back(digits[data[pos+i] & 0x0f]);
+            }
+        }
+        pos += rr->rdlength;
+        return true;
+    }
+
+    bool finished() const { return pos == size; }
+
+private:
+    bool fail(const char *what) {
+        error = what;
+        return false;
+    }
+
+    // pointers must lead back, so they never loop
+    bool name_at(size_t at, std::string *out, size_t *end) {
+        out->clear();
+        *end = 0;
+        size_t limit = at;
+        for(;;) {
+            if(at >= size) {
+                return fail("name cut");
+            }
+            uint8_t len = data[at];
+            if((len & 0xc0) == 0xc0) {
+                if(at + 1 >= size) {
+                    return fail("name cut");
+                }
+                size_t target = ((len & 0x3f) << 8) | data[at+1];
+                if(target >= limit) {
+                    return fail("name pointer does not lead back");
+                }
+                if(!*end) {
+                    *end = at + 2;
+                }
+                at = limit = target;
+                continue;
+            }
+            if(len & 0xc0) {
+                return fail("bad label type");
+            }
+            ++at;
+            if(len == 0) {
+                break;
+            }
+            if(at + len > size) {
+                return fail("name cut");
+            }
+            for(size_t i=0; i<len; ++i) {
+                out->push_back(tolower(data[at+i]));
+            }
+            out->push_back('.');
+            at += len;
+            if(out->size() > 254) {
+                return fail("name longer than 255 bytes");
+            }
+        }
+        if(!*end) {
+            *end = at;
+        }
+        if(out->empty()) {
+            out->push_back('.');
+        }
+        return true;
+    }
+
+    const uint8_t *data;
+    size_t size;
+    size_t pos;
+};
+
+typedef std::pair<std::string, uint16_t> rrset_key; // name, type
+typedef std::map<rrset_key, std::set<std::string>> record_store;
+
+struct totals {
+    unsigned long messages;
+    unsigned long dropped;
+    unsigned long resent;
+    unsigned long refused;
+    unsigned long conflicts; // failed prerequisites
+    unsigned long malformed;
+    unsigned long records;
+    unsigned long redundant; // updates changing nothing
+    size_t max_size;
+};
+
+static bool name_in_use(const record_store &records, const std::string &name)
+{
+    auto it = records.lower_bound(rrset_key(name, 0));
+    return it != records.end() && it->first.first == name;
+}
+
+// RFC 2136 3.2, rcode of the first prerequisite not met
+static uint8_t check_prerequisites(const record_store &records, const std::vector<resource_record> &prerequisites)
+{
+    record_store wanted; // value dependent RRsets
+    for(const resource_record &rr : prerequisites) {
+        auto rrset = records.find(rrset_key(rr.name, rr.type));
+        if(rr.rr_class == class_any) {
+            if(rr.type == type_any ? !name_in_use(records, rr.name) : rrset == records.end()) {
+                return rr.type == type_any ? rcode_nxdomain : rcode_nxrrset;
+            }
+        }
+        else if(rr.rr_class == class_none) {
+            if(rr.type == type_any ? name_in_use(records, rr.name) : rrset != records.end()) {
+                return rr.type == type_any ? rcode_yxdomain : rcode_yxrrset;
+            }
+        }
+        else {
+            wanted[rrset_key(rr.name, rr.type)].insert(rr.rdata);
+        }
+    }
+    for(const auto &rrset : wanted) {
+        auto it = records.find(rrset.first);
+        if(it == records.end() || it->second != rrset.second) {
+            return rcode_nxrrset;
+        }
+    }
+    return rcode_noerror;
+}
+
+// RFC 2136 3.4.2, returns updates changing nothing
+static unsigned apply_updates(record_store *records, const std::vector<resource_record> &updates)
+{
+    unsigned redundant = 0;
+    for(const resource_record &rr : updates) {
+        rrset_key key(rr.name, rr.type);
+        if(rr.rr_class == class_in) {
+            if(!(*records)[key].insert(rr.rdata).second) {
+                ++redundant;
+            }
+        }
+        else if(rr.rr_class == class_any) {
+            if(rr.type == type_any) {
+                while(name_in_use(*records, rr.name)) {
+                    records->erase(records->lower_bound(rrset_key(rr.name, 0)));
+                }
+            }
+            else {
+                records->erase(key);
+            }
+        }
+        else {
+            auto rrset = records->find(key);
+            if(rrset == records->end() || rrset->second.erase(rr.rdata) == 0) {
+                ++redundant;
+            }
+            else if(rrset->second.empty()) {
+                records->erase(rrset);
+            }
+        }
+    }
+    return redundant;
+}
+
+// Checks message and applies it, returns rcode of the reply
+static uint8_t process(const uint8_t *data, size_t size, const std::string &refused_zone,
+                       record_store *records, totals *stats, std::string *info)
+{
+    message_reader reader(data, size);
+    uint16_t flags = reader.u16(2);
+    uint16_t zone_count = reader.u16(4);
+    uint16_t prerequisite_count = reader.u16(6);
+    uint16_t update_count = reader.u16(8);
+    uint16_t additional_count = reader.u16(10);
+    std::string zone;
+    uint16_t zone_type = 0;
+    uint16_t zone_class = 0;
+    *info = std::to_string(prerequisite_count) + " prerequisites, " + std::to_string(update_count) + " updates";
+
+    const char *error = nullptr;
+    if(((flags >> 11) & 0x0f) != opcode_update) {
+        error = "not an UPDATE";
+    }
+    else if(zone_count != 1) {
+        error = "zone count is not 1";
+    }
+    else if(size > max_message_size) {
+        error = "longer than 512 bytes";
+    }
+    else if(!reader.question(&zone, &zone_type, &zone_class)) {
+        error = reader.error;
+    }
+    else if(zone_type != type_soa || zone_class != class_in) {
+        error = "zone is not SOA IN";
+    }
+    if(error) {
+        *info += ", ";
+        *info += error;
+        ++stats->malformed;
+        return rcode_formerr;
+    }
+    *info = zone + " " + *info;
+    if(zone == refused_zone) {
+        ++stats->refused;
+        return rcode_refused;
+    }
+
+    // RFC 2136 3.4.1.3 prescan, records must also be ones the updater sends
+    std::vector<resource_record> prerequisites(prerequisite_count);
+    std::vector<resource_record> updates(update_count);
+    uint8_t rcode = rcode_noerror;
+    for(size_t i=0; !error && i<prerequisites.size()+updates.size(); ++i) {
+        bool prerequisite = i < prerequisites.size();
+        resource_record &rr = prerequisite ? prerequisites[i] : updates[i-prerequisites.size()];
+        if(!reader.record(&rr)) {
+            error = reader.error;
+        }
+        else if(!in_zone(rr.name, zone)) {
+            error = "record outside of zone";
+            rcode = rcode_notzone;
+        }
+        else if(rr.type != type_a && rr.type != type_ptr && rr.type != type_dhcid && rr.type != type_any) {
+            error = "unexpected record type";
+        }
+        else if(rr.rr_class != class_in && rr.rr_class != class_none && rr.rr_class != class_any) {
+            error = "unexpected record class";
+        }
+        else if(rr.rr_class == class_in && (rr.type == type_any || rr.rdlength == 0)) {
+            error = "record of class IN has no data";
+        }
+        else if(rr.rr_class == class_any && rr.rdlength != 0) {
+            error = "record of class ANY has data";
+        }
+        else if(rr.rr_class == class_none && prerequisite && rr.rdlength != 0) {
+            error = "prerequisite of class NONE has data";
+        }
+        else if(rr.rr_class == class_none && !prerequisite && (rr.type == type_any || rr.rdlength == 0)) {
+            error = "record to delete has no data";
+        }
+        else if((prerequisite || rr.rr_class != class_in) && rr.ttl != 0) {
+            error = "TTL is not 0";
+        }
+        else if(!prerequisite && rr.rr_class == class_in && rr.ttl == 0) {
+            error = "added record has TTL 0";
+        }
+    }
+    if(!error && additional_count != 0) {
+        error = "additional records";
+    }
+    if(!error && !reader.finished()) {
+        error = "data after records";
+    }
+    if(error) {
+        *info += ", ";
+        *info += error;
+        ++stats->malformed;
+        return rcode != rcode_noerror ? rcode : static_cast<uint8_t>(rcode_formerr);
+    }
+
+    rcode = check_prerequisites(*records, prerequisites);
+    if(rcode != rcode_noerror) {
+        ++stats->conflicts;
+        return rcode;
+    }
+    unsigned redundant = apply_updates(records, updates);
+    if(redundant) {
+        *info += ", " + std::to_string(redundant) + " change nothing";
+    }
+    stats->records += updates.size();
+    stats->redundant += redundant;
+    return rcode_noerror;
+}
+
+static volatile sig_atomic_t stop = 0;
+
+static void sig_handler_stop(int)
+{
+    stop = 1;
+}
+
+int main(int argc, char *argv[])
+{
+    std::string address = "127.0.0.1";
+    uint16_t port = 5353;
+    unsigned long drop = 0;
+    std::string refused_zone;
+    record_store records;
+
+    for(;;) {
+        int opt = getopt(argc, argv, "a:p:d:r:n:");
+        if(opt == -1) {
+            break;
+        }
+        switch(opt) {
+        case 'a':
+            address = optarg;
+            break;
+        case 'p':
+            port = strtoul(optarg, nullptr, 10);
+            break;
+        case 'd':
+            drop = strtoul(optarg, nullptr, 10);
+            break;
+        case 'r':
+            refused_zone = canonical(optarg);
+            break;
+        case 'n':
+            // name of another host, taken for updater
+            records[rrset_key(canonical(optarg), type_a)].insert("192.0.2.1");
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-a <address>] [-p <port>] [-d <messages to drop>] "
+                            "[-r <refused zone>] [-n <name in use>]...\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if(fd < 0) {
+        perror("socket()");
+        return EXIT_FAILURE;
+    }
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if(inet_pton(AF_INET, address.c_str(), &addr.sin_addr) != 1) {
+        fprintf(stderr, "%s: bad address %s\n", argv[0], address.c_str());
+        return EXIT_FAILURE;
+    }
+    if(bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+        perror("bind()");
+        return EXIT_FAILURE;
+    }
+
+    // no SA_RESTART to interrupt recvfrom()
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = sig_handler_stop;
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+
+    printf("Listening on %s:%u\n", address.c_str(), port);
+    fflush(stdout);
+
+    totals stats;
+    memset(&stats, 0, sizeof(stats));
+    std::map<uint16_t, std::vector<uint8_t>> seen; // last message of every id
+    std::vector<uint8_t> buf(65536);
+    while(!stop) {
+        sockaddr_in from;
+        socklen_t from_len = sizeof(from);
+        ssize_t len = recvfrom(fd, buf.data(), buf.size(), 0, reinterpret_cast<sockaddr*>(&from), &from_len);
+        if(len < 0) {
+            if(errno != EINTR) {
+                perror("recvfrom()");
+                break;
+            }
+            continue;
+        }
+        if(static_cast<size_t>(len) < header_size) {
+            printf("%zd bytes, shorter than header\n", len);
+            ++stats.malformed;
+            continue;
+        }
+        uint16_t id = (buf[0] << 8) | buf[1];
+        if(buf[2] & 0x80) {
+            continue; // not a query
+        }
+        ++stats.messages;
+        if(static_cast<size_t>(len) > stats.max_size) {
+            stats.max_size = len;
+        }
+        std::vector<uint8_t> data(buf.begin(), buf.begin() + len);
+        bool resent = seen.count(id) && seen[id] == data;
+        if(resent) {
+            ++stats.resent;
+        }
+        seen[id] = data;
+        if(stats.dropped < drop) {
+            ++stats.dropped;
+            printf("id %04x %zd bytes%s: dropped\n", id, len, resent ? ", resent" : "");
+            fflush(stdout);
+            continue;
+        }
+
+        std::string info;
+        uint8_t rcode = process(data.data(), data.size(), refused_zone, &records, &stats, &info);
+        printf("id %04x %s, %zd bytes%s: %s\n", id, info.c_str(), len, resent ? ", resent" : "", rcode_name(rcode));
+        fflush(stdout);
+
+        uint8_t reply[header_size] = {
+            buf[0], buf[1],
+            static_cast<uint8_t>((flag_response | (opcode_update << 11)) >> 8), rcode,
+            0, 0, 0, 0, 0, 0, 0, 0
+        };
+        sendto(fd, reply, sizeof(reply), 0, reinterpret_cast<sockaddr*>(&from), from_len);
+    }
+    close(fd);
+
+    printf("\nRecords:\n");
+    for(const auto &rrset : records) {
+        for(const std::string &rdata : rrset.second) {
+            printf("%s %s %s\n", rrset.first.first.c_str(), type_name(rrset.first.second).c_str(), rdata.c_str());
+        }
+    }
+    printf("\n%lu messages, largest %zu bytes, %lu dropped, %lu resent, %lu refused, "
+           "%lu failed prerequisites, %lu malformed\n"
+           "%lu updates, %lu changing nothing\n",
+           stats.messages, stats.max_size, stats.dropped, stats.resent, stats.refused,
+           stats.conflicts, stats.malformed, stats.records, stats.redundant);
+    return stats.malformed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,120 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+#include <ndhcpd_trace.h>
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <ctime>
+#include <string>
+#include <vector>
+
+#include <arpa/inet.h>
+
+// Prints packet trace dump as a timeline
+
+static const char *message_type_name(uint8_t type)
+{
+    static const char *names[] = {
+        "-", "DISCOVER", "OFFER", "REQUEST", "DECLINE", "ACK", "NAK", "RELEASE", "INFORM"
+    };
+    return type < sizeof(names)/sizeof(names[0]) ? names[type] : "?";
+}
+
+static const char *decision_name(uint8_t decision)
+{
+    switch(decision) {
+    case NDHCPD_TRACE_IGNORED: return "ignored";
+    case NDHCPD_TRACE_OFFER: return "offer";
+    case NDHCPD_TRACE_ACK: return "ack";
+    case NDHCPD_TRACE_NAK: return "nak";
+    case NDHCPD_TRACE_PARKED: return "probing";
+    case NDHCPD_TRACE_SHED: return "shed";
+    case NDHCPD_TRACE_ERROR: return "error";
+    default: return "?";
+    }
+}
+
+static std::string format_time(uint64_t ns)
+{
+    if(!ns) {
+        return "-";
+    }
+    time_t sec = ns / 1000000000;
+    struct tm tm;
+    localtime_r(&sec, &tm);
+    char buf[64];
+    size_t len = strftime(buf, sizeof(buf), "%F %T", &tm);
+    snprintf(buf+len, sizeof(buf)-len, ".%09llu", static_cast<unsigned long long>(ns % 1000000000));
+    return buf;
+}
+
+static std::string format_delay(uint64_t from, uint64_t to)
+{
+    if(!from || !to) {
+        return "-";
+    }
+    char buf[32];
+    snprintf(buf, sizeof(buf), "+%.1fus", (static_cast<int64_t>(to - from)) / 1000.0);
+    return buf;
+}
+
+static bool decode(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    if(!file) {
+        perror(path);
+        return false;
+    }
+    ndhcpd_trace_header_t header;
+    if(fread(&header, sizeof(header), 1, file) != 1
+            || header.magic != NDHCPD_TRACE_MAGIC
+            || header.version != NDHCPD_TRACE_VERSION
+            || header.record_size < sizeof(ndhcpd_trace_record_t)) {
+        fprintf(stderr, "%s: not a ndhcpd trace\n", path);
+        fclose(file);
+        return false;
+    }
+    fseek(file, header.header_size, SEEK_SET);
+
+    std::vector<char> buf(header.record_size);
+    for(uint64_t i=0; i<header.count && fread(buf.data(), buf.size(), 1, file) == 1; ++i) {
+        ndhcpd_trace_record_t record;
+        memcpy(&record, buf.data(), sizeof(record));
+        char ip[INET_ADDRSTRLEN] = "-";
+        if(record.ip) {
+            in_addr addr = {htonl(record.ip)};
+            inet_ntop(AF_INET, &addr, ip, sizeof(ip));
+        }
+        printf("%s xid %08x %02x:%02x:%02x:%02x:%02x:%02x %-8s -> %-7s %-15s",
+               format_time(record.received).c_str(), ntohl(record.xid),
+               record.mac[0], record.mac[1], record.mac[2], record.mac[3], record.mac[4], record.mac[5],
+               message_type_name(record.message_type), decision_name(record.decision), ip);
+        if(record.slot != NDHCPD_TRACE_NO_SLOT) {
+            printf(" slot %u", record.slot);
+        }
+        printf(" decided %s sent %s", format_delay(record.received, record.decided).c_str(),
+               format_delay(record.received, record.sent).c_str());
+        if(record.decision == NDHCPD_TRACE_ERROR) {
+            printf(" error %u", record.error);
+        }
+        printf("\n");
+    }
+    fclose(file);
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc < 2) {
+        fprintf(stderr, "Usage: %s <trace>...\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    int ret = EXIT_SUCCESS;
+    for(int i=1; i<argc; ++i) {
+        if(!decode(argv[i])) {
+            ret = EXIT_FAILURE;
+        }
+    }
+    return ret;
+}
@@ -3,9 +3,11 @@
 #include <ndhcpd.hpp>
 #include "config.h"
 #include "ndhcpd_p.hpp"
+#include "ndhcpd_executor_p.hpp"
 
 #include <arpa/inet.h>
 #include <algorithm>
+#include <cerrno>
 
 using std::min;
 using std::max;
@@ -24,7 +26,23 @@ void ndhcpd::setInterfaceName(const std::string &ifaceName)
     d->ifaceName = ifaceName;
 }
 
-void ndhcpd::addRange(const std::string &from, const std::string &to, const std::string &mask)
+ndhcpd::pool_options::pool_options()
+    : leaseTime(std::chrono::hours(1))
+    , offerTime(std::chrono::seconds(60))
+    , t1(0)
+    , t2(0)
+    , leaseJitter(0)
+    , allocation(allocation_policy::sequential)
+    , hashProbes(16)
+    , conflictProbe(conflict_probe::none)
+    , probeTimeout(500)
+    , quarantineTime(std::chrono::hours(1))
+    , rapidCommit(false)
+    , broadcastAddress(0)
+{
+}
+
+int ndhcpd::addRange(const std::string &from, const std::string &to, const std::string &mask)
 {
     in_addr_t n_addr_from = inet_addr(from.c_str());
     in_addr_t n_addr_to = inet_addr(to.c_str());
@@ -33,14 +51,19 @@ void ndhcpd::addRange(const std::string &from, const std::string &to, const std:
     return addRange(ntohl(n_addr_from), ntohl(n_addr_to), ntohl(n_addr_mask));
 }
 
-void ndhcpd::addRange(uint32_t from, uint32_t to, uint32_t mask)
+int ndhcpd::addRange(uint32_t from, uint32_t to, uint32_t mask)
 {
+    int pool = d->add_pool();
     for(uint32_t ip = min(from, to); ip <= max(from,to); ++ip) {
-        addIp(ip, mask);
+        d->add_ip(ip, mask, pool);
+        if(ip == UINT32_MAX) {
+            break;
+        }
     }
+    return pool;
 }
 
-void ndhcpd::addIp(const std::string &ip, const std::string &mask)
+int ndhcpd::addIp(const std::string &ip, const std::string &mask)
 {
     in_addr_t n_addr = inet_addr(ip.c_str());
     in_addr_t n_addr_mask = inet_addr(mask.c_str());
@@ -48,13 +71,96 @@ void ndhcpd::addIp(const std::string &ip, const std::string &mask)
     return addIp(ntohl(n_addr), ntohl(n_addr_mask));
 }
 
-void ndhcpd::addIp(uint32_t ip, uint32_t mask)
+int ndhcpd::addIp(uint32_t ip, uint32_t mask)
 {
-    if(mask <= 32) {
-        // mask len provided instead of mask
-        mask = ~((1<<(32-mask))-1);
-    }
-    d->leases.emplace(ndhcpd_private::ipinfo(ip, mask), nullptr);
+    int pool = d->add_pool();
+    d->add_ip(ip, mask, pool);
+    return pool;
+}
+
+std::vector<int> ndhcpd::addRanges(const std::vector<range> &ranges)
+{
+    return d->add_ranges(ranges);
+}
+
+void ndhcpd::setPoolEnabled(int pool, bool enabled)
+{
+    d->set_pool_enabled(pool, enabled);
+}
+
+void ndhcpd::setDefaultPoolOptions(const pool_options &options)
+{
+    d->set_default_pool_options(options);
+}
+
+ndhcpd::pool_options ndhcpd::defaultPoolOptions() const
+{
+    return d->default_pool_options;
+}
+
+ndhcpd::pool_options ndhcpd::poolOptions(int pool) const
+{
+    return d->get_pool(pool).options;
+}
+
+void ndhcpd::setPoolOptions(int pool, const pool_options &options)
+{
+    d->set_pool_options(pool, options);
+}
+
+void ndhcpd::setPoolInterface(int pool, const std::string &ifaceName)
+{
+    d->set_pool_interface(pool, ifaceName);
+}
+
+void ndhcpd::setInterfaceServerId(const std::string &ifaceName, const std::string &serverId)
+{
+    in_addr_t n_addr = inet_addr(serverId.c_str());
+
+    return setInterfaceServerId(ifaceName, ntohl(n_addr));
+}
+
+void ndhcpd::setInterfaceServerId(const std::string &ifaceName, uint32_t serverId)
+{
+    in_addr id = {htonl(serverId)};
+    d->set_interface_server_id(ifaceName, id);
+}
+
+void ndhcpd::addClassRule(const std::string &className, const std::string &rule)
+{
+    d->classifier.add_rule(className, rule);
+}
+
+void ndhcpd::clearClassRules()
+{
+    d->classifier.clear_rules();
+}
+
+void ndhcpd::setPoolClasses(int pool, const std::vector<std::string> &classes)
+{
+    d->set_pool_classes(pool, classes);
+}
+
+void ndhcpd::setClassOption(const std::string &className, uint8_t code, const std::vector<uint8_t> &value)
+{
+    d->set_class_option(className, code, value);
+}
+
+const int ndhcpd::any_architecture;
+
+ndhcpd::boot_options::boot_options()
+    : nextServer(0)
+{
+}
+
+void ndhcpd::setBootOptions(int architecture, const boot_options &options)
+{
+    d->templates.set_boot(architecture, options.nextServer, options.serverName, options.bootFile);
+}
+
+void ndhcpd::clearBootOptions()
+{
+    d->templates.clear_boot();
 }
 
 std::vector<uint32_t> ndhcpd::ips() const
@@ -67,6 +173,205 @@ std::vector<uint32_t> ndhcpd::ips() const
     return out;
 }
 
+std::vector<ndhcpd::lease_info> ndhcpd::leases() const
+{
+    std::vector<lease_info> out;
+    out.reserve(d->lease_records.size());
+    d->lease_records.for_each(d->clock->now(), [&out](const lease_info &info) {
+        out.push_back(info);
+    });
+    return out;
+}
+
+void ndhcpd::forEachLease(const std::function<void (const lease_info &)> &fn) const
+{
+    d->lease_records.for_each(d->clock->now(), fn);
+}
+
+void ndhcpd::exportLeases(const std::string &shmName)
+{
+    // packet thread writes to the segment, it is remapped between packets
+    d->update([this, &shmName]() {
+        d->export_leases(shmName);
+    });
+}
+
+int ndhcpd::subscribe(const lease_event_handler &handler)
+{
+    return d->events.subscribe(handler);
+}
+
+void ndhcpd::unsubscribe(int id)
+{
+    d->events.unsubscribe(id);
+}
+
+uint64_t ndhcpd::eventsDropped() const
+{
+    return d->events.dropped();
+}
+
+void ndhcpd::setServerId(const std::string &serverId)
+{
+    in_addr_t n_addr = inet_addr(serverId.c_str());
+
+    return setServerId(ntohl(n_addr));
+}
+
+void ndhcpd::setServerId(uint32_t serverId)
+{
+    d->server_id.s_addr = htonl(serverId);
+    d->fixed_server_id = (d->server_id.s_addr != INADDR_NONE);
+}
+
+void ndhcpd::setHashBuckets(const std::vector<uint8_t> &buckets)
+{
+    d->balancer.set_buckets(buckets);
+}
+
+std::vector<uint8_t> ndhcpd::hashBuckets() const
+{
+    return d->balancer.served_buckets();
+}
+
+size_t ndhcpd::processPacket(const void *request, size_t requestLen, const packet_info &requestInfo,
+                             void *reply, size_t replyLen, packet_info *replyInfo)
+{
+    return d->handle_packet(request, requestLen, requestInfo, reply, replyLen, replyInfo);
+}
+
+uint64_t ndhcpd::processTimers(uint64_t timestamp)
+{
+    std::chrono::steady_clock::time_point now;
+    if(timestamp != 0) {
+        now = std::chrono::steady_clock::time_point(std::chrono::nanoseconds(timestamp));
+    }
+    else {
+        now = d->clock->now();
+    }
+    std::chrono::steady_clock::time_point next = d->run_timers(now);
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(next.time_since_epoch()).count();
+}
+
+void ndhcpd::replicateTo(const std::string &peer, uint16_t port, std::chrono::seconds resyncInterval)
+{
+    if(peer.empty()) {
+        d->replication.stop();
+        return;
+    }
+    ndhcpd_private *p = d.get();
+    d->replication.start_active(peer, port, resyncInterval,
+        [p](const std::function<void(const lease_info&)> &fn) {
+            p->lease_records.for_each(p->clock->now(), fn);
+        },
+        [p]() {
+            return p->clock->now();
+        });
+}
+
+void ndhcpd::replicateFrom(const std::string &address, uint16_t port, const std::string &peer)
+{
+    d->replication.start_standby(address, port, peer);
+}
+
+std::vector<ndhcpd::lease_info> ndhcpd::replicatedLeases() const
+{
+    return d->replication.warm_copy();
+}
+
+void ndhcpd::takeOver()
+{
+    d->take_over();
+}
+
+ndhcpd::ddns_options::ddns_options()
+    : port(53)
+    , ttl(300)
+    , delay(100)
+    , timeout(1000)
+    , retries(3)
+{
+}
+
+void ndhcpd::setDdns(const ddns_options &options)
+{
+    if(options.server.empty()) {
+        d->ddns.stop();
+        return;
+    }
+    ndhcpd_private *p = d.get();
+    d->ddns.start(options,
+        [p](const std::function<void(const lease_info&)> &fn) {
+            p->lease_records.for_each(p->clock->now(), fn);
+        });
+}
+
+ndhcpd::ddns_statistics ndhcpd::ddnsStats() const
+{
+    return d->ddns.stats();
+}
+
+void ndhcpd::setClock(clock_type type)
+{
+    if(isStarted()) {
+        throw std::system_error(std::make_error_code(std::errc::device_or_resource_busy), "setClock()");
+    }
+    d->set_clock(type);
+}
+
+void ndhcpd::advanceClock(std::chrono::nanoseconds step)
+{
+    simulated_clock *clock = dynamic_cast<simulated_clock*>(d->clock.get());
+    if(!clock) {
+        throw std::system_error(std::make_error_code(std::errc::operation_not_permitted), "advanceClock()");
+    }
+    clock->advance(step);
+}
+
+uint64_t ndhcpd::clockTime() const
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(d->clock->now().time_since_epoch()).count();
+}
+
+ndhcpd::low_latency_options::low_latency_options()
+    : priority(0)
+    , busyPoll(0)
+    , preferBusyPoll(false)
+    , spin(0)
+{
+}
+
+void ndhcpd::setLowLatency(const low_latency_options &options)
+{
+    d->low_latency = options;
+}
+
+ndhcpd::statistics ndhcpd::stats() const
+{
+    return d->stats.snapshot();
+}
+
+void ndhcpd::dumpTrace(const std::string &path) const
+{
+    d->trace.dump(path);
+}
+
+void ndhcpd::setExecutor(ndhcpd_executor *executor)
+{
+    if(isStarted()) {
+        throw std::system_error(std::make_error_code(std::errc::operation_in_progress), "setExecutor()");
+    }
+    d->executor = executor ? executor->d.get() : nullptr;
+}
+
+void ndhcpd::setTransport(transport_type type)
+{
+    if(isStarted()) {
+        throw std::system_error(std::make_error_code(std::errc::operation_in_progress), "setTransport()");
+    }
+    d->transport = type;
+}
+
 void ndhcpd::start()
 {
     d->start();
@@ -79,7 +384,31 @@ void ndhcpd::stop()
 
 bool ndhcpd::isStarted() const
 {
-    return d->serverThread.joinable();
+    return d->serverThread.joinable() || d->attached;
+}
+
+void ndhcpd::update(const std::function<void()> &changes)
+{
+    d->update(changes);
+}
+
+ndhcpd_executor::ndhcpd_executor(size_t threads)
+    : d(new ndhcpd_executor_private(threads))
+{
+}
+
+ndhcpd_executor::~ndhcpd_executor()
+{
+}
+
+size_t ndhcpd_executor::threads() const
+{
+    return d->threads();
+}
+
+size_t ndhcpd_executor::servers() const
+{
+    return d->servers();
 }
 
 // C interface implementation
@@ -107,40 +436,714 @@ void ndhcpd_setInterfaceName(ndhcpd_t _ndhcpd, const char *ifaceName) __THROW
     p->setInterfaceName(ifaceName);
 }
 
-void ndhcpd_addRange_s(ndhcpd_t _ndhcpd, const char *from, const char *to, const char *mask) __THROW
+int ndhcpd_addRange_s(ndhcpd_t _ndhcpd, const char *from, const char *to, const char *mask) __THROW
 {
-    ndhcpd* p = reinterpret_cast<ndhcpd*>(_ndhcpd);
-    p->addRange(from, to, mask);
+    try {
+        ndhcpd* p = reinterpret_cast<ndhcpd*>(_ndhcpd);
+        return p->addRange(from, to, mask);
+    }
+    catch(const std::system_error &err) {
+        errno = err.code().value();
+        return -1;
+    }
+    catch(...) {
+        return -1;
+    }
 }
 
-void ndhcpd_addRange_i(ndhcpd_t _ndhcpd, uint32_t from, uint32_t to, uint32_t mask) __THROW
+int ndhcpd_addRange_i(ndhcpd_t _ndhcpd, uint32_t from, uint32_t to, uint32_t mask) __THROW
 {
-    ndhcpd* p = reinterpret_cast<ndhcpd*>(_ndhcpd);
-    p->addRange(from, to, mask);
+    try {
+        ndhcpd* p = reinterpret_cast<ndhcpd*>(_ndhcpd);
+        return p->addRange(from, to, mask);
+    }
+    catch(const std::system_error &err) {
+        errno = err.code().value();
+        return -1;
+    }
+    catch(...) {
+        return -1;
+    }
 }
 
-void ndhcpd_addIp_s(ndhcpd_t _ndhcpd, const char *ip, const char *mask) __THROW
+int ndhcpd_addIp_s(ndhcpd_t _ndhcpd, const char *ip, const char *mask) __THROW
 {
-    ndhcpd* p = reinterpret_cast<ndhcpd*>(_ndhcpd);
-    p->addIp(ip, mask);
+    try {
+        ndhcpd* p = reinterpret_cast<ndhcpd*>(_ndhcpd);
+        return p->addIp(ip, mask);
+    }
+    catch(const std::system_error &err) {
+        errno = err.code().value();
+        return -1;
+    }
+    catch(...) {
+        return -1;
+    }
 }
 
-void ndhcpd_addIp_i(ndhcpd_t _ndhcpd, uint32_t ip, uint32_t mask) __THROW
+int ndhcpd_addIp_i(ndhcpd_t _ndhcpd, uint32_t ip, uint32_t mask) __THROW
 {
-    ndhcpd* p = reinterpret_cast<ndhcpd*>(_ndhcpd);
-    p->addIp(ip, mask);
+    try {
+        ndhcpd* p = reinterpret_cast<ndhcpd*>(_ndhcpd);
+        return p->addIp(ip, mask);
+    }
+    catch(const std::system_error &err) {
+        errno = err.code().value();
+        return -1;
+    }
+    catch(...) {
+        return -1;
+    }
 }
 
-int ndhcpd_ips(const ndhcpd_t _ndhcpd, uint32_t *ips, size_t ipsCount) __THROW
+int ndhcpd_addRanges(ndhcpd_t _ndhcpd, const ndhcpd_range_t *ranges, size_t rangesCount, int *pools) __THROW
 {
-    const ndhcpd* p = reinterpret_cast<const ndhcpd*>(_ndhcpd);
-    if(!ips) {
-        return p->ips().size();
+    try {
+        ndhcpd* p = reinterpret_cast<ndhcpd*>(_ndhcpd);
+        std::vector<ndhcpd::range> items;
+        items.reserve(rangesCount);
+        for(size_t i = 0; i < rangesCount; ++i) {
+            items.push_back(ndhcpd::range{ranges[i].from, ranges[i].to, ranges[i].mask});
+        }
+        std::vector<int> ids = p->addRanges(items);
+        if(pools) {
+            std::copy(ids.begin(), ids.end(), pools);
+        }
+        return 0;
+    }
+    catch(const std::system_error &err) {
+        return err.code().value();
+    }
+    catch(...) {
+        return -1;
     }
+}
 
-    auto vIps = p->ips();
-    std::copy_n(vIps.begin(), std::min(ipsCount, vIps.size()), ips);
-    return std::min(ipsCount, vIps.size());
+int ndhcpd_setPoolEnabled(ndhcpd_t _ndhcpd, int pool, int enable) __THROW
+{
+    try {
+        ndhcpd* p = reinterpret_cast<ndhcpd*>(_ndhcpd);
+        p->setPoolEnabled(pool, enable != 0);
+        return 0;
+    }
+    catch(const std::system_error &err) {
+        return err.code().value();
+    }
+    catch(...) {
+        return -1;
+    }
+}
+
+static int update_pool_options(ndhcpd_t _ndhcpd, int pool, const std::function<void(ndhcpd::pool_options&)> &fn)
+{
+    try {
+        ndhcpd* p = reinterpret_cast<ndhcpd*>(_ndhcpd);
+        ndhcpd::pool_options options = (pool == NDHCPD_DEFAULT_POOL) ? p->defaultPoolOptions() : p->poolOptions(pool);
+        fn(options);
+        if(pool == NDHCPD_DEFAULT_POOL) {
+            p->setDefaultPoolOptions(options);
+        }
+        else {
+            p->setPoolOptions(pool, options);
+        }
+        return 0;
+    }
+    catch(const std::system_error &err) {
+        return err.code().value();
+    }
+    catch(...) {
+        return -1;
+    }
+}
+
+int ndhcpd_setPoolTimers(ndhcpd_t _ndhcpd, int pool, uint32_t leaseTime, uint32_t offerTime, uint32_t t1, uint32_t t2) __THROW
+{
+    return update_pool_options(_ndhcpd, pool, [=](ndhcpd::pool_options &options) {
+        options.leaseTime = std::chrono::seconds(leaseTime);
+        options.offerTime = std::chrono::seconds(offerTime);
+        options.t1 = std::chrono::seconds(t1);
+        options.t2 = std::chrono::seconds(t2);
+    });
+}
+
+int ndhcpd_setPoolLeaseJitter(ndhcpd_t _ndhcpd, int pool, unsigned percent) __THROW
+{
+    return update_pool_options(_ndhcpd, pool, [=](ndhcpd::pool_options &options) {
+        options.leaseJitter = percent;
+    });
+}
+
+int ndhcpd_setPoolAllocation(ndhcpd_t _ndhcpd, int pool, int policy, unsigned hashProbes) __THROW
+{
+    return update_pool_options(_ndhcpd, pool, [=](ndhcpd::pool_options &options) {
+        options.allocation = static_cast<ndhcpd::allocation_policy>(policy);
+        options.hashProbes = hashProbes;
+    });
+}
+
+int ndhcpd_setPoolRapidCommit(ndhcpd_t _ndhcpd, int pool, int enable) __THROW
+{
+    return update_pool_options(_ndhcpd, pool, [=](ndhcpd::pool_options &options) {
+        options.rapidCommit = (enable != 0);
+    });
+}
+
+int ndhcpd_setPoolConflictProbe(ndhcpd_t _ndhcpd, int pool, int probe, uint32_t timeoutMs, uint32_t quarantineTime) __THROW
+{
+    return update_pool_options(_ndhcpd, pool, [=](ndhcpd::pool_options &options) {
+        options.conflictProbe = static_cast<ndhcpd::conflict_probe>(probe);
+        options.probeTimeout = std::chrono::milliseconds(timeoutMs);
+        options.quarantineTime = std::chrono::seconds(quarantineTime);
+    });
+}
+
+int ndhcpd_setPoolRouters(ndhcpd_t _ndhcpd, int pool, const uint32_t *routers, size_t routersCount) __THROW
+{
+    return update_pool_options(_ndhcpd, pool, [=](ndhcpd::pool_options &options) {
+        options.routers.assign(routers, routers + routersCount);
+    });
+}
+
+int ndhcpd_setPoolDnsServers(ndhcpd_t _ndhcpd, int pool, const uint32_t *servers, size_t serversCount) __THROW
+{
+    return update_pool_options(_ndhcpd, pool, [=](ndhcpd::pool_options &options) {
+        options.dnsServers.assign(servers, servers + serversCount);
+    });
+}
+
+int ndhcpd_setPoolDomainName(ndhcpd_t _ndhcpd, int pool, const char *domainName) __THROW
+{
+    return update_pool_options(_ndhcpd, pool, [=](ndhcpd::pool_options &options) {
+        options.domainName = domainName ? domainName : "";
+    });
+}
+
+int ndhcpd_setPoolBroadcastAddress(ndhcpd_t _ndhcpd, int pool, uint32_t broadcastAddress) __THROW
+{
+    return update_pool_options(_ndhcpd, pool, [=](ndhcpd::pool_options &options) {
+        options.broadcastAddress = broadcastAddress;
+    });
+}
+
+int ndhcpd_setPoolNtpServers(ndhcpd_t _ndhcpd, int pool, const uint32_t *servers, size_t serversCount) __THROW
+{
+    return update_pool_options(_ndhcpd, pool, [=](ndhcpd::pool_options &options) {
+        options.ntpServers.assign(servers, servers + serversCount);
+    });
+}
+
+int ndhcpd_setPoolClasslessRoutes(ndhcpd_t _ndhcpd, int pool, const ndhcpd_route_t *routes, size_t routesCount) __THROW
+{
+    return update_pool_options(_ndhcpd, pool, [=](ndhcpd::pool_options &options) {
+        options.classlessRoutes.clear();
+        for(size_t i = 0; i < routesCount; ++i) {
+            options.classlessRoutes.push_back(ndhcpd::pool_options::route{routes[i].destination, routes[i].prefix_length, routes[i].router});
+        }
+    });
+}
+
+int ndhcpd_setPoolInterface(ndhcpd_t _ndhcpd, int pool, const char *ifaceName) __THROW
+{
+    try {
+        ndhcpd* p = reinterpret_cast<ndhcpd*>(_ndhcpd);
+        p->setPoolInterface(pool, ifaceName ? ifaceName : "");
+        return 0;
+    }
+    catch(const std::system_error &err) {
+        return err.code().value();
+    }
+    catch(...) {
+        return -1;
+    }
+}
+
+int ndhcpd_setInterfaceServerId_s(ndhcpd_t _ndhcpd, const char *ifaceName, const char *serverId) __THROW
+{
+    try {
+        ndhcpd* p = reinterpret_cast<ndhcpd*>(_ndhcpd);
+        p->setInterfaceServerId(ifaceName, serverId);
+        return 0;
+    }
+    catch(...) {
+        return -1;
+    }
+}
+
+int ndhcpd_setInterfaceServerId_i(ndhcpd_t _ndhcpd, const char *ifaceName, uint32_t serverId) __THROW
+{
+    try {
+        ndhcpd* p = reinterpret_cast<ndhcpd*>(_ndhcpd);
+        p->setInterfaceServerId(ifaceName, serverId);
+        return 0;
+    }
+    catch(...) {
+        return -1;
+    }
+}
+
+int ndhcpd_addClassRule(ndhcpd_t _ndhcpd, const char *className, const char *rule) __THROW
+{
+    try {
+        ndhcpd* p = reinterpret_cast<ndhcpd*>(_ndhcpd);
+        p->addClassRule(className, rule);
+        return 0;
+    }
+    catch(const std::system_error &err) {
+        return err.code().value();
+    }
+    catch(...) {
+        return -1;
+    }
+}
+
+int ndhcpd_clearClassRules(ndhcpd_t _ndhcpd) __THROW
+{
+    try {
+        ndhcpd* p = reinterpret_cast<ndhcpd*>(_ndhcpd);
+        p->clearClassRules();
+        return 0;
+    }
+    catch(...) {
+        return -1;
+    }
+}
+
+int ndhcpd_setPoolClasses(ndhcpd_t _ndhcpd, int pool, const char *const *classes, size_t classesCount) __THROW
+{
+    try {
+        ndhcpd* p = reinterpret_cast<ndhcpd*>(_ndhcpd);
+        std::vector<std::string> names;
+        if(classes) {
+            names.assign(classes, classes+classesCount);
+        }
+        p->setPoolClasses(pool, names);
+        return 0;
+    }
+    catch(const std::system_error &err) {
+        return err.code().value();
+    }
+    catch(...) {
+        return -1;
+    }
+}
+
+int ndhcpd_setClassOption(ndhcpd_t _ndhcpd, const char *className, uint8_t code, const void *value, size_t valueLen) __THROW
+{
+    try {
+        ndhcpd* p = reinterpret_cast<ndhcpd*>(_ndhcpd);
+        const uint8_t *bytes = static_cast<const uint8_t *>(value);
+        std::vector<uint8_t> data;
+        if(bytes) {
+            data.assign(bytes, bytes+valueLen);
+        }
+        p->setClassOption(className, code, data);
+        return 0;
+    }
+    catch(const std::system_error &err) {
+        return err.code().value();
+    }
+    catch(...) {
+        return -1;
+    }
+}
+
+int ndhcpd_setBootOptions(ndhcpd_t _ndhcpd, int architecture, uint32_t nextServer,
+                          const char *serverName, const char *bootFile) __THROW
+{
+    try {
+        ndhcpd* p = reinterpret_cast<ndhcpd*>(_ndhcpd);
+        ndhcpd::boot_options options;
+        options.nextServer = nextServer;
+        options.serverName = serverName ? serverName : "";
+        options.bootFile = bootFile ? bootFile : "";
+        p->setBootOptions(architecture, options);
+        return 0;
+    }
+    catch(const std::system_error &err) {
+        return err.code().value();
+    }
+    catch(...) {
+        return -1;
+    }
+}
+
+void ndhcpd_clearBootOptions(ndhcpd_t _ndhcpd) __THROW
+{
+    ndhcpd* p = reinterpret_cast<ndhcpd*>(_ndhcpd);
+    p->clearBootOptions();
+}
+
+int ndhcpd_ips(const ndhcpd_t _ndhcpd, uint32_t *ips, size_t ipsCount) __THROW
+{
+    const ndhcpd* p = reinterpret_cast<const ndhcpd*>(_ndhcpd);
+    if(!ips) {
+        return p->ips().size();
+    }
+
+    auto vIps = p->ips();
+    std::copy_n(vIps.begin(), std::min(ipsCount, vIps.size()), ips);
+    return std::min(ipsCount, vIps.size());
+}
+
+int ndhcpd_leases(const ndhcpd_t _ndhcpd, ndhcpd_lease_t *leases, size_t leasesCount) __THROW
+{
+    try {
+        const ndhcpd* p = reinterpret_cast<const ndhcpd*>(_ndhcpd);
+        size_t count = 0;
+        p->forEachLease([&](const ndhcpd::lease_info &info) {
+            if(leases && count < leasesCount) {
+                leases[count].ip = info.ip;
+                std::copy(info.mac.begin(), info.mac.end(), leases[count].mac);
+                leases[count].state = static_cast<uint8_t>(info.state);
+                leases[count].remaining = info.remaining.count();
+            }
+            ++count;
+        });
+        return leases ? std::min(count, leasesCount) : count;
+    }
+    catch(const std::system_error &err) {
+        errno = err.code().value();
+        return -1;
+    }
+    catch(...) {
+        return -1;
+    }
+}
+
+int ndhcpd_exportLeases(ndhcpd_t _ndhcpd, const char *shmName) __THROW
+{
+    try {
+        ndhcpd* p = reinterpret_cast<ndhcpd*>(_ndhcpd);
+        p->exportLeases(shmName ? shmName : "");
+        return 0;
+    }
+    catch(const std::system_error &err) {
+        return err.code().value();
+    }
+    catch(...) {
+        return -1;
+    }
+}
+
+int ndhcpd_subscribe(ndhcpd_t _ndhcpd, ndhcpd_lease_event_cb cb, void *arg) __THROW
+{
+    try {
+        ndhcpd* p = reinterpret_cast<ndhcpd*>(_ndhcpd);
+        return p->subscribe([cb, arg](const ndhcpd::lease_event *events, size_t count) {
+            std::vector<ndhcpd_lease_event_t> c_events(count);
+            for(size_t i=0; i<count; ++i) {
+                c_events[i].type = static_cast<uint8_t>(events[i].type);
+                c_events[i].ip = events[i].ip;
+                std::copy(events[i].mac.begin(), events[i].mac.end(), c_events[i].mac);
+                c_events[i].lease_time = events[i].lease_time.count();
+                c_events[i].timestamp = events[i].timestamp;
+            }
+            cb(c_events.data(), c_events.size(), arg);
+        });
+    }
+    catch(const std::system_error &err) {
+        errno = err.code().value();
+        return -1;
+    }
+    catch(...) {
+        return -1;
+    }
+}
+
+void ndhcpd_unsubscribe(ndhcpd_t _ndhcpd, int id) __THROW
+{
+    ndhcpd* p = reinterpret_cast<ndhcpd*>(_ndhcpd);
+    p->unsubscribe(id);
+}
+
+uint64_t ndhcpd_eventsDropped(const ndhcpd_t _ndhcpd) __THROW
+{
+    const ndhcpd* p = reinterpret_cast<const ndhcpd*>(_ndhcpd);
+    return p->eventsDropped();
+}
+
+void ndhcpd_setServerId_s(ndhcpd_t _ndhcpd, const char *serverId) __THROW
+{
+    ndhcpd* p = reinterpret_cast<ndhcpd*>(_ndhcpd);
+    p->setServerId(serverId);
+}
+
+void ndhcpd_setServerId_i(ndhcpd_t _ndhcpd, uint32_t serverId) __THROW
+{
+    ndhcpd* p = reinterpret_cast<ndhcpd*>(_ndhcpd);
+    p->setServerId(serverId);
+}
+
+int ndhcpd_setHashBuckets(ndhcpd_t _ndhcpd, const uint8_t *buckets, size_t bucketsCount) __THROW
+{
+    try {
+        ndhcpd* p = reinterpret_cast<ndhcpd*>(_ndhcpd);
+        std::vector<uint8_t> served;
+        if(buckets) {
+            served.assign(buckets, buckets+bucketsCount);
+        }
+        p->setHashBuckets(served);
+        return 0;
+    }
+    catch(...) {
+        return -1;
+    }
+}
+
+int ndhcpd_processPacket(ndhcpd_t _ndhcpd, const void *request, size_t requestLen, const ndhcpd_packet_info_t *requestInfo,
+                         void *reply, size_t replyLen, ndhcpd_packet_info_t *replyInfo) __THROW
+{
+    try {
+        ndhcpd* p = reinterpret_cast<ndhcpd*>(_ndhcpd);
+        ndhcpd::packet_info in_info = {requestInfo->ifindex, requestInfo->addr, requestInfo->port, requestInfo->timestamp,
+                                       requestInfo->local_addr};
+        ndhcpd::packet_info out_info;
+        int len = p->processPacket(request, requestLen, in_info, reply, replyLen, &out_info);
+        replyInfo->ifindex = out_info.ifindex;
+        replyInfo->addr = out_info.addr;
+        replyInfo->port = out_info.port;
+        replyInfo->timestamp = out_info.timestamp;
+        replyInfo->local_addr = out_info.localAddr;
+        return len;
+    }
+    catch(const std::system_error &err) {
+        errno = err.code().value();
+        return -1;
+    }
+    catch(...) {
+        return -1;
+    }
+}
+
+uint64_t ndhcpd_processTimers(ndhcpd_t _ndhcpd, uint64_t timestamp) __THROW
+{
+    ndhcpd* p = reinterpret_cast<ndhcpd*>(_ndhcpd);
+    return p->processTimers(timestamp);
+}
+
+int ndhcpd_setLowLatency(ndhcpd_t _ndhcpd, const int *cpus, size_t cpusCount, int priority,
+                         uint32_t busyPollUs, int preferBusyPoll, uint32_t spinUs) __THROW
+{
+    try {
+        ndhcpd* p = reinterpret_cast<ndhcpd*>(_ndhcpd);
+        ndhcpd::low_latency_options options;
+        if(cpus) {
+            options.cpus.assign(cpus, cpus+cpusCount);
+        }
+        options.priority = priority;
+        options.busyPoll = std::chrono::microseconds(busyPollUs);
+        options.preferBusyPoll = (preferBusyPoll != 0);
+        options.spin = std::chrono::microseconds(spinUs);
+        p->setLowLatency(options);
+        return 0;
+    }
+    catch(...) {
+        return -1;
+    }
+}
+
+int ndhcpd_stats(const ndhcpd_t _ndhcpd, ndhcpd_stats_t *stats) __THROW
+{
+    const ndhcpd* p = reinterpret_cast<const ndhcpd*>(_ndhcpd);
+    ndhcpd::statistics s = p->stats();
+    stats->received = s.received;
+    stats->replied = s.replied;
+    stats->dropped = s.dropped;
+    stats->latency_count = s.latencyCount;
+    stats->latency_total_ns = s.latencyTotal.count();
+    stats->latency_max_ns = s.latencyMax.count();
+    std::copy(s.latencyHistogram.begin(), s.latencyHistogram.end(), stats->latency_histogram);
+    stats->shed = s.shed;
+    stats->kernel_dropped = s.kernelDropped;
+    stats->backlog = s.backlog;
+    stats->ignored = s.ignored;
+    return 0;
+}
+
+int ndhcpd_setDdns(ndhcpd_t _ndhcpd, const char *server, uint16_t port, const char *forwardZone, const char *reverseZone,
+                   uint32_t ttl) __THROW
+{
+    try {
+        ndhcpd* p = reinterpret_cast<ndhcpd*>(_ndhcpd);
+        ndhcpd::ddns_options options;
+        options.server = server ? server : "";
+        options.port = port ? port : 53;
+        options.forwardZone = forwardZone ? forwardZone : "";
+        options.reverseZone = reverseZone ? reverseZone : "";
+        if(ttl) {
+            options.ttl = std::chrono::seconds(ttl);
+        }
+        p->setDdns(options);
+        return 0;
+    }
+    catch(const std::system_error &err) {
+        return err.code().value();
+    }
+    catch(...) {
+        return -1;
+    }
+}
+
+int ndhcpd_ddnsStats(const ndhcpd_t _ndhcpd, ndhcpd_ddns_stats_t *stats) __THROW
+{
+    const ndhcpd* p = reinterpret_cast<const ndhcpd*>(_ndhcpd);
+    ndhcpd::ddns_statistics s = p->ddnsStats();
+    stats->queued = s.queued;
+    stats->dropped = s.dropped;
+    stats->sent = s.sent;
+    stats->retried = s.retried;
+    stats->failed = s.failed;
+    stats->pending = s.pending;
+    return 0;
+}
+
+int ndhcpd_dumpTrace(const ndhcpd_t _ndhcpd, const char *path) __THROW
+{
+    try {
+        const ndhcpd* p = reinterpret_cast<const ndhcpd*>(_ndhcpd);
+        p->dumpTrace(path);
+        return 0;
+    }
+    catch(const std::system_error &err) {
+        return err.code().value();
+    }
+    catch(...) {
+        return -1;
+    }
+}
+
+int ndhcpd_replicateTo(ndhcpd_t _ndhcpd, const char *peer, uint16_t port, uint32_t resyncSec) __THROW
+{
+    try {
+        ndhcpd* p = reinterpret_cast<ndhcpd*>(_ndhcpd);
+        p->replicateTo(peer ? peer : "", port, std::chrono::seconds(resyncSec ? resyncSec : 60));
+        return 0;
+    }
+    catch(const std::system_error &err) {
+        return err.code().value();
+    }
+    catch(...) {
+        return -1;
+    }
+}
+
+int ndhcpd_replicateFrom(ndhcpd_t _ndhcpd, const char *address, uint16_t port, const char *peer) __THROW
+{
+    try {
+        ndhcpd* p = reinterpret_cast<ndhcpd*>(_ndhcpd);
+        p->replicateFrom(address ? address : "", port, peer ? peer : "");
+        return 0;
+    }
+    catch(const std::system_error &err) {
+        return err.code().value();
+    }
+    catch(...) {
+        return -1;
+    }
+}
+
+int ndhcpd_takeOver(ndhcpd_t _ndhcpd) __THROW
+{
+    try {
+        ndhcpd* p = reinterpret_cast<ndhcpd*>(_ndhcpd);
+        p->takeOver();
+        return 0;
+    }
+    catch(const std::system_error &err) {
+        return err.code().value();
+    }
+    catch(...) {
+        return -1;
+    }
+}
+
+int ndhcpd_setClock(ndhcpd_t _ndhcpd, int type) __THROW
+{
+    try {
+        ndhcpd* p = reinterpret_cast<ndhcpd*>(_ndhcpd);
+        p->setClock(static_cast<ndhcpd::clock_type>(type));
+        return 0;
+    }
+    catch(const std::system_error &err) {
+        return err.code().value();
+    }
+    catch(...) {
+        return -1;
+    }
+}
+
+int ndhcpd_advanceClock(ndhcpd_t _ndhcpd, uint64_t stepNs) __THROW
+{
+    try {
+        ndhcpd* p = reinterpret_cast<ndhcpd*>(_ndhcpd);
+        p->advanceClock(std::chrono::nanoseconds(stepNs));
+        return 0;
+    }
+    catch(const std::system_error &err) {
+        return err.code().value();
+    }
+    catch(...) {
+        return -1;
+    }
+}
+
+uint64_t ndhcpd_clockTime(const ndhcpd_t _ndhcpd) __THROW
+{
+    const ndhcpd* p = reinterpret_cast<const ndhcpd*>(_ndhcpd);
+    return p->clockTime();
+}
+
+ndhcpd_executor_t ndhcpd_executor_create(size_t threads) __THROW
+{
+    try {
+        ndhcpd_executor *instance = new ndhcpd_executor(threads);
+        return reinterpret_cast<ndhcpd_executor_t>(instance);
+    }
+    catch(...) {
+        return nullptr;
+    }
+}
+
+void ndhcpd_executor_delete(ndhcpd_executor_t _executor) __THROW
+{
+    ndhcpd_executor* p = reinterpret_cast<ndhcpd_executor*>(_executor);
+    delete p;
+}
+
+size_t ndhcpd_executor_servers(const ndhcpd_executor_t _executor) __THROW
+{
+    const ndhcpd_executor* p = reinterpret_cast<const ndhcpd_executor*>(_executor);
+    return p->servers();
+}
+
+int ndhcpd_setExecutor(ndhcpd_t _ndhcpd, ndhcpd_executor_t _executor) __THROW
+{
+    try {
+        ndhcpd* p = reinterpret_cast<ndhcpd*>(_ndhcpd);
+        p->setExecutor(reinterpret_cast<ndhcpd_executor*>(_executor));
+        return 0;
+    }
+    catch(const std::system_error &err) {
+        return err.code().value();
+    }
+    catch(...) {
+        return -1;
+    }
+}
+
+int ndhcpd_setTransport(ndhcpd_t _ndhcpd, int type) __THROW
+{
+    try {
+        ndhcpd* p = reinterpret_cast<ndhcpd*>(_ndhcpd);
+        p->setTransport(static_cast<ndhcpd::transport_type>(type));
+        return 0;
+    }
+    catch(const std::system_error &err) {
+        return err.code().value();
+    }
+    catch(...) {
+        return -1;
+    }
 }
 
 int ndhcpd_start(ndhcpd_t _ndhcpd) __THROW
@@ -0,0 +1,316 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+#include "ndhcpd_executor_p.hpp"
+#include "ndhcpd_p.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <system_error>
+
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+ndhcpd_executor_private::ndhcpd_executor_private(size_t threads)
+    : log(log4cpp::Category::getInstance("ndhcpd.executor"))
+{
+    if(threads == 0) {
+        throw std::system_error(std::make_error_code(std::errc::invalid_argument), "ndhcpd_executor()");
+    }
+    try {
+        for(size_t i = 0; i < threads; ++i) {
+            std::unique_ptr<worker> w(new worker);
+            w->stop = false;
+            File _epoll(epoll_create1(EPOLL_CLOEXEC));
+            if(!_epoll) {
+                throw std::system_error(errno, std::system_category(), "epoll_create1()");
+            }
+            File _event(eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC));
+            if(!_event) {
+                throw std::system_error(errno, std::system_category(), "eventfd()");
+            }
+            struct epoll_event ev;
+            ev.events = EPOLLIN;
+            ev.data.ptr = nullptr;
+            if(epoll_ctl(_epoll, EPOLL_CTL_ADD, _event, &ev) < 0) {
+                throw std::system_error(errno, std::system_category(), "epoll_ctl()");
+            }
+            std::swap(w->epoll, _epoll);
+            std::swap(w->event, _event);
+            w->thread = std::thread(std::mem_fn(&ndhcpd_executor_private::run), this, w.get());
+            workers.push_back(std::move(w));
+        }
+    }
+    catch(...) {
+        stop_workers();
+        throw;
+    }
+    log.infoStream() << "Executor started with " << threads << " threads";
+}
+
+ndhcpd_executor_private::~ndhcpd_executor_private()
+{
+    stop_workers();
+}
+
+void ndhcpd_executor_private::stop_workers()
+{
+    for(std::unique_ptr<worker> &w : workers) {
+        {
+            std::lock_guard<std::mutex> lock(w->mutex);
+            w->stop = true;
+        }
+        eventfd_write(w->event, 1);
+    }
+    for(std::unique_ptr<worker> &w : workers) {
+        if(w->thread.joinable()) {
+            w->thread.join();
+        }
+        if(!w->servers.empty()) {
+            log.warnStream() << "Executor stopped with " << w->servers.size() << " servers attached";
+        }
+    }
+    workers.clear();
+}
+
+void ndhcpd_executor_private::attach(ndhcpd_private *server)
+{
+    worker *least = nullptr;
+    size_t least_count = 0;
+    for(std::unique_ptr<worker> &w : workers) {
+        std::lock_guard<std::mutex> lock(w->mutex);
+        if(!least || w->members.size() < least_count) {
+            least = w.get();
+            least_count = w->members.size();
+        }
+    }
+    command cmd = {server, true, false, 0};
+    post(least, &cmd);
+    if(cmd.error != 0) {
+        throw std::system_error(cmd.error, std::system_category(), "ndhcpd_executor::attach()");
+    }
+}
+
+void ndhcpd_executor_private::detach(ndhcpd_private *server)
+{
+    for(std::unique_ptr<worker> &w : workers) {
+        bool member;
+        {
+            std::lock_guard<std::mutex> lock(w->mutex);
+            member = std::find(w->members.begin(), w->members.end(), server) != w->members.end();
+        }
+        if(member) {
+            command cmd = {server, false, false, 0};
+            post(w.get(), &cmd);
+            return;
+        }
+    }
+}
+
+size_t ndhcpd_executor_private::servers() const
+{
+    size_t count = 0;
+    for(const std::unique_ptr<worker> &w : workers) {
+        std::lock_guard<std::mutex> lock(w->mutex);
+        count += w->members.size();
+    }
+    return count;
+}
+
+void ndhcpd_executor_private::post(worker *w, command *cmd)
+{
+    std::unique_lock<std::mutex> lock(w->mutex);
+    if(w->stop) {
+        cancel_commands(w);
+        cmd->error = ECANCELED;
+        if(!cmd->attach) {
+            w->members.erase(std::find(w->members.begin(), w->members.end(), cmd->server));
+        }
+        return;
+    }
+    if(cmd->attach) {
+        w->members.push_back(cmd->server);
+    }
+    w->commands.push_back(cmd);
+    eventfd_write(w->event, 1);
+    w->done.wait(lock, [cmd]{ return cmd->done; });
+}
+
+bool ndhcpd_executor_private::run_commands(worker *w)
+{
+    std::lock_guard<std::mutex> lock(w->mutex);
+    for(command *cmd : w->commands) {
+        if(cmd->attach) {
+            cmd->error = add_server(w, cmd->server);
+            if(cmd->error != 0) {
+                w->members.erase(std::find(w->members.begin(), w->members.end(), cmd->server));
+            }
+        }
+        else {
+            remove_server(w, cmd->server);
+            w->members.erase(std::find(w->members.begin(), w->members.end(), cmd->server));
+        }
+        cmd->done = true;
+    }
+    if(!w->commands.empty()) {
+        w->commands.clear();
+        w->done.notify_all();
+    }
+    return !w->stop;
+}
+
+void ndhcpd_executor_private::cancel_commands(worker *w)
+{
+    for(command *cmd : w->commands) {
+        cmd->error = ECANCELED;
+        w->members.erase(std::find(w->members.begin(), w->members.end(), cmd->server));
+        cmd->done = true;
+    }
+    if(!w->commands.empty()) {
+        w->commands.clear();
+        w->done.notify_all();
+    }
+}
+
+int ndhcpd_executor_private::add_server(worker *w, ndhcpd_private *server)
+{
+    std::unique_ptr<attached> a(new attached);
+    a->server = server;
+    a->dirty = true;
+    a->failed = false;
+    std::vector<int> fds = server->watched_fds();
+    a->watches.reserve(fds.size());
+    for(int fd : fds) {
+        a->watches.push_back(watch{a.get(), fd});
+    }
+    for(size_t i = 0; i < a->watches.size(); ++i) {
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = &a->watches[i];
+        if(epoll_ctl(w->epoll, EPOLL_CTL_ADD, a->watches[i].fd, &ev) < 0) {
+            int err = errno;
+            for(size_t j = 0; j < i; ++j) {
+                epoll_ctl(w->epoll, EPOLL_CTL_DEL, a->watches[j].fd, nullptr);
+            }
+            return err;
+        }
+    }
+    w->servers.push_back(std::move(a));
+    return 0;
+}
+
+void ndhcpd_executor_private::remove_server(worker *w, ndhcpd_private *server)
+{
+    auto iter = std::find_if(w->servers.begin(), w->servers.end(), [server](const std::unique_ptr<attached> &a) {
+        return a->server == server;
+    });
+    if(iter == w->servers.end()) {
+        return;
+    }
+    for(const watch &wt : (*iter)->watches) {
+        epoll_ctl(w->epoll, EPOLL_CTL_DEL, wt.fd, nullptr);
+    }
+    w->servers.erase(iter);
+}
+
+void ndhcpd_executor_private::remove_failed(worker *w)
+{
+    for(size_t i = 0; i < w->servers.size(); ) {
+        if(w->servers[i]->failed) {
+            // like its own thread, failed server stops serving until restarted
+            log.errorStream() << "Server taken out of executor";
+            remove_server(w, w->servers[i]->server);
+        }
+        else {
+            ++i;
+        }
+    }
+}
+
+void ndhcpd_executor_private::run_timers(worker *w)
+{
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    for(std::unique_ptr<attached> &a : w->servers) {
+        if(!a->dirty && (a->due == std::chrono::steady_clock::time_point() || a->due > now)) {
+            continue;
+        }
+        try {
+            // server clock may be simulated, so keep the delay only
+            std::chrono::steady_clock::time_point server_now = a->server->clock->now();
+            std::chrono::steady_clock::time_point next = a->server->run_all_timers(server_now);
+            a->due = std::chrono::steady_clock::time_point();
+            if(next != std::chrono::steady_clock::time_point()) {
+                a->due = now + (next - server_now);
+            }
+        }
+        catch(const std::exception &err) {
+            log.error(err.what());
+            a->failed = true;
+        }
+        a->dirty = false;
+    }
+}
+
+int ndhcpd_executor_private::timeout(const worker *w) const
+{
+    std::chrono::steady_clock::time_point next;
+    for(const std::unique_ptr<attached> &a : w->servers) {
+        if(a->due != std::chrono::steady_clock::time_point()
+                && (next == std::chrono::steady_clock::time_point() || a->due < next)) {
+            next = a->due;
+        }
+    }
+    if(next == std::chrono::steady_clock::time_point()) {
+        return -1;
+    }
+    // round up, so timers are due when epoll_wait() returns
+    auto delay = std::chrono::duration_cast<std::chrono::milliseconds>(next - std::chrono::steady_clock::now()).count() + 1;
+    delay = std::min<decltype(delay)>(delay, std::numeric_limits<int>::max());
+    return static_cast<int>(std::max<decltype(delay)>(delay, 0));
+}
+
+void ndhcpd_executor_private::run(worker *w)
+{
+    struct epoll_event events[max_events];
+    try {
+        while(run_commands(w)) {
+            run_timers(w);
+            remove_failed(w);
+            int ret = epoll_wait(w->epoll, events, max_events, timeout(w));
+            if(ret < 0) {
+                if(errno == EINTR) {
+                    continue;
+                }
+                throw std::system_error(errno, std::system_category(), "epoll_wait()");
+            }
+            for(int i = 0; i < ret; ++i) {
+                if(!events[i].data.ptr) {
+                    // commands posted
+                    eventfd_t val;
+                    eventfd_read(w->event, &val);
+                    continue;
+                }
+                const watch *wt = static_cast<const watch *>(events[i].data.ptr);
+                if(wt->owner->failed) {
+                    continue;
+                }
+                try {
+                    wt->owner->server->handle_socket(wt->fd, events[i].events & (EPOLLERR|EPOLLHUP));
+                }
+                catch(const std::exception &err) {
+                    log.error(err.what());
+                    wt->owner->failed = true;
+                }
+                wt->owner->dirty = true;
+            }
+            remove_failed(w);
+        }
+    }
+    catch(const std::exception &err) {
+        log.error(err.what());
+    }
+    // nobody serves this worker anymore
+    std::lock_guard<std::mutex> lock(w->mutex);
+    w->stop = true;
+    cancel_commands(w);
+}
@@ -0,0 +1,84 @@
+#ifndef NDHCPD_NDHCPD_EXECUTOR_P_HPP
+#define NDHCPD_NDHCPD_EXECUTOR_P_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "file.hpp"
+
+#include <log4cpp/Category.hh>
+
+class ndhcpd_private;
+
+// Event loop shared by many servers.
+// Every attached server is owned by one worker thread, which waits on its
+// sockets with epoll and runs its timers, so a server is never touched by two
+// threads. Servers are spread over workers by count.
+class ndhcpd_executor_private
+{
+public:
+    explicit ndhcpd_executor_private(size_t threads);
+    ~ndhcpd_executor_private();
+
+    ndhcpd_executor_private(const ndhcpd_executor_private&) = delete;
+    ndhcpd_executor_private& operator=(const ndhcpd_executor_private&) = delete;
+
+public:
+    void attach(ndhcpd_private *server);
+    // returns when worker does not use the server anymore
+    void detach(ndhcpd_private *server);
+    size_t threads() const { return workers.size(); }
+    size_t servers() const;
+
+private:
+    struct attached;
+    struct watch {
+        attached *owner;
+        int fd;
+    };
+    struct attached {
+        ndhcpd_private *server;
+        std::vector<watch> watches;
+        std::chrono::steady_clock::time_point due; // next timer, zero if none
+        bool dirty; // timers to be rescheduled
+        bool failed; // threw, taken out of the worker after the events at hand
+    };
+    struct command {
+        ndhcpd_private *server;
+        bool attach;
+        bool done;
+        int error; // errno of failed attach
+    };
+    struct worker {
+        File epoll;
+        File event;
+        std::thread thread;
+        std::mutex mutex; // guards stop, commands and members
+        bool stop;
+        std::condition_variable done;
+        std::vector<command*> commands;
+        std::vector<ndhcpd_private*> members; // attached and being attached servers
+        std::vector<std::unique_ptr<attached>> servers; // worker thread only
+    };
+    static const int max_events = 64;
+
+    void stop_workers();
+    void run(worker *w);
+    void post(worker *w, command *cmd);
+    bool run_commands(worker *w); // false when worker is stopped
+    void cancel_commands(worker *w);
+    int add_server(worker *w, ndhcpd_private *server);
+    void remove_server(worker *w, ndhcpd_private *server);
+    void remove_failed(worker *w);
+    void run_timers(worker *w);
+    int timeout(const worker *w) const;
+
+    std::vector<std::unique_ptr<worker>> workers;
+    log4cpp::Category &log;
+};
+
+#endif//NDHCPD_NDHCPD_EXECUTOR_P_HPP
@@ -7,20 +7,28 @@
 #include <net/if.h>
 #include <sys/eventfd.h>
 #include <poll.h>
+#include <pthread.h>
+#include <sched.h>
 #include <unistd.h>
 #include <string.h>
 
 #include <algorithm>
 #include <sstream>
 #include <iomanip>
+#include <limits>
 
 #include <stddef.h>
 
 #include <sys/socket.h>
 #include <sys/ioctl.h>
 #include <net/if_arp.h>
+#include <linux/sockios.h>
+#include <linux/sock_diag.h>
+#include <linux/filter.h>
 
 #include "dhcp_error.hpp"
+#include "probes.hpp"
+#include "ndhcpd_executor_p.hpp"
 
 #include <syslog.h>
 #include <arpa/inet.h>
@@ -55,8 +63,43 @@ static std::string mac_to_string(const uint8_t *mac)
 
 }
 
+static uint32_t mac_hash(const uint8_t *mac)
+{
+    // FNV-1a, stable across runs and platforms
+    uint32_t hash = 2166136261u;
+    for(int i=0; i<6; ++i) {
+        hash ^= mac[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// RFC 2131 4.1: reply to client without address goes to chaddr and yiaddr,
+// unless client asks for broadcast or it is a NAK
+static bool unicast_to_chaddr(const dhcp_packet &packet)
+{
+    dhcp_message_type msgType;
+    return !(packet.flags & htons(BROADCAST_FLAG))
+            && packet.yiaddr != 0
+            && packet.htype == 1 && packet.hlen == 6
+            && dhcp_get<dhcp_option::_code::message_type>(packet, &msgType) && msgType != dhcp_message_type::nak;
+}
+
 ndhcpd_private::ndhcpd_private()
-    : stop_server(false)
+    : multi_interface(false)
+    , interfaces_dirty(false)
+    , restricted_pools(false)
+    , packet_pools(nullptr)
+    , client_class(client_classifier::none)
+    , offers(max_offers)
+    , admission_buffer(admission_batch)
+    , rxq_overflow(0)
+    , transport(ndhcpd::transport_type::udp)
+    , fixed_server_id(false)
+    , stop_server(false)
+    , executor(nullptr)
+    , attached(false)
+    , clock(new coarse_clock())
     , log(log4cpp::Category::getInstance("ndhcpd.lib"))
 {
     std::vector<std::string> logFileNames;
@@ -87,6 +130,7 @@ ndhcpd_private::ndhcpd_private()
     endservent();
 
     server_id.s_addr = INADDR_NONE;
+    packet_server_id.s_addr = INADDR_NONE;
 
 
 }
@@ -94,8 +138,418 @@ ndhcpd_private::ndhcpd_private()
 ndhcpd_private::~ndhcpd_private()
 {
     stop(true);
+    // snapshot of DNS updater reads lease clock
+    ddns.stop();
+}
+
+
+int ndhcpd_private::add_pool()
+{
+    pools.emplace_back(default_pool_options);
+    pools.back().lease_options = default_lease_options;
+    if(multi_interface) {
+        // unbound pool serves every interface
+        interfaces_dirty = true;
+    }
+    return pools.size()-1;
+}
+
+void ndhcpd_private::set_default_pool_options(const ndhcpd::pool_options &options)
+{
+    check_timers(options);
+    default_lease_options = encode_lease_options(options);
+    default_pool_options = options;
+}
+
+void ndhcpd_private::set_pool_options(int pool, const ndhcpd::pool_options &options)
+{
+    struct pool &p = get_pool(pool);
+    check_timers(options);
+    p.lease_options = encode_lease_options(options);
+    p.options = options;
+}
+
+std::vector<uint8_t> ndhcpd_private::encode_lease_options(const ndhcpd::pool_options &options)
+{
+    // options are kept encoded, so replies get them by one copy
+    std::vector<uint8_t> encoded;
+    bool fits = true;
+    if(!options.routers.empty()) {
+        fits = fits && dhcp_encode<dhcp_option::_code::router>(options.routers, &encoded);
+    }
+    if(!options.dnsServers.empty()) {
+        fits = fits && dhcp_encode<dhcp_option::_code::dns_servers>(options.dnsServers, &encoded);
+    }
+    if(!options.domainName.empty()) {
+        fits = fits && dhcp_encode<dhcp_option::_code::domain_name>(options.domainName, &encoded);
+    }
+    if(options.broadcastAddress != 0) {
+        fits = fits && dhcp_encode<dhcp_option::_code::broadcast_address>(options.broadcastAddress, &encoded);
+    }
+    if(!options.ntpServers.empty()) {
+        fits = fits && dhcp_encode<dhcp_option::_code::ntp_servers>(options.ntpServers, &encoded);
+    }
+    if(!options.classlessRoutes.empty()) {
+        std::vector<dhcp_route> routes;
+        for(const ndhcpd::pool_options::route &route : options.classlessRoutes) {
+            if(route.prefixLength > 32) {
+                fits = false;
+            }
+            routes.push_back(dhcp_route{route.destination, route.prefixLength, route.router});
+        }
+        fits = fits && dhcp_encode<dhcp_option::_code::classless_routes>(routes, &encoded);
+    }
+    if(!fits) {
+        throw std::system_error(std::make_error_code(std::errc::invalid_argument), "encode_lease_options()");
+    }
+    return encoded;
+}
+
+void ndhcpd_private::add_ip(uint32_t ip, uint32_t mask, int pool)
+{
+    if(mask <= 32) {
+        // mask len provided instead of mask
+        mask = mask ? ~((UINT64_C(1)<<(32-mask))-1) : 0;
+    }
+    // addresses usually come in ascending order, so the end is tried first
+    leases_t::iterator hint = leases.end();
+    if(!leases.empty() && !(std::prev(hint)->first.ip < ip)) {
+        hint = leases.lower_bound(ipinfo(ip, 0, 0, 0));
+        if(hint->first.ip == ip) {
+            if(!pools[hint->first.pool].enabled && hint->first.pool != static_cast<uint32_t>(pool)) {
+                // its lease stays, entry of disabled pool is dropped when enabled
+                hint->first.subnet = mask;
+                hint->first.pool = pool;
+                pools[pool].entries.push_back(hint);
+            }
+            return;
+        }
+    }
+    uint32_t slot = lease_records.append(ip);
+    lease_export.add(slot, ip);
+    leases_t::iterator lease = leases.emplace_hint(hint, ipinfo(ip, mask, slot, pool), nullptr);
+    pools[pool].entries.push_back(lease);
+}
+
+std::vector<int> ndhcpd_private::add_ranges(const std::vector<ndhcpd::range> &ranges)
+{
+    // pools are numbered in given order, addresses are inserted in ascending
+    // order, so every one goes to the end of the lease map
+    std::vector<int> ids;
+    ids.reserve(ranges.size());
+    pools.reserve(pools.size() + ranges.size());
+    for(size_t i = 0; i < ranges.size(); ++i) {
+        ids.push_back(add_pool());
+    }
+    std::vector<size_t> order(ranges.size());
+    for(size_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&ranges](size_t a, size_t b) {
+        return std::min(ranges[a].from, ranges[a].to) < std::min(ranges[b].from, ranges[b].to);
+    });
+    for(size_t i : order) {
+        const ndhcpd::range &r = ranges[i];
+        uint32_t to = std::max(r.from, r.to);
+        for(uint32_t ip = std::min(r.from, r.to); ip <= to; ++ip) {
+            add_ip(ip, r.mask, ids[i]);
+            if(ip == UINT32_MAX) {
+                break;
+            }
+        }
+    }
+    return ids;
+}
+
+uint64_t ndhcpd_private::mac_key(const uint8_t *mac)
+{
+    uint64_t key = 0;
+    for(int i=0; i<6; ++i) {
+        key = (key << 8) | mac[i];
+    }
+    return key;
+}
+
+ndhcpd_private::leases_t::iterator ndhcpd_private::find_lease(const uint8_t *mac)
+{
+    auto index = mac_index.find(mac_key(mac));
+    if(index == mac_index.end()) {
+        return leases.end();
+    }
+    return index->second;
+}
+
+ndhcpd_private::leases_t::iterator ndhcpd_private::allocate_lease(const uint8_t *mac)
+{
+    lease_is_overdue is_overdue(packet_time);
+    auto is_free = [this, &is_overdue](const leases_t::value_type &lease) {
+        return is_overdue(lease) && !offers.is_reserved(lease.first.ip, packet_time);
+    };
+    size_t pool_count = packet_pools ? packet_pools->size() : pools.size();
+    for(size_t i = 0; i < pool_count; ++i) {
+        pool &p = pools[packet_pools ? (*packet_pools)[i] : i];
+        if(p.entries.empty() || !p.enabled || !serves_class(p)) {
+            continue;
+        }
+        if(p.options.allocation == ndhcpd::allocation_policy::hash) {
+            // Preferred address is derived from MAC, so clients get the same
+            // address again and addresses spread evenly over the pool
+            size_t start = mac_hash(mac) % p.entries.size();
+            size_t probes = std::min<size_t>(std::max(p.options.hashProbes, 1u), p.entries.size());
+            for(size_t probe=0; probe<probes; ++probe) {
+                leases_t::iterator lease = p.entries[(start+probe) % p.entries.size()];
+                if(is_free(*lease)) {
+                    return lease;
+                }
+            }
+        }
+        auto lease = std::find_if(p.entries.begin(), p.entries.end(), [&is_free](leases_t::iterator lease) {
+            return is_free(*lease);
+        });
+        if(lease != p.entries.end()) {
+            return *lease;
+        }
+    }
+    // pool is exhausted, take back the oldest unconfirmed offer
+    if(packet_pools || restricted_pools) {
+        // offers of other interfaces, classes and of disabled pools are not taken
+        auto usable = [this](uint32_t ip) {
+            leases_t::const_iterator lease = leases.find(ipinfo(ip, 0, 0, 0));
+            return lease != leases.end() && serves_pool(lease->first.pool);
+        };
+        for(uint32_t ip = offers.reclaim(packet_time, usable); ip != 0; ip = offers.reclaim(packet_time, usable)) {
+            leases_t::iterator lease = leases.find(ipinfo(ip, 0, 0, 0));
+            if(is_overdue(*lease)) {
+                return lease;
+            }
+        }
+        return leases.end();
+    }
+    for(uint32_t ip = offers.reclaim(packet_time); ip != 0; ip = offers.reclaim(packet_time)) {
+        leases_t::iterator lease = leases.find(ipinfo(ip, 0, 0, 0));
+        if(lease != leases.end() && is_overdue(*lease)) {
+            return lease;
+        }
+    }
+    return leases.end();
+}
+
+void ndhcpd_private::set_pool_interface(int pool, const std::string &iface)
+{
+    get_pool(pool).iface = iface;
+    // rebuilt once for many pools set in a row
+    interfaces_dirty = true;
+}
+
+void ndhcpd_private::set_interface_server_id(const std::string &iface, in_addr id)
+{
+    if(id.s_addr == INADDR_NONE) {
+        interface_server_ids.erase(iface);
+    }
+    else {
+        interface_server_ids[iface] = id;
+    }
+    build_interfaces();
+}
+
+void ndhcpd_private::build_interfaces()
+{
+    // interfaces may come and go, so names are resolved again on start()
+    std::vector<interface_context> table;
+    std::vector<uint32_t> unbound;
+    multi_interface = false;
+    for(uint32_t i = 0; i < pools.size(); ++i) {
+        if(pools[i].iface.empty()) {
+            unbound.push_back(i);
+            continue;
+        }
+        multi_interface = true;
+        unsigned ifindex = if_nametoindex(pools[i].iface.c_str());
+        if(ifindex == 0) {
+            log.warnStream() << "Interface " << pools[i].iface << " of pool " << i << " not found";
+            continue;
+        }
+        if(table.size() <= ifindex) {
+            table.resize(ifindex+1, interface_context{std::vector<uint32_t>(), in_addr{INADDR_NONE}});
+        }
+        table[ifindex].pools.push_back(i);
+    }
+    for(const auto &id : interface_server_ids) {
+        multi_interface = true;
+        unsigned ifindex = if_nametoindex(id.first.c_str());
+        if(ifindex == 0) {
+            log.warnStream() << "Interface " << id.first << " not found";
+            continue;
+        }
+        if(table.size() <= ifindex) {
+            table.resize(ifindex+1, interface_context{std::vector<uint32_t>(), in_addr{INADDR_NONE}});
+        }
+        table[ifindex].server_id = id.second;
+    }
+    for(interface_context &context : table) {
+        context.pools.insert(context.pools.end(), unbound.begin(), unbound.end());
+        std::sort(context.pools.begin(), context.pools.end());
+    }
+    std::swap(interfaces, table);
+    std::swap(any_pools, unbound);
+    interfaces_dirty = false;
+}
+
+void ndhcpd_private::select_interface(const ndhcpd::packet_info &info)
+{
+    packet_pools = nullptr;
+    packet_server_id = server_id;
+    if(interfaces_dirty) {
+        build_interfaces();
+    }
+    if(!multi_interface && (fixed_server_id || info.localAddr == 0)) {
+        return;
+    }
+    const interface_context *context = nullptr;
+    if(info.ifindex > 0 && static_cast<size_t>(info.ifindex) < interfaces.size()) {
+        context = &interfaces[info.ifindex];
+    }
+    if(multi_interface) {
+        packet_pools = context ? &context->pools : &any_pools;
+    }
+    if(context && context->server_id.s_addr != INADDR_NONE) {
+        packet_server_id = context->server_id;
+    }
+    else if(!fixed_server_id && info.localAddr != 0 && ifaceName.empty()) {
+        // unbound socket answers from address the request arrived to
+        packet_server_id.s_addr = htonl(info.localAddr);
+    }
+}
+
+bool ndhcpd_private::serves_pool(uint32_t pool) const
+{
+    return (!packet_pools || std::binary_search(packet_pools->begin(), packet_pools->end(), pool))
+            && serves_class(pools[pool]);
+}
+
+bool ndhcpd_private::serves_class(const pool &p) const
+{
+    return p.enabled
+            && (p.classes.empty() || std::binary_search(p.classes.begin(), p.classes.end(), client_class));
+}
+
+void ndhcpd_private::set_pool_classes(int pool, const std::vector<std::string> &classes)
+{
+    std::vector<int> ids;
+    for(const std::string &name : classes) {
+        ids.push_back(classifier.intern(name));
+    }
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    bool restricted = !ids.empty();
+    get_pool(pool).classes = ids;
+    if(restricted != restricted_pools) {
+        update_restricted_pools();
+    }
+}
+
+void ndhcpd_private::set_pool_enabled(int pool, bool enabled)
+{
+    struct pool &p = get_pool(pool);
+    if(enabled && !p.enabled) {
+        // addresses taken over by other pools while disabled
+        p.entries.erase(std::remove_if(p.entries.begin(), p.entries.end(), [pool](leases_t::iterator lease) {
+            return lease->first.pool != static_cast<uint32_t>(pool);
+        }), p.entries.end());
+    }
+    p.enabled = enabled;
+    if(enabled == restricted_pools) {
+        update_restricted_pools();
+    }
+}
+
+void ndhcpd_private::update_restricted_pools()
+{
+    restricted_pools = std::any_of(pools.begin(), pools.end(), [](const struct pool &p) {
+        return !p.classes.empty() || !p.enabled;
+    });
+}
+
+void ndhcpd_private::set_class_option(const std::string &class_name, uint8_t code, const std::vector<uint8_t> &value)
+{
+    if(code == static_cast<uint8_t>(dhcp_option::_code::padding)
+            || code == static_cast<uint8_t>(dhcp_option::_code::end)
+            || value.size() > 255) {
+        throw std::system_error(std::make_error_code(std::errc::invalid_argument), "set_class_option()");
+    }
+    size_t id = classifier.intern(class_name);
+    if(class_options.size() <= id) {
+        class_options.resize(id+1);
+    }
+    // options are kept encoded, so replies get them by one copy
+    std::vector<uint8_t> &encoded = class_options[id];
+    for(size_t pos = 0; pos < encoded.size(); pos += 2 + encoded[pos+1]) {
+        if(encoded[pos] == code) {
+            encoded.erase(encoded.begin() + pos, encoded.begin() + pos + 2 + encoded[pos+1]);
+            break;
+        }
+    }
+    encoded.push_back(code);
+    encoded.push_back(static_cast<uint8_t>(value.size()));
+    encoded.insert(encoded.end(), value.begin(), value.end());
+}
+
+bool ndhcpd_private::add_class_options(dhcp_packet *out_packet) const
+{
+    if(client_class == client_classifier::none || static_cast<size_t>(client_class) >= class_options.size()) {
+        return false;
+    }
+    const std::vector<uint8_t> &encoded = class_options[client_class];
+    if(encoded.empty()) {
+        return false;
+    }
+    if(!dhcp_append_options(out_packet, encoded.data(), encoded.size())) {
+        log.warnStream() << "Options of class " << classifier.name(client_class) << " do not fit into reply";
+        return false;
+    }
+    return true;
+}
+
+ndhcpd_private::pool &ndhcpd_private::get_pool(int pool)
+{
+    if(pool < 0 || (size_t)pool >= pools.size()) {
+        throw std::system_error(std::make_error_code(std::errc::invalid_argument), "get_pool()");
+    }
+    return pools[pool];
+}
+
+void ndhcpd_private::check_timers(const ndhcpd::pool_options &options)
+{
+    // clients rebinding before renewing would skip this server
+    std::chrono::seconds t1 = options.t1.count() != 0 ? options.t1 : options.leaseTime / 2;
+    std::chrono::seconds t2 = options.t2.count() != 0 ? options.t2 : options.leaseTime * 7 / 8;
+    bool ordered = (options.t1.count() == 0 && options.t2.count() == 0) || (t1 < t2 && t2 < options.leaseTime);
+    if(options.leaseTime.count() <= 0 || options.offerTime.count() <= 0 || !ordered) {
+        throw std::system_error(std::make_error_code(std::errc::invalid_argument), "check_timers()");
+    }
+}
+
+const ndhcpd::pool_options *ndhcpd_private::lease_pool_options(uint32_t ip) const
+{
+    leases_t::const_iterator lease = leases.find(ipinfo(ip, 0, 0, 0));
+    if(lease == leases.end()) {
+        return nullptr;
+    }
+    return &pools[lease->first.pool].options;
 }
 
+void ndhcpd_private::quarantine_lease(uint32_t ip)
+{
+    leases_t::iterator lease = leases.find(ipinfo(ip, 0, 0, 0));
+    if(lease == leases.end()) {
+        return;
+    }
+    static const uint8_t no_mac[6] = {0};
+    offers.release(ip);
+    set_lease(*lease, new lease_data(no_mac, ndhcpd::lease_state::quarantined, pools[lease->first.pool].options.quarantineTime, packet_time));
+    in_addr addr = {htonl(ip)};
+    log.warnStream() << "Address " << inet_ntoa(addr) << " is in use, quarantined";
+}
 
 bool ndhcpd_private::lease_is_mac_equal::operator ()(const leases_t::value_type &lease)
 {
@@ -113,6 +567,171 @@ bool ndhcpd_private::lease_is_overdue::operator ()(const leases_t::value_type &l
     return (lease.second->lease_start + lease.second->lease_time < now);
 }
 
+void ndhcpd_private::set_lease(leases_t::value_type &lease, lease_data *data)
+{
+    leases_t::iterator leaseIter = leases.find(lease.first);
+    if(lease.second && lease.second->state == ndhcpd::lease_state::bound
+            && !(data && data->state == ndhcpd::lease_state::bound)) {
+        update_dns(lease.first.ip, nullptr);
+    }
+    if(lease.second) {
+        auto index = mac_index.find(mac_key(lease.second->mac.data()));
+        if(index != mac_index.end() && index->second == leaseIter) {
+            mac_index.erase(index);
+        }
+    }
+    if(data && data->state != ndhcpd::lease_state::quarantined) {
+        mac_index[mac_key(data->mac.data())] = leaseIter;
+    }
+    lease.second.reset(data);
+    if(data && data->state == ndhcpd::lease_state::bound) {
+        lease_expiries.push({data->lease_start + data->lease_time, leaseIter});
+    }
+    publish_lease(lease);
+    replicate_lease(lease);
+}
+
+void ndhcpd_private::publish_lease(const leases_t::value_type &lease)
+{
+    const lease_data *data = lease.second.get();
+    if(data) {
+        lease_records.publish(lease.first.slot, data->mac.data(), data->state, data->lease_start + data->lease_time);
+        lease_export.publish(lease.first.slot, data->mac.data(), data->state, data->lease_start + data->lease_time);
+    }
+    else {
+        lease_records.publish(lease.first.slot, nullptr, ndhcpd::lease_state::free, std::chrono::steady_clock::time_point());
+        lease_export.publish(lease.first.slot, nullptr, ndhcpd::lease_state::free, std::chrono::steady_clock::time_point());
+    }
+}
+
+void ndhcpd_private::replicate_lease(const leases_t::value_type &lease)
+{
+    if(!replication.active()) {
+        return;
+    }
+    lease_replication::change change;
+    change.ip = lease.first.ip;
+    const lease_data *data = lease.second.get();
+    if(data) {
+        change.mac = data->mac;
+        change.state = data->state;
+        change.expires = data->lease_start + data->lease_time;
+    }
+    else {
+        change.mac.fill(0);
+        change.state = ndhcpd::lease_state::free;
+    }
+    replication.push(change);
+}
+
+void ndhcpd_private::update_dns(uint32_t ip, const dhcp_packet *packet)
+{
+    if(!ddns.active()) {
+        return;
+    }
+    ddns_updater::change change;
+    change.ip = ip;
+    change.bound = (packet != nullptr);
+    change.mac.fill(0);
+    change.name_len = 0;
+    // raw name is copied, it is checked on the updater thread
+    const dhcp_option *host_name = packet ? dhcp_find_option(*packet, dhcp_option::_code::host_name) : nullptr;
+    if(packet) {
+        memcpy(change.mac.data(), packet->chaddr, change.mac.size());
+    }
+    if(host_name) {
+        change.name_len = std::min<size_t>(host_name->len, sizeof(change.name));
+        memcpy(change.name, host_name->value, change.name_len);
+    }
+    ddns.push(change);
+}
+
+void ndhcpd_private::take_over()
+{
+    if(!replication.standby()) {
+        return;
+    }
+    replication.stop();
+    std::chrono::steady_clock::time_point now = clock->now();
+    size_t count = 0;
+    for(const ndhcpd::lease_info &info : replication.warm_copy()) {
+        leases_t::iterator lease = leases.find(ipinfo(info.ip, 0, 0, 0));
+        if(lease == leases.end()) {
+            continue;
+        }
+        set_lease(*lease, new lease_data(info.mac.data(), info.state, info.remaining, now));
+        ++count;
+    }
+    log.noticeStream() << "Took over " << count << " replicated leases";
+}
+
+void ndhcpd_private::export_leases(const std::string &shmName)
+{
+    if(shmName.empty()) {
+        lease_export.close();
+        return;
+    }
+    lease_export.open(shmName);
+    for(auto &lease : leases) {
+        lease_export.add(lease.first.slot, lease.first.ip);
+        publish_lease(lease);
+    }
+    log.infoStream() << "Exporting leases to shared memory " << shmName;
+}
+
+void ndhcpd_private::emit_event(ndhcpd::lease_event_type type, const leases_t::value_type &lease, std::chrono::steady_clock::time_point time)
+{
+    if(lease.second) {
+        emit_event(type, lease.first.ip, lease.second->mac.data(), lease.second->lease_time, time);
+    }
+}
+
+void ndhcpd_private::emit_event(ndhcpd::lease_event_type type, uint32_t ip, const uint8_t *mac, std::chrono::seconds lease_time,
+                                std::chrono::steady_clock::time_point time)
+{
+    if(!events.active()) {
+        return;
+    }
+    ndhcpd::lease_event event;
+    event.type = type;
+    event.ip = ip;
+    std::copy(mac, mac+6, event.mac.begin());
+    event.lease_time = lease_time;
+    event.timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+    events.push(event);
+}
+
+std::chrono::steady_clock::time_point ndhcpd_private::run_timers(std::chrono::steady_clock::time_point now)
+{
+    expire_leases(now);
+    offers.expire(now);
+    if(lease_expiries.empty()) {
+        return std::chrono::steady_clock::time_point();
+    }
+    return lease_expiries.top().at;
+}
+
+void ndhcpd_private::expire_leases(std::chrono::steady_clock::time_point now)
+{
+    while(!lease_expiries.empty() && lease_expiries.top().at <= now) {
+        lease_expiry expiry = lease_expiries.top();
+        lease_expiries.pop();
+        lease_data *data = expiry.lease->second.get();
+        if(!data
+                || data->state != ndhcpd::lease_state::bound
+                || data->lease_start + data->lease_time != expiry.at) {
+            // lease has been renewed or reused since
+            continue;
+        }
+        data->state = ndhcpd::lease_state::expired;
+        publish_lease(*expiry.lease);
+        replicate_lease(*expiry.lease);
+        emit_event(ndhcpd::lease_event_type::expired, *expiry.lease, now);
+        update_dns(expiry.lease->first.ip, nullptr);
+        in_addr addr = {htonl(expiry.lease->first.ip)};
+        log.infoStream() << "Lease for " << inet_ntoa(addr) << " to " << mac_to_string(data->mac.data()) << " expired";
+    }
+}
 
 void ndhcpd_private::get_server_id(const Socket &_server)
 {
@@ -131,7 +750,7 @@ void ndhcpd_private::get_server_id(const Socket &_server)
 void ndhcpd_private::start()
 {
     try {
-        if(serverThread.joinable()) {
+        if(serverThread.joinable() || attached) {
             log.notice("Server thread already started");
             return;
         }
@@ -140,6 +759,12 @@ void ndhcpd_private::start()
 
         _server.setsockopt(SOL_SOCKET, SO_REUSEADDR, true);
         _server.setsockopt(SOL_SOCKET, SO_BROADCAST, true);
+        _server.setsockopt(SOL_SOCKET, SO_TIMESTAMPNS, true);
+        _server.setsockopt(SOL_SOCKET, SO_RXQ_OVFL, true);
+        // ingress interface and local address of every request
+        _server.setsockopt(IPPROTO_IP, IP_PKTINFO, true);
+        rxq_overflow = 0;
+        apply_busy_poll(_server);
 
         if(!ifaceName.empty()) {
             log.infoStream() << "Starting bound to interface " << ifaceName;
@@ -147,7 +772,9 @@ void ndhcpd_private::start()
             memset(ifr.ifr_name, 0, std::size(ifr.ifr_name));
             ifaceName.copy(ifr.ifr_name, std::size(ifr.ifr_name));
             _server.setsockopt(SOL_SOCKET, SO_BINDTODEVICE, ifr);
-            get_server_id(_server);
+            if(!fixed_server_id) {
+                get_server_id(_server);
+            }
         }
         else {
             log.infoStream() << "Starting unbound";
@@ -155,17 +782,52 @@ void ndhcpd_private::start()
 
         sockaddr_in addr = srcAddr;
         _server.bind(addr);
+        if(transport == ndhcpd::transport_type::packet_ring) {
+            if(ifaceName.empty()) {
+                throw std::system_error(std::make_error_code(std::errc::invalid_argument), "start(): packet ring needs interface");
+            }
+            // socket stays bound, so kernel does not answer requests with
+            // port unreachable, but all of them are read from the ring
+            struct sock_filter drop = BPF_STMT(BPF_RET|BPF_K, 0);
+            struct sock_fprog filter = { 1, &drop };
+            _server.setsockopt(SOL_SOCKET, SO_ATTACH_FILTER, filter);
+            ring.open(ifaceName, ntohs(srcAddr.sin_port));
+            log.infoStream() << "Packet ring opened on " << ifaceName;
+        }
+        else {
+            try {
+                neighbours.open();
+            }
+            catch(const std::system_error &err) {
+                log.warnStream() << "Replies to clients without address are broadcast: " << err.what();
+            }
+        }
+        build_interfaces();
 
-        File _event(eventfd(0,0));
-
+        take_over();
         std::swap(server, _server);
-        std::swap(event, _event);
+        open_prober();
+        File _update_event(eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC));
+        if(!_update_event.isValid()) {
+            throw std::system_error(errno, std::system_category(), "eventfd()");
+        }
+        std::swap(update_event, _update_event);
 
+        if(executor) {
+            // shared event loop waits on our sockets, no thread of our own
+            executor->attach(this);
+            attached = true;
+            log.notice("Service started on executor");
+            return;
+        }
+        File _event(eventfd(0,0));
+        std::swap(event, _event);
         serverThread = std::thread(std::mem_fn(&ndhcpd_private::process_dhcp), this);
         log.notice("Service started");
     }
     catch(const std::system_error &err) {
         log.error(err.what());
+        update_event.close();
         throw;
     }
 }
@@ -176,8 +838,13 @@ void ndhcpd_private::stop(bool silent)
         log.info("Stoping service");
     }
     stop_server = true;
-    eventfd_write(event, 1);
-    if(serverThread.joinable()) {
+    if(attached) {
+        executor->detach(this);
+        attached = false;
+        log.notice("Service stoped");
+    }
+    else if(serverThread.joinable()) {
+        eventfd_write(event, 1);
         serverThread.join();
         log.notice("Service stoped");
     }
@@ -186,159 +853,947 @@ void ndhcpd_private::stop(bool silent)
             log.info("Service already stoped");
         }
     }
+    if(update_event.isValid()) {
+        // nobody else runs changes posted before the server stopped
+        run_updates();
+        update_event.close();
+    }
+    prober.close();
+    pending_offers.clear();
+    pending_deadlines = decltype(pending_deadlines)();
     leases.clear();
+    pools.clear();
+    mac_index.clear();
+    lease_records.clear();
+    lease_export.clear();
+    lease_expiries = decltype(lease_expiries)();
+    offers.clear();
+    ring.close();
+    neighbours.close();
+    interfaces.clear();
+    any_pools.clear();
+    multi_interface = !interface_server_ids.empty();
+    interfaces_dirty = false;
     server.close();
     event.close();
 }
 
-void ndhcpd_private::process_dhcp()
+void ndhcpd_private::set_clock(ndhcpd::clock_type type)
 {
-    try {
-        std::vector<struct pollfd> pollFds = {
-            { event, POLLIN|POLLERR },
-            { server, POLLIN|POLLERR }
-        };
+    switch(type) {
+    case ndhcpd::clock_type::real:
+        clock.reset(new real_clock());
+        break;
+    case ndhcpd::clock_type::coarse:
+        clock.reset(new coarse_clock());
+        break;
+    case ndhcpd::clock_type::simulated:
+        clock.reset(new simulated_clock());
+        break;
+    default:
+        throw std::system_error(std::make_error_code(std::errc::invalid_argument), "set_clock()");
+    }
+}
 
-        while(!stop_server) {
-            auto ret = poll(pollFds.data(), pollFds.size(), -1);
-            if(ret < 0) {
-                throw std::system_error(errno, std::system_category(), "poll()");
-            }
-            if(pollFds[0].revents != 0) {
-                // event handle has been raised
-                eventfd_t val;
-                eventfd_read(event, &val);
-                // check stop_server variable
-                continue;
-            }
-            std::for_each(pollFds.cbegin()+1, pollFds.cend(), [this](const pollfd& fd){
-               if(fd.revents & (POLLERR|POLLHUP|POLLNVAL)) {
-                   log.errorStream() << "Socket " << fd.fd << " in error state";
-               }
-               else if(fd.revents & POLLIN) {
-                   try {
-                       if(server_id.s_addr == INADDR_NONE) {
-                           get_server_id(server);
-                           char server_id_str[256];
-                           log.infoStream() << "Got server_id: " << inet_ntop(AF_INET, &server_id, server_id_str, sizeof(server_id_str));
-                       }
-                       struct dhcp_packet in_packet;
-                       in_packet = recieve_packet(fd.fd);
-                       struct dhcp_packet out_packet = process_packet(in_packet);
-                       send_packet(fd.fd, out_packet);
-                   }
-                   catch(const std::system_error &err) {
-                       log.error(err.what());
-                   }
-               }
-            });
+void ndhcpd_private::apply_busy_poll(Socket &socket)
+{
+    if(low_latency.busyPoll.count() > 0) {
+        try {
+            socket.setsockopt(SOL_SOCKET, SO_BUSY_POLL, static_cast<int>(low_latency.busyPoll.count()));
+        }
+        catch(const std::system_error &err) {
+            log.warnStream() << "Busy poll not enabled: " << err.what();
         }
     }
-    catch(const std::exception &err) {
-        log.error(err.what());
+    if(low_latency.preferBusyPoll) {
+#ifdef SO_PREFER_BUSY_POLL
+        try {
+            socket.setsockopt(SOL_SOCKET, SO_PREFER_BUSY_POLL, true);
+        }
+        catch(const std::system_error &err) {
+            log.warnStream() << "Preferred busy poll not enabled: " << err.what();
+        }
+#else
+        log.warn("Preferred busy poll is not supported by this build");
+#endif
     }
 }
 
-dhcp_packet ndhcpd_private::recieve_packet(int fd)
+void ndhcpd_private::apply_thread_tuning()
 {
-    dhcp_packet packet;
-    ssize_t len = read(fd, &packet, sizeof(packet));
-    if(len < 0) {
-        throw std::system_error(errno, std::system_category(), "read()");
+    if(!low_latency.cpus.empty()) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        for(int cpu : low_latency.cpus) {
+            if(cpu >= 0 && cpu < CPU_SETSIZE) {
+                CPU_SET(cpu, &cpus);
+            }
+        }
+        int err = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+        if(err != 0) {
+            log.warnStream() << "Server thread not pinned: " << std::system_category().message(err);
+        }
+    }
+    if(low_latency.priority > 0) {
+        struct sched_param param;
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = low_latency.priority;
+        int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if(err != 0) {
+            log.warnStream() << "Server thread priority not set: " << std::system_category().message(err);
+        }
+    }
+}
+
+int ndhcpd_private::poll_events(pollfd *fds, size_t count, int timeout)
+{
+    if(low_latency.spin.count() > 0 && timeout != 0) {
+        // spin on non-blocking poll to skip the wakeup latency, then block
+        std::chrono::steady_clock::time_point spin_end = std::chrono::steady_clock::now() + low_latency.spin;
+        do {
+            int ret = poll(fds, count, 0);
+            if(ret != 0) {
+                return ret;
+            }
+        } while(!stop_server && std::chrono::steady_clock::now() < spin_end);
+        if(timeout > 0) {
+            timeout = std::max<int>(timeout - std::chrono::duration_cast<std::chrono::milliseconds>(low_latency.spin).count(), 0);
+        }
+    }
+    return poll(fds, count, timeout);
+}
+
+std::vector<int> ndhcpd_private::watched_fds() const
+{
+    std::vector<int> fds = { ring.is_open() ? ring.fd() : static_cast<int>(server) };
+    if(prober.can_arp()) {
+        fds.push_back(prober.arp_socket);
+    }
+    if(prober.can_icmp()) {
+        fds.push_back(prober.icmp_socket);
+    }
+    if(update_event.isValid()) {
+        fds.push_back(update_event);
+    }
+    return fds;
+}
+
+void ndhcpd_private::handle_socket(int fd, bool error)
+{
+    if(error) {
+        log.errorStream() << "Socket " << fd << " in error state";
+        return;
+    }
+    if(fd == update_event) {
+        run_updates();
+        return;
+    }
+    try {
+        if(fd == server || fd == ring.fd()) {
+            serve_packet(fd);
+        }
+        else {
+            handle_probe_reply(fd);
+        }
+        if(ring.is_open()) {
+            ring.flush();
+        }
+    }
+    catch(const std::system_error &err) {
+        log.error(err.what());
+    }
+}
+
+std::chrono::steady_clock::time_point ndhcpd_private::run_all_timers(std::chrono::steady_clock::time_point now)
+{
+    std::chrono::steady_clock::time_point next_timer = run_timers(now);
+    std::chrono::steady_clock::time_point next_probe_timer = run_probe_timers(now);
+    if(next_timer == std::chrono::steady_clock::time_point()
+            || (next_probe_timer != std::chrono::steady_clock::time_point() && next_probe_timer < next_timer)) {
+        next_timer = next_probe_timer;
+    }
+    // last, so entries added by replies above are scheduled too
+    std::chrono::steady_clock::time_point next_neighbour_timer = neighbours.expire(now);
+    if(next_timer == std::chrono::steady_clock::time_point()
+            || (next_neighbour_timer != std::chrono::steady_clock::time_point() && next_neighbour_timer < next_timer)) {
+        next_timer = next_neighbour_timer;
+    }
+    return next_timer;
+}
+
+void ndhcpd_private::update(const std::function<void()> &changes)
+{
+    if(!update_event.isValid()) {
+        // nobody serves packets, changes are applied right away
+        changes();
+        return;
+    }
+    pending_update pending = {&changes, false, nullptr};
+    std::unique_lock<std::mutex> lock(update_mutex);
+    updates.push_back(&pending);
+    eventfd_write(update_event, 1);
+    update_done.wait(lock, [&pending]{ return pending.done; });
+    if(pending.error) {
+        std::rethrow_exception(pending.error);
+    }
+}
+
+void ndhcpd_private::run_updates()
+{
+    eventfd_t val;
+    eventfd_read(update_event, &val);
+    std::lock_guard<std::mutex> lock(update_mutex);
+    for(pending_update *pending : updates) {
+        try {
+            (*pending->changes)();
+        }
+        catch(...) {
+            pending->error = std::current_exception();
+        }
+        pending->done = true;
+    }
+    if(!updates.empty()) {
+        updates.clear();
+        update_done.notify_all();
+    }
+}
+
+void ndhcpd_private::process_dhcp()
+{
+    apply_thread_tuning();
+    try {
+        std::vector<struct pollfd> pollFds = {
+            { event, POLLIN|POLLERR, 0 }
+        };
+        for(int fd : watched_fds()) {
+            pollFds.push_back({ fd, POLLIN|POLLERR, 0 });
+        }
+
+        while(!stop_server) {
+            int timeout = -1;
+            std::chrono::steady_clock::time_point now = clock->now();
+            std::chrono::steady_clock::time_point next_timer = run_all_timers(now);
+            if(next_timer != std::chrono::steady_clock::time_point()) {
+                // round up, so timers are due when poll() returns
+                auto delay = std::chrono::duration_cast<std::chrono::milliseconds>(next_timer - now).count() + 1;
+                timeout = static_cast<int>(std::min<decltype(delay)>(delay, std::numeric_limits<int>::max()));
+            }
+            auto ret = poll_events(pollFds.data(), pollFds.size(), timeout);
+            if(ret < 0) {
+                if(errno == EINTR) {
+                    // signal handled by this thread, e.g. SIGHUP of the daemon
+                    continue;
+                }
+                throw std::system_error(errno, std::system_category(), "poll()");
+            }
+            if(pollFds[0].revents != 0) {
+                // event handle has been raised
+                eventfd_t val;
+                eventfd_read(event, &val);
+                // check stop_server variable
+                continue;
+            }
+            std::for_each(pollFds.cbegin()+1, pollFds.cend(), [this](const pollfd& fd){
+               if(fd.revents & (POLLERR|POLLHUP|POLLNVAL)) {
+                   handle_socket(fd.fd, true);
+               }
+               else if(fd.revents & POLLIN) {
+                   handle_socket(fd.fd, false);
+               }
+            });
+        }
+    }
+    catch(const std::exception &err) {
+        log.error(err.what());
+    }
+}
+
+void ndhcpd_private::serve_packet(int fd)
+{
+    if(server_id.s_addr == INADDR_NONE && !ifaceName.empty()) {
+        get_server_id(server);
+        char server_id_str[256];
+        log.infoStream() << "Got server_id: " << inet_ntop(AF_INET, &server_id, server_id_str, sizeof(server_id_str));
+    }
+    uint32_t overflow_before = rxq_overflow;
+    size_t admitted = 0;
+    try {
+        // first read blocks as poll() reported data, the rest drain what is queued
+        while(admitted < admission_buffer.size()
+              && (ring.is_open() ? receive_ring(&admission_buffer[admitted])
+                                 : recieve_packet(fd, admitted ? MSG_DONTWAIT : 0, &admission_buffer[admitted]))) {
+            queued_packet &queued = admission_buffer[admitted++];
+            stats.packet_received();
+            admission_queues[classify_packet(queued.packet)].push_back(&queued);
+        }
+    }
+    catch(const std::system_error &err) {
+        log.error(err.what());
+    }
+    if(ring.is_open()) {
+        try {
+            rxq_overflow += ring.dropped();
+        }
+        catch(const std::system_error &err) {
+            log.error(err.what());
+        }
+    }
+    stats.set_kernel_dropped(rxq_overflow);
+
+    bool shed = under_pressure(fd, overflow_before);
+    if(shed && !admission_queues[discovering].empty()) {
+        log.debugStream() << "Overloaded, shedding " << admission_queues[discovering].size() << " packets";
+        stats.packet_shed(admission_queues[discovering].size());
+        for(const queued_packet *queued : admission_queues[discovering]) {
+            ndhcpd_trace_record_t record;
+            trace_request(*queued, &record);
+            record.decision = NDHCPD_TRACE_SHED;
+            NDHCPD_PROBE3(packet_dropped, ntohl(record.xid), record.mac, 0);
+            trace.record(record);
+        }
+        admission_queues[discovering].clear();
+    }
+    for(auto &queue : admission_queues) {
+        for(const queued_packet *queued : queue) {
+            try {
+                serve_queued(fd, *queued);
+            }
+            catch(const std::system_error &err) {
+                log.error(err.what());
+            }
+        }
+        queue.clear();
+    }
+}
+
+ndhcpd_private::packet_class ndhcpd_private::classify_packet(const dhcp_packet &packet)
+{
+    dhcp_message_type msgType;
+    if(!dhcp_get<dhcp_option::_code::message_type>(packet, &msgType)) {
+        return discovering;
+    }
+    switch(msgType) {
+    case dhcp_message_type::request:
+        if(packet.ciaddr == 0 && dhcp_get_option(packet, dhcp_option::_code::server_id)) {
+            return selecting;
+        }
+        return renewing;
+    case dhcp_message_type::release:
+    case dhcp_message_type::decline:
+        return renewing;
+    default:
+        return discovering;
+    }
+}
+
+bool ndhcpd_private::under_pressure(int fd, uint32_t overflow_before)
+{
+    bool pressure = (rxq_overflow != overflow_before); // kernel dropped since last batch
+    if(ring.is_open()) {
+        size_t backlog = ring.backlog();
+        stats.set_backlog(backlog);
+        return pressure || backlog > ring.capacity() / 2;
+    }
+    uint32_t meminfo[SK_MEMINFO_VARS];
+    socklen_t meminfoLen = sizeof(meminfo);
+    if(getsockopt(fd, SOL_SOCKET, SO_MEMINFO, meminfo, &meminfoLen) == 0) {
+        // still queued after the batch was drained
+        stats.set_backlog(meminfo[SK_MEMINFO_RMEM_ALLOC]);
+        pressure |= (meminfo[SK_MEMINFO_RMEM_ALLOC] > meminfo[SK_MEMINFO_RCVBUF] / 2);
+    }
+    else {
+        // size of next datagram only, any left means batch did not catch up
+        int pending = 0;
+        if(ioctl(fd, SIOCINQ, &pending) == 0) {
+            stats.set_backlog(pending);
+            pressure |= (pending > 0);
+        }
+    }
+    return pressure;
+}
+
+void ndhcpd_private::serve_queued(int fd, const queued_packet &queued)
+{
+    ndhcpd_trace_record_t record;
+    trace_request(queued, &record);
+    try {
+        struct dhcp_packet out_packet;
+        struct dhcp_packet *reply = &out_packet;
+        if(ring.is_open()) {
+            // reply is built right in the tx frame
+            reply = static_cast<dhcp_packet *>(ring.reply_frame());
+            if(!reply) {
+                ring.flush();
+                reply = static_cast<dhcp_packet *>(ring.reply_frame());
+            }
+            if(!reply) {
+                throw std::system_error(std::make_error_code(std::errc::no_buffer_space), "serve_queued()");
+            }
+        }
+        ndhcpd::packet_info out_info;
+        size_t out_len = handle_packet(&queued.packet, queued.len, queued.info, reply, sizeof(*reply), &out_info);
+        record.decided = packet_trace::now();
+        if(out_len == 0) {
+            stats.packet_ignored();
+        }
+        else {
+            trace_reply(*reply, &record);
+            if(park_offer(queued.packet, queued.len, queued.info, *reply, out_len, out_info, 0)) {
+                record.decision = NDHCPD_TRACE_PARKED;
+            }
+            else {
+                send_packet(fd, *reply, out_len, out_info);
+                record.sent = packet_trace::now();
+                std::chrono::nanoseconds latency(0);
+                if(record.received != 0) {
+                    latency = std::chrono::nanoseconds(record.sent - record.received);
+                }
+                stats.packet_replied(latency);
+            }
+        }
+        trace.record(record);
+    }
+    catch(const std::system_error &err) {
+        if(!record.decided) {
+            record.decided = packet_trace::now();
+        }
+        record.decision = NDHCPD_TRACE_ERROR;
+        record.error = err.code().value();
+        NDHCPD_PROBE3(packet_dropped, ntohl(record.xid), record.mac, err.code().value());
+        trace.record(record);
+        stats.packet_dropped();
+        throw;
+    }
+    catch(...) {
+        stats.packet_dropped();
+        throw;
+    }
+}
+
+void ndhcpd_private::trace_request(const queued_packet &queued, ndhcpd_trace_record_t *record) const
+{
+    memset(record, 0, sizeof(*record));
+    record->received = static_cast<uint64_t>(queued.rx_time.tv_sec) * 1000000000 + queued.rx_time.tv_nsec;
+    record->slot = NDHCPD_TRACE_NO_SLOT;
+    record->decision = NDHCPD_TRACE_IGNORED;
+    if(queued.len < offsetof(dhcp_packet, options)) {
+        // truncated, fields are not there
+        return;
+    }
+    record->xid = queued.packet.xid;
+    memcpy(record->mac, queued.packet.chaddr, sizeof(record->mac));
+    dhcp_message_type msgType;
+    if(dhcp_get<dhcp_option::_code::message_type>(queued.packet, &msgType)) {
+        record->message_type = static_cast<uint8_t>(msgType);
+    }
+}
+
+void ndhcpd_private::trace_reply(const dhcp_packet &reply, ndhcpd_trace_record_t *record) const
+{
+    dhcp_message_type msgType;
+    bool typed = dhcp_get<dhcp_option::_code::message_type>(reply, &msgType);
+    if(typed && msgType == dhcp_message_type::offer) {
+        record->decision = NDHCPD_TRACE_OFFER;
+    }
+    else if(typed && msgType == dhcp_message_type::ack) {
+        record->decision = NDHCPD_TRACE_ACK;
+    }
+    else if(typed && msgType == dhcp_message_type::nak) {
+        record->decision = NDHCPD_TRACE_NAK;
+    }
+    record->ip = ntohl(reply.yiaddr);
+    leases_t::const_iterator lease = leases.find(ipinfo(record->ip, 0, 0, 0));
+    if(lease != leases.end()) {
+        record->slot = lease->first.slot;
+    }
+}
+
+void ndhcpd_private::open_prober()
+{
+    bool arp = false, icmp = false;
+    for(const pool &p : pools) {
+        arp |= (p.options.conflictProbe == ndhcpd::conflict_probe::arp);
+        icmp |= (p.options.conflictProbe == ndhcpd::conflict_probe::icmp);
+    }
+    try {
+        if(arp) {
+            if(ifaceName.empty()) {
+                log.warn("ARP conflict probe requires interface, addresses will not be probed");
+            }
+            else {
+                prober.open_arp(ifaceName);
+            }
+        }
+        if(icmp) {
+            prober.open_icmp(ifaceName);
+        }
+    }
+    catch(const std::system_error &err) {
+        log.warnStream() << "Conflict probe disabled: " << err.what();
+    }
+}
+
+bool ndhcpd_private::park_offer(const dhcp_packet &request, size_t request_len, const ndhcpd::packet_info &request_info,
+                                const dhcp_packet &reply, size_t reply_len, const ndhcpd::packet_info &reply_info,
+                                unsigned attempts)
+{
+    dhcp_message_type msgType;
+    bool rapidCommit;
+    if(!dhcp_get<dhcp_option::_code::message_type>(reply, &msgType)
+            || (msgType != dhcp_message_type::offer
+                && !(msgType == dhcp_message_type::ack && dhcp_get<dhcp_option::_code::rapid_commit>(reply, &rapidCommit)))) {
+        return false;
+    }
+    uint32_t ip = ntohl(reply.yiaddr);
+    const ndhcpd::pool_options *options = lease_pool_options(ip);
+    if(!options || options->conflictProbe == ndhcpd::conflict_probe::none) {
+        return false;
+    }
+
+    auto pending = pending_offers.find(ip);
+    if(pending != pending_offers.end()) {
+        // DISCOVER retransmission, probe is already in flight
+        pending->second.request = request;
+        pending->second.request_len = request_len;
+        pending->second.request_info = request_info;
+        pending->second.reply = reply;
+        pending->second.reply_len = reply_len;
+        pending->second.reply_info = reply_info;
+        return true;
+    }
+    if(pending_offers.size() >= max_pending_offers) {
+        log.warn("Too many offers waiting for conflict probe, offering without probe");
+        return false;
+    }
+
+    try {
+        if(options->conflictProbe == ndhcpd::conflict_probe::arp && prober.can_arp()) {
+            prober.probe_arp(ip);
+        }
+        else if(options->conflictProbe == ndhcpd::conflict_probe::icmp && prober.can_icmp()) {
+            prober.probe_icmp(ip);
+        }
+        else {
+            return false;
+        }
+    }
+    catch(const std::system_error &err) {
+        log.warn(err.what());
+        return false;
+    }
+
+    pending_offer offer;
+    offer.deadline = clock->now() + options->probeTimeout;
+    offer.attempts = attempts;
+    offer.request = request;
+    offer.request_len = request_len;
+    offer.request_info = request_info;
+    offer.reply = reply;
+    offer.reply_len = reply_len;
+    offer.reply_info = reply_info;
+    pending_offers.emplace(ip, offer);
+    pending_deadlines.push({offer.deadline, ip});
+    return true;
+}
+
+void ndhcpd_private::handle_probe_reply(int fd)
+{
+    uint32_t ip = prober.read_reply(fd);
+    auto pending = pending_offers.find(ip);
+    if(ip == 0 || pending == pending_offers.end()) {
+        return;
     }
-    if(len < (ssize_t)offsetof(dhcp_packet, options) ||
+    pending_offer offer = pending->second;
+    pending_offers.erase(pending);
+
+    packet_time = clock->now();
+    quarantine_lease(ip);
+    if(offer.attempts+1 >= max_probe_attempts) {
+        log.warnStream() << "No conflict free address found for " << mac_to_string(offer.request.chaddr);
+        return;
+    }
+
+    // Offer another address to the same DISCOVER
+    struct dhcp_packet out_packet;
+    ndhcpd::packet_info out_info;
+    size_t out_len = handle_packet(&offer.request, offer.request_len, offer.request_info, &out_packet, sizeof(out_packet), &out_info);
+    if(out_len != 0
+            && !park_offer(offer.request, offer.request_len, offer.request_info, out_packet, out_len, out_info, offer.attempts+1)) {
+        send_packet(server, out_packet, out_len, out_info);
+    }
+}
+
+std::chrono::steady_clock::time_point ndhcpd_private::run_probe_timers(std::chrono::steady_clock::time_point now)
+{
+    while(!pending_deadlines.empty() && pending_deadlines.top().at <= now) {
+        pending_deadline deadline = pending_deadlines.top();
+        pending_deadlines.pop();
+        auto pending = pending_offers.find(deadline.ip);
+        if(pending == pending_offers.end() || pending->second.deadline != deadline.at) {
+            continue;
+        }
+        // Nobody answered, address is free to offer
+        try {
+            send_packet(server, pending->second.reply, pending->second.reply_len, pending->second.reply_info);
+        }
+        catch(const std::system_error &err) {
+            log.error(err.what());
+        }
+        pending_offers.erase(pending);
+    }
+    if(pending_deadlines.empty()) {
+        return std::chrono::steady_clock::time_point();
+    }
+    return pending_deadlines.top().at;
+}
+
+size_t ndhcpd_private::handle_packet(const void *request, size_t requestLen, const ndhcpd::packet_info &requestInfo,
+                                     void *reply, size_t replyLen, ndhcpd::packet_info *replyInfo)
+{
+    if(replyLen < sizeof(dhcp_packet)) {
+        throw std::system_error(std::make_error_code(std::errc::no_buffer_space), "handle_packet()");
+    }
+
+    // Request buffer may be unaligned and shorter than dhcp_packet
+    dhcp_packet packet;
+    memset(&packet, (int)dhcp_option::_code::end, sizeof(packet));
+    memcpy(&packet, request, std::min(requestLen, sizeof(packet)));
+    validate_packet(packet, requestLen);
+    select_interface(requestInfo);
+    if(is_foreign(packet)) {
+        return 0;
+    }
+    client_class = classifier.classify(packet);
+
+    if(requestInfo.timestamp != 0) {
+        packet_time = std::chrono::steady_clock::time_point(std::chrono::nanoseconds(requestInfo.timestamp));
+    }
+    else {
+        packet_time = clock->now();
+    }
+
+    dhcp_packet out_packet;
+    if(!process_packet(packet, &out_packet)) {
+        return 0;
+    }
+
+    replyInfo->ifindex = requestInfo.ifindex;
+    replyInfo->localAddr = requestInfo.localAddr;
+    if((out_packet.flags & htons(BROADCAST_FLAG))
+            || out_packet.ciaddr == 0
+            ) {
+        replyInfo->addr = INADDR_BROADCAST;
+    }
+    else {
+        replyInfo->addr = ntohl(out_packet.ciaddr);
+    }
+    replyInfo->port = ntohs(dstAddr.sin_port);
+    replyInfo->timestamp = 0;
+
+    memcpy(reply, &out_packet, sizeof(out_packet));
+    return sizeof(out_packet);
+}
+
+void ndhcpd_private::validate_packet(const dhcp_packet &packet, size_t len)
+{
+    if(len < offsetof(dhcp_packet, options) ||
             packet.cookie != htonl(dhcp_packet::cookie_value_he)) {
-        throw std::system_error(make_error_code(dhcp_error::invalid_packet), "recieve_packet()");
+        throw std::system_error(make_error_code(dhcp_error::invalid_packet), "validate_packet()");
     }
     if(packet.htype != ARPHRD_ETHER ||
             packet.hlen != 6) {
-        throw std::system_error(make_error_code(dhcp_error::invalid_hwtype), "recieve_packet()");
+        throw std::system_error(make_error_code(dhcp_error::invalid_hwtype), "validate_packet()");
     }
     if(packet.op != dhcp_packet::_op::BOOTREQUEST) {
-        throw std::system_error(make_error_code(dhcp_error::unexpected_packet_type), "recieve_packet()");
+        throw std::system_error(make_error_code(dhcp_error::unexpected_packet_type), "validate_packet()");
     }
+}
+
+bool ndhcpd_private::is_foreign(const dhcp_packet &packet) const
+{
+    dhcp_message_type msgType;
+    if(!dhcp_get<dhcp_option::_code::message_type>(packet, &msgType)) {
+        return false;
+    }
+    uint32_t server_id_opt;
+    if(msgType == dhcp_message_type::request && dhcp_get<dhcp_option::_code::server_id>(packet, &server_id_opt)) {
+        // client in SELECTING state chose the offer of another server
+        if(packet_server_id.s_addr != INADDR_NONE && server_id_opt != ntohl(packet_server_id.s_addr)) {
+            log.infoStream() << "Ignore request from " << mac_to_string(packet.chaddr) << " to other server";
+            return true;
+        }
+        return false;
+    }
+    if(balancer.serves_all()) {
+        return false;
+    }
+    // RENEWING and REBINDING clients are served by the lease holder
+    if(msgType == dhcp_message_type::discover
+            || (msgType == dhcp_message_type::request && packet.ciaddr == 0)) {
+        uint8_t bucket = load_balancer::bucket(packet);
+        if(!balancer.serves(bucket)) {
+            log.infoStream() << "Ignore " << dhcp_message_type_name(msgType) << " from " << mac_to_string(packet.chaddr)
+                             << " of hash bucket " << static_cast<unsigned>(bucket);
+            return true;
+        }
+    }
+    return false;
+}
 
-    return packet;
+bool ndhcpd_private::recieve_packet(int fd, int flags, queued_packet *queued)
+{
+    struct sockaddr_in addr;
+    struct iovec iov = { &queued->packet, sizeof(queued->packet) };
+    union {
+        char buf[CMSG_SPACE(sizeof(struct timespec)) + CMSG_SPACE(sizeof(uint32_t)) + CMSG_SPACE(sizeof(struct in_pktinfo))];
+        struct cmsghdr align;
+    } control;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = &addr;
+    msg.msg_namelen = sizeof(addr);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    ssize_t len = recvmsg(fd, &msg, flags);
+    if(len < 0) {
+        if(((flags & MSG_DONTWAIT) && (errno == EAGAIN || errno == EWOULDBLOCK)) || errno == EINTR) {
+            return false;
+        }
+        throw std::system_error(errno, std::system_category(), "recvmsg()");
+    }
+    // options past the received data read as end option
+    memset(reinterpret_cast<uint8_t*>(&queued->packet) + len, 0xff, sizeof(queued->packet) - len);
+    queued->len = len;
+    queued->rx_time.tv_sec = 0;
+    queued->rx_time.tv_nsec = 0;
+    queued->info.ifindex = 0;
+    queued->info.localAddr = 0;
+    for(struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if(cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_PKTINFO) {
+            struct in_pktinfo pktinfo;
+            memcpy(&pktinfo, CMSG_DATA(cmsg), sizeof(pktinfo));
+            queued->info.ifindex = pktinfo.ipi_ifindex;
+            queued->info.localAddr = ntohl(pktinfo.ipi_spec_dst.s_addr);
+            continue;
+        }
+        if(cmsg->cmsg_level != SOL_SOCKET) {
+            continue;
+        }
+        if(cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+            memcpy(&queued->rx_time, CMSG_DATA(cmsg), sizeof(queued->rx_time));
+        }
+        else if(cmsg->cmsg_type == SO_RXQ_OVFL) {
+            memcpy(&rxq_overflow, CMSG_DATA(cmsg), sizeof(rxq_overflow));
+        }
+    }
+    queued->info.addr = ntohl(addr.sin_addr.s_addr);
+    queued->info.port = ntohs(addr.sin_port);
+    queued->info.timestamp = 0;
+    NDHCPD_PROBE4(packet_received, ntohl(queued->packet.xid), queued->packet.chaddr, len, queued->info.addr);
+    return true;
 }
 
-dhcp_packet ndhcpd_private::process_packet(const dhcp_packet &packet)
+bool ndhcpd_private::process_packet(const dhcp_packet &packet, dhcp_packet *out_packet)
 {
-    const dhcp_message_type *msgType = static_cast<const dhcp_message_type *>(dhcp_get_option(packet, dhcp_option::_code::message_type));
-    if(!msgType) {
+    dhcp_message_type msgType;
+    if(!dhcp_get<dhcp_option::_code::message_type>(packet, &msgType)) {
         throw std::system_error(make_error_code(dhcp_error::invalid_packet), "process_packet()");
     }
-    if(*msgType < dhcp_message_type::minval
-            || *msgType > dhcp_message_type::maxval) {
+    if(msgType < dhcp_message_type::minval
+            || msgType > dhcp_message_type::maxval) {
         throw std::system_error(make_error_code(dhcp_error::invalid_packet), "process_packet()");
     }
 
-    log.infoStream() << "Recieved " << dhcp_message_type_name(*msgType) << " from " << mac_to_string(packet.chaddr);
+    NDHCPD_PROBE3(packet_classified, ntohl(packet.xid), packet.chaddr, static_cast<uint8_t>(msgType));
+    log.infoStream() << "Recieved " << dhcp_message_type_name(msgType) << " from " << mac_to_string(packet.chaddr);
 
-    switch(*msgType) {
+    switch(msgType) {
     case dhcp_message_type::discover:
-        return make_offer(packet);
+        *out_packet = make_offer(packet);
+        return true;
     case dhcp_message_type::request:
-        return process_ip_request(packet);
+        *out_packet = process_ip_request(packet);
+        return true;
+    case dhcp_message_type::release:
+        process_release(packet);
+        return false;
+    case dhcp_message_type::decline:
+        process_decline(packet);
+        return false;
     default:
         throw std::system_error(make_error_code(dhcp_error::unexpected_packet_type), "process_packet()");
     }
 
 }
 
-void ndhcpd_private::send_packet(int fd, const dhcp_packet &packet)
+void ndhcpd_private::send_packet(int fd, const dhcp_packet &packet, size_t len, const ndhcpd::packet_info &info)
 {
-    uint32_t ciaddr;
-    if((packet.flags & htons(BROADCAST_FLAG))
-            || packet.ciaddr == 0
-            ) {
-        ciaddr = INADDR_BROADCAST;
+    struct sockaddr_in addr = dstAddr;
+    addr.sin_addr.s_addr = htonl(info.addr);
+    addr.sin_port = htons(info.port);
+    if(info.addr == INADDR_BROADCAST && !ring.is_open() && neighbours.is_open() && unicast_to_chaddr(packet)) {
+        try {
+            if(neighbours.add(info.ifindex, ntohl(packet.yiaddr), packet.chaddr, clock->now())) {
+                addr.sin_addr.s_addr = packet.yiaddr;
+            }
+        }
+        catch(const std::system_error &err) {
+            if(err.code().value() == EPERM) {
+                log.warnStream() << "Replies to clients without address are broadcast: " << err.what();
+                neighbours.close();
+            }
+            else {
+                log.error(err.what());
+            }
+        }
+    }
+    struct iovec iov = { const_cast<dhcp_packet *>(&packet), len };
+    union {
+        char buf[CMSG_SPACE(sizeof(struct in_pktinfo))];
+        struct cmsghdr align;
+    } control;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = &addr;
+    msg.msg_namelen = sizeof(addr);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if(info.ifindex > 0 && ifaceName.empty()) {
+        // unbound socket, leave through the interface request arrived on
+        memset(control.buf, 0, sizeof(control.buf));
+        msg.msg_control = control.buf;
+        msg.msg_controllen = sizeof(control.buf);
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = IPPROTO_IP;
+        cmsg->cmsg_type = IP_PKTINFO;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(struct in_pktinfo));
+        struct in_pktinfo pktinfo;
+        memset(&pktinfo, 0, sizeof(pktinfo));
+        pktinfo.ipi_ifindex = info.ifindex;
+        pktinfo.ipi_spec_dst.s_addr = htonl(info.localAddr);
+        memcpy(CMSG_DATA(cmsg), &pktinfo, sizeof(pktinfo));
+    }
+    if(ring.is_open()) {
+        send_ring(packet, len, info);
     }
     else {
-        ciaddr = packet.ciaddr;
+        ssize_t ret = sendmsg(fd, &msg, 0);
+        if(ret < 0)
+            throw std::system_error(errno, std::system_category(), "sendmsg()");
     }
+    dhcp_message_type msgType = dhcp_message_type::minval;
+    dhcp_get<dhcp_option::_code::message_type>(packet, &msgType);
+    NDHCPD_PROBE5(packet_sent, ntohl(packet.xid), packet.chaddr, static_cast<uint8_t>(msgType),
+                  ntohl(packet.yiaddr), info.addr);
 
-    struct sockaddr_in addr = dstAddr;
-    addr.sin_addr.s_addr = ciaddr;
-    ssize_t ret = sendto(fd, &packet, sizeof(packet), 0, (const sockaddr*)&addr, sizeof(addr));
-    if(ret < 0)
-        throw std::system_error(errno, std::system_category(), "sendto()");
+    log.infoStream() << "Sent " << dhcp_message_type_name(msgType) << " to " << mac_to_string(packet.chaddr);
+
+}
+
+bool ndhcpd_private::receive_ring(queued_packet *queued)
+{
+    packet_ring::request req;
+    if(!ring.next(&req)) {
+        return false;
+    }
+    size_t len = std::min(req.len, sizeof(queued->packet));
+    memcpy(&queued->packet, req.data, len);
+    // options past the received data read as end option
+    memset(reinterpret_cast<uint8_t*>(&queued->packet) + len, 0xff, sizeof(queued->packet) - len);
+    queued->len = len;
+    queued->rx_time = req.time;
+    queued->info.ifindex = ring.ifindex();
+    queued->info.addr = req.src_addr;
+    queued->info.port = req.src_port;
+    queued->info.timestamp = 0;
+    queued->info.localAddr = 0;
+    NDHCPD_PROBE4(packet_received, ntohl(queued->packet.xid), queued->packet.chaddr, len, queued->info.addr);
+    return true;
+}
 
-    log.infoStream() << "Sent " << dhcp_message_type_name(*static_cast<const dhcp_message_type *>(dhcp_get_option(packet, dhcp_option::_code::message_type))) << " to " << mac_to_string(packet.chaddr);
+void ndhcpd_private::send_ring(const dhcp_packet &packet, size_t len, const ndhcpd::packet_info &info)
+{
+    void *frame = ring.reply_frame();
+    if(!frame) {
+        ring.flush();
+        frame = ring.reply_frame();
+    }
+    if(!frame) {
+        throw std::system_error(std::make_error_code(std::errc::no_buffer_space), "send_ring()");
+    }
+    if(frame != &packet) {
+        // reply was not built in the ring, e.g. offer held for conflict probe
+        memcpy(frame, &packet, std::min(len, ring.reply_capacity()));
+    }
 
+    static const uint8_t broadcast_mac[6] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+    const uint8_t *dst_mac = packet.chaddr;
+    uint32_t dst_addr = info.addr;
+    if(info.addr == INADDR_BROADCAST) {
+        if(unicast_to_chaddr(packet)) {
+            dst_addr = ntohl(packet.yiaddr);
+        }
+        else {
+            dst_mac = broadcast_mac;
+        }
+    }
+    uint32_t src_addr = info.localAddr;
+    uint32_t server_id_opt;
+    if(dhcp_get<dhcp_option::_code::server_id>(packet, &server_id_opt) && server_id_opt != INADDR_NONE) {
+        src_addr = server_id_opt;
+    }
+    ring.send_frame(std::min(len, ring.reply_capacity()), dst_mac, src_addr, dst_addr, info.port);
 }
 
 dhcp_packet ndhcpd_private::make_offer(const dhcp_packet &packet)
 {
     dhcp_packet out_packet;
-    memset(&out_packet, 0, sizeof(out_packet));
-    out_packet.op = dhcp_packet::_op::BOOTREPLY;
-    out_packet.htype = ARPHRD_ETHER;
-    out_packet.hlen = 6;
-    out_packet.xid = packet.xid;
-    memcpy(out_packet.chaddr, packet.chaddr, sizeof(out_packet.chaddr));
-    out_packet.flags = packet.flags;
-    out_packet.ciaddr = packet.ciaddr;
-    out_packet.cookie = (dhcp_packet::_cookie)htonl(dhcp_packet::cookie_value_he);
-    out_packet.options[0] = (uint8_t)dhcp_option::_code::end;
-    dhcp_add_option(&out_packet, dhcp_option::_code::message_type, dhcp_message_type::offer);
-    dhcp_add_option(&out_packet, dhcp_option::_code::server_id, server_id);
-
-    // Find lease with same MAC-address
-    leases_t::iterator leaseIter = std::find_if(leases.begin(), leases.end(), lease_is_mac_equal(packet.chaddr));
+    templates.render(packet, dhcp_message_type::offer, packet_server_id, &out_packet);
 
+    // Repeat pending offer, or find lease with same MAC-address
+    leases_t::iterator leaseIter = leases.end();
+    uint32_t offered_ip = offers.find(mac_key(packet.chaddr), packet_time);
+    if(offered_ip != 0) {
+        leaseIter = leases.find(ipinfo(offered_ip, 0, 0, 0));
+    }
     if(leaseIter == leases.end()) {
-        leaseIter = std::find_if(leases.begin(), leases.end(), lease_is_overdue(std::chrono::steady_clock::now()));
+        leaseIter = find_lease(packet.chaddr);
+    }
+    if(leaseIter != leases.end() && !serves_pool(leaseIter->first.pool)) {
+        // client moved from another interface
+        leaseIter = leases.end();
+    }
+    if(leaseIter == leases.end()) {
+        leaseIter = allocate_lease(packet.chaddr);
     }
 
     if(leaseIter == leases.end()) {
         throw std::system_error(make_error_code(dhcp_error::no_more_leases), "make_offer()");
     }
 
-    leaseIter->second.reset(new lease_data(packet.chaddr, std::chrono::seconds(60))); // Set lease for offer time (60 sec)
+    bool rapidCommit;
+    if(pools[leaseIter->first.pool].options.rapidCommit
+            && dhcp_get<dhcp_option::_code::rapid_commit>(packet, &rapidCommit)) {
+        // RFC 4039: two message exchange, commit the lease right away
+        offers.release(leaseIter->first.ip);
+        dhcp_packet ack = ack_packet(packet, &(*leaseIter));
+        dhcp_put<dhcp_option::_code::rapid_commit>(&ack, true);
+        NDHCPD_PROBE4(lease_chosen, ntohl(packet.xid), packet.chaddr, leaseIter->first.ip, static_cast<uint8_t>(dhcp_message_type::ack));
+        in_addr addr = {ack.yiaddr};
+        log.infoStream() << "Rapid commit " << inet_ntoa(addr) << " to " << mac_to_string(ack.chaddr);
+        return ack;
+    }
+
+    // Hold the address for offer time, lease table is updated on REQUEST only
+    const ndhcpd::pool_options &options = pools[leaseIter->first.pool].options;
+    offers.reserve(leaseIter->first.ip, mac_key(packet.chaddr), packet_time + options.offerTime);
+    emit_event(ndhcpd::lease_event_type::offered, leaseIter->first.ip, packet.chaddr, options.offerTime, packet_time);
 
     out_packet.yiaddr = htonl(leaseIter->first.ip);
-    dhcp_add_option(&out_packet, dhcp_option::_code::lease_time, htonl(leaseIter->second->lease_time.count()));
-    dhcp_add_option(&out_packet, dhcp_option::_code::subnet_mask, htonl(leaseIter->first.subnet));
+    add_lease_options(&out_packet, leaseIter->first, granted_lease_time(leaseIter->first, packet.chaddr));
+    NDHCPD_PROBE4(lease_chosen, ntohl(packet.xid), packet.chaddr, leaseIter->first.ip, static_cast<uint8_t>(dhcp_message_type::offer));
     in_addr addr = {out_packet.yiaddr};
     log.infoStream() << "Make offer for " << inet_ntoa(addr) << " to " << mac_to_string(out_packet.chaddr);
     return out_packet;
@@ -346,36 +1801,45 @@ dhcp_packet ndhcpd_private::make_offer(const dhcp_packet &packet)
 
 dhcp_packet ndhcpd_private::process_ip_request(const dhcp_packet &packet)
 {
-    const uint32_t *server_id_opt = (uint32_t *)dhcp_get_option(packet, dhcp_option::_code::server_id);
-    const uint32_t *requested_ip_opt = (uint32_t *)dhcp_get_option(packet, dhcp_option::_code::requested_ip);
-
+    uint32_t server_id_opt;
+    bool selecting = dhcp_get<dhcp_option::_code::server_id>(packet, &server_id_opt);
     uint32_t requested_ip;
-    if(requested_ip_opt) {
-        requested_ip = ntohl(*requested_ip_opt);
-    }
-    else {
+    bool init_reboot = dhcp_get<dhcp_option::_code::requested_ip>(packet, &requested_ip);
+
+    if(!init_reboot) {
         requested_ip = ntohl(packet.ciaddr);
         if(requested_ip == 0) {
             throw std::system_error(make_error_code(dhcp_error::no_ip_requested), "process_ip_request()");
         }
     }
 
-    leases_t::iterator leaseIter = std::find_if(leases.begin(), leases.end(), lease_is_mac_equal(packet.chaddr));
+    leases_t::iterator leaseIter = find_lease(packet.chaddr);
+    if(offers.find(mac_key(packet.chaddr), packet_time) == requested_ip) {
+        // client selected our offer
+        leaseIter = leases.find(ipinfo(requested_ip, 0, 0, 0));
+        offers.release(requested_ip);
+    }
+    if(leaseIter != leases.end() && !serves_pool(leaseIter->first.pool)) {
+        // lease of another interface
+        leaseIter = leases.end();
+    }
     if(leaseIter != leases.end() && leaseIter->first.ip == requested_ip) {
         // client requested or configured IP matches the lease.
         // ACK it, and bump lease expiration time.
         in_addr addr = {htonl(requested_ip)};
         log.infoStream() << "Acknowledge request for " << inet_ntoa(addr) << " to " << mac_to_string(packet.chaddr);
+        NDHCPD_PROBE4(lease_chosen, ntohl(packet.xid), packet.chaddr, requested_ip, static_cast<uint8_t>(dhcp_message_type::ack));
         return ack_packet(packet, &(*leaseIter));
     }
 
     // No lease for this MAC, or lease IP != requested IP
 
-    if(server_id_opt // client is in SELECTING state
-            || requested_ip_opt // client is in INIT-REBOOT state
+    if(selecting // client is in SELECTING state
+            || init_reboot // client is in INIT-REBOOT state
             ) {
         // "No, we don't have this IP for you"
         log.infoStream() << "Not acknowledge request to " << mac_to_string(packet.chaddr);
+        NDHCPD_PROBE4(lease_chosen, ntohl(packet.xid), packet.chaddr, requested_ip, static_cast<uint8_t>(dhcp_message_type::nak));
         return nak_packet(packet);
     }
 
@@ -384,44 +1848,104 @@ dhcp_packet ndhcpd_private::process_ip_request(const dhcp_packet &packet)
     throw std::system_error(make_error_code(dhcp_error::invalid_packet), "process_ip_request()");
 }
 
+void ndhcpd_private::process_release(const dhcp_packet &packet)
+{
+    uint32_t released_ip = ntohl(packet.ciaddr);
+    leases_t::iterator leaseIter = find_lease(packet.chaddr);
+    if(leaseIter == leases.end() || leaseIter->first.ip != released_ip) {
+        log.infoStream() << "Ignore release from " << mac_to_string(packet.chaddr) << " without lease";
+        return;
+    }
+    in_addr addr = {packet.ciaddr};
+    log.infoStream() << "Release " << inet_ntoa(addr) << " from " << mac_to_string(packet.chaddr);
+    emit_event(ndhcpd::lease_event_type::released, *leaseIter, packet_time);
+    set_lease(*leaseIter, nullptr);
+}
+
+std::chrono::seconds ndhcpd_private::granted_lease_time(const ipinfo &ip, const uint8_t *mac) const
+{
+    const ndhcpd::pool_options &options = pools[ip.pool].options;
+    std::chrono::seconds lease_time = options.leaseTime;
+    if(options.leaseJitter != 0) {
+        // Same client always gets the same cut, so renewals of clients
+        // bound at the same moment drift apart instead of repeating in lockstep
+        int64_t spread = lease_time.count() * std::min(options.leaseJitter, 100u) / 100;
+        lease_time -= std::chrono::seconds(spread * (mac_hash(mac) % 1024) / 1024);
+        lease_time = std::max(lease_time, std::chrono::seconds(1));
+    }
+    return lease_time;
+}
+
+void ndhcpd_private::add_lease_options(dhcp_packet *out_packet, const ipinfo &ip, std::chrono::seconds lease_time) const
+{
+    const ndhcpd::pool_options &options = pools[ip.pool].options;
+    // configured T1/T2 are scaled together with jittered lease time
+    std::chrono::seconds t1 = lease_time / 2;
+    if(options.t1.count() != 0) {
+        t1 = options.t1 * lease_time.count() / std::max<std::chrono::seconds::rep>(options.leaseTime.count(), 1);
+    }
+    std::chrono::seconds t2 = lease_time * 7 / 8;
+    if(options.t2.count() != 0) {
+        t2 = options.t2 * lease_time.count() / std::max<std::chrono::seconds::rep>(options.leaseTime.count(), 1);
+    }
+
+    dhcp_put<dhcp_option::_code::lease_time>(out_packet, lease_time.count());
+    dhcp_put<dhcp_option::_code::renewal_time>(out_packet, t1.count());
+    dhcp_put<dhcp_option::_code::rebinding_time>(out_packet, t2.count());
+    dhcp_put<dhcp_option::_code::subnet_mask>(out_packet, ip.subnet);
+    bool class_options_added = add_class_options(out_packet);
+
+    const std::vector<uint8_t> &encoded = pools[ip.pool].lease_options;
+    bool fits = true;
+    if(!class_options_added) {
+        fits = dhcp_append_options(out_packet, encoded.data(), encoded.size());
+    }
+    else {
+        // options of class override the ones of pool
+        for(size_t pos = 0; pos < encoded.size(); pos += 2 + encoded[pos+1]) {
+            if(!dhcp_find_option(*out_packet, static_cast<dhcp_option::_code>(encoded[pos]))) {
+                fits = fits && dhcp_append_options(out_packet, &encoded[pos], 2 + encoded[pos+1]);
+            }
+        }
+    }
+    if(!fits) {
+        log.warnStream() << "Options of pool " << ip.pool << " do not fit into reply";
+    }
+}
+
+void ndhcpd_private::process_decline(const dhcp_packet &packet)
+{
+    uint32_t requested_ip;
+    leases_t::iterator leaseIter = find_lease(packet.chaddr);
+    if(!dhcp_get<dhcp_option::_code::requested_ip>(packet, &requested_ip)
+            || leaseIter == leases.end() || leaseIter->first.ip != requested_ip) {
+        log.infoStream() << "Ignore decline from " << mac_to_string(packet.chaddr) << " without lease";
+        return;
+    }
+    log.infoStream() << "Decline from " << mac_to_string(packet.chaddr);
+    quarantine_lease(leaseIter->first.ip);
+}
+
 dhcp_packet ndhcpd_private::ack_packet(const dhcp_packet &packet, leases_t::value_type *lease)
 {
     dhcp_packet out_packet;
-    memset(&out_packet, 0, sizeof(out_packet));
-    out_packet.op = dhcp_packet::_op::BOOTREPLY;
-    out_packet.htype = ARPHRD_ETHER;
-    out_packet.hlen = 6;
-    out_packet.xid = packet.xid;
-    memcpy(out_packet.chaddr, packet.chaddr, sizeof(out_packet.chaddr));
-    out_packet.flags = packet.flags;
-    out_packet.ciaddr = packet.ciaddr;
-    out_packet.cookie = (dhcp_packet::_cookie)htonl(dhcp_packet::cookie_value_he);
-    out_packet.options[0] = (uint8_t)dhcp_option::_code::end;
-    dhcp_add_option(&out_packet, dhcp_option::_code::message_type, dhcp_message_type::ack);
-    dhcp_add_option(&out_packet, dhcp_option::_code::server_id, server_id);
-
-    lease->second.reset(new lease_data(packet.chaddr, std::chrono::hours(1))); // Set lease for lease time (1hour)
+    templates.render(packet, dhcp_message_type::ack, packet_server_id, &out_packet);
+
+    bool renew = lease->second
+            && lease->second->state == ndhcpd::lease_state::bound
+            && lease_is_mac_equal(packet.chaddr)(*lease);
+    set_lease(*lease, new lease_data(packet.chaddr, ndhcpd::lease_state::bound, granted_lease_time(lease->first, packet.chaddr), packet_time));
+    emit_event(renew ? ndhcpd::lease_event_type::renewed : ndhcpd::lease_event_type::bound, *lease, packet_time);
+    update_dns(lease->first.ip, &packet);
 
     out_packet.yiaddr = htonl(lease->first.ip);
-    dhcp_add_option(&out_packet, dhcp_option::_code::lease_time, htonl(lease->second->lease_time.count()));
-    dhcp_add_option(&out_packet, dhcp_option::_code::subnet_mask, htonl(lease->first.subnet));
+    add_lease_options(&out_packet, lease->first, lease->second->lease_time);
     return out_packet;
 }
 
 dhcp_packet ndhcpd_private::nak_packet(const dhcp_packet &packet)
 {
     dhcp_packet out_packet;
-    memset(&out_packet, 0, sizeof(out_packet));
-    out_packet.op = dhcp_packet::_op::BOOTREPLY;
-    out_packet.htype = ARPHRD_ETHER;
-    out_packet.hlen = 6;
-    out_packet.xid = packet.xid;
-    memcpy(out_packet.chaddr, packet.chaddr, sizeof(out_packet.chaddr));
-    out_packet.flags = packet.flags;
-    out_packet.ciaddr = packet.ciaddr;
-    out_packet.cookie = (dhcp_packet::_cookie)htonl(dhcp_packet::cookie_value_he);
-    out_packet.options[0] = (uint8_t)dhcp_option::_code::end;
-    dhcp_add_option(&out_packet, dhcp_option::_code::message_type, dhcp_message_type::nak);
-    dhcp_add_option(&out_packet, dhcp_option::_code::server_id, server_id);
+    templates.render(packet, dhcp_message_type::nak, packet_server_id, &out_packet);
     return out_packet;
 }
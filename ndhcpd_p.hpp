@@ -5,8 +5,12 @@
 #include <array>
 #include <chrono>
 #include <map>
+#include <queue>
 #include <thread>
+#include <unordered_map>
 #include <condition_variable>
+#include <exception>
+#include <functional>
 #include <mutex>
 #include <string>
 #include <sstream>
@@ -15,12 +19,30 @@
 
 #include "file.hpp"
 #include "socket.hpp"
+#include "lease_table.hpp"
+#include "lease_events.hpp"
+#include "lease_shm.hpp"
+#include "client_classifier.hpp"
+#include "conflict_probe.hpp"
+#include "offer_table.hpp"
+#include "lease_clock.hpp"
+#include "lease_replication.hpp"
+#include "ddns_updater.hpp"
+#include "load_balancer.hpp"
+#include "neighbour_cache.hpp"
+#include "packet_ring.hpp"
+#include "packet_trace.hpp"
+#include "reply_templates.hpp"
+#include "server_stats.hpp"
 
 #include "dhcp_packet.hpp"
+#include "dhcp_options.hpp"
 
 #include <log4cpp/Category.hh>
 
 
+class ndhcpd_executor_private;
+
 class ndhcpd_private
 {
 public:
@@ -28,24 +50,29 @@ public:
     ~ndhcpd_private();
 public:
     struct lease_data {
-        lease_data(const uint8_t *_mac, std::chrono::seconds _lease_time)
-            : lease_time(_lease_time)
-            , lease_start(std::chrono::steady_clock::now())
+        lease_data(const uint8_t *_mac, ndhcpd::lease_state _state, std::chrono::seconds _lease_time, std::chrono::steady_clock::time_point _lease_start)
+            : state(_state)
+            , lease_time(_lease_time)
+            , lease_start(_lease_start)
         {
             std::copy(_mac, _mac+6, mac.begin());
         }
 
         std::array<uint8_t,6> mac;
+        ndhcpd::lease_state state;
         std::chrono::seconds lease_time;
         std::chrono::steady_clock::time_point lease_start;
     };
 
     struct ipinfo {
-        ipinfo(uint32_t ip_, uint32_t subnet_)
-            : ip(ip_), subnet(subnet_)
+        ipinfo(uint32_t ip_, uint32_t subnet_, uint32_t slot_, uint32_t pool_)
+            : ip(ip_), subnet(subnet_), slot(slot_), pool(pool_)
         {}
         uint32_t ip;
-        uint32_t subnet;
+        // not part of the key, address of disabled pool moves to pool adding it again
+        mutable uint32_t subnet;
+        uint32_t slot; // index in lease_records
+        mutable uint32_t pool; // index in pools
         bool operator<(const ipinfo& other) const {
             return ip < other.ip;
         }
@@ -60,6 +87,106 @@ public:
     typedef std::map<ipinfo, std::unique_ptr<lease_data>> leases_t;
     leases_t leases;
 
+    struct pool {
+        explicit pool(const ndhcpd::pool_options &_options)
+            : options(_options)
+        {}
+        ndhcpd::pool_options options;
+        std::vector<leases_t::iterator> entries; // in order of adding
+        std::string iface; // serves clients of this interface only, empty for any
+        std::vector<int> classes; // serves clients of these classes only, sorted, empty for all
+        std::vector<uint8_t> lease_options; // network options of pool options, encoded
+        bool enabled = true; // disabled pool offers nothing and NAKs renewals
+    };
+    std::vector<pool> pools;
+    ndhcpd::pool_options default_pool_options;
+    std::vector<uint8_t> default_lease_options;
+    void set_default_pool_options(const ndhcpd::pool_options &options);
+    void set_pool_options(int pool, const ndhcpd::pool_options &options);
+    static std::vector<uint8_t> encode_lease_options(const ndhcpd::pool_options &options);
+
+    // Multi-interface mode of unbound server. Context of the interface request
+    // arrived on is looked up by ifindex from IP_PKTINFO.
+    struct interface_context {
+        std::vector<uint32_t> pools; // own and unbound pools, in order of adding
+        in_addr server_id; // INADDR_NONE for address request arrived to
+    };
+    std::vector<interface_context> interfaces; // indexed by ifindex
+    std::vector<uint32_t> any_pools; // pools not bound to interface
+    std::map<std::string, in_addr> interface_server_ids;
+    bool multi_interface;
+    bool interfaces_dirty; // rebuilt before the next packet
+    void build_interfaces();
+    void set_pool_interface(int pool, const std::string &iface);
+    void set_interface_server_id(const std::string &iface, in_addr id);
+
+    // Client classes select pools and add options to replies
+    client_classifier classifier;
+    std::vector<std::vector<uint8_t>> class_options; // encoded options by class id
+    bool restricted_pools; // some pool is limited to classes or disabled
+    void set_pool_classes(int pool, const std::vector<std::string> &classes);
+    void set_pool_enabled(int pool, bool enabled);
+    void update_restricted_pools();
+    void set_class_option(const std::string &class_name, uint8_t code, const std::vector<uint8_t> &value);
+    bool add_class_options(struct dhcp_packet *out_packet) const; // false if none added
+
+    reply_templates templates; // reply headers, network boot ones by client architecture
+
+    // context of the packet being processed
+    const std::vector<uint32_t> *packet_pools; // nullptr for all pools
+    in_addr packet_server_id;
+    int client_class; // of the client, client_classifier::none if no class
+    void select_interface(const ndhcpd::packet_info &info);
+    bool serves_pool(uint32_t pool) const;
+    bool serves_class(const pool &p) const;
+
+    int add_pool();
+    void add_ip(uint32_t ip, uint32_t mask, int pool);
+    std::vector<int> add_ranges(const std::vector<ndhcpd::range> &ranges);
+    pool &get_pool(int pool);
+    static void check_timers(const ndhcpd::pool_options &options);
+
+    // client MAC to its lease
+    std::unordered_map<uint64_t, leases_t::iterator> mac_index;
+    static uint64_t mac_key(const uint8_t *mac);
+    leases_t::iterator find_lease(const uint8_t *mac);
+    leases_t::iterator allocate_lease(const uint8_t *mac);
+    const ndhcpd::pool_options *lease_pool_options(uint32_t ip) const;
+    void quarantine_lease(uint32_t ip);
+    lease_table lease_records;
+    static const size_t max_offers = 65536;
+    offer_table offers;
+    lease_event_queue events;
+    lease_shm_export lease_export;
+
+    void export_leases(const std::string &shmName);
+
+    lease_replication replication;
+    void replicate_lease(const leases_t::value_type &lease);
+    void take_over();
+
+    ddns_updater ddns;
+    void update_dns(uint32_t ip, const dhcp_packet *packet); // nullptr when lease is gone
+
+    void set_lease(leases_t::value_type &lease, lease_data *data);
+    void publish_lease(const leases_t::value_type &lease);
+    void emit_event(ndhcpd::lease_event_type type, const leases_t::value_type &lease, std::chrono::steady_clock::time_point time);
+    void emit_event(ndhcpd::lease_event_type type, uint32_t ip, const uint8_t *mac, std::chrono::seconds lease_time,
+                    std::chrono::steady_clock::time_point time);
+
+    // bound leases ordered by expiration time, stale entries are skipped
+    struct lease_expiry {
+        std::chrono::steady_clock::time_point at;
+        leases_t::iterator lease;
+        bool operator>(const lease_expiry &other) const {
+            return at > other.at;
+        }
+    };
+    std::priority_queue<lease_expiry, std::vector<lease_expiry>, std::greater<lease_expiry>> lease_expiries;
+
+    std::chrono::steady_clock::time_point run_timers(std::chrono::steady_clock::time_point now);
+    void expire_leases(std::chrono::steady_clock::time_point now);
+
     struct lease_is_mac_equal {
         lease_is_mac_equal(const uint8_t *mac)
             : mac(mac)
@@ -82,16 +209,114 @@ public:
     void stop(bool silent = false);
 
     void get_server_id(const Socket &_server);
+    void apply_busy_poll(Socket &socket);
+    void apply_thread_tuning();
+    int poll_events(struct pollfd *fds, size_t count, int timeout);
     void process_dhcp();
+    void serve_packet(int fd);
+
+    // event loop pieces, shared with executor
+    std::vector<int> watched_fds() const;
+
+    void handle_socket(int fd, bool error);
+    std::chrono::steady_clock::time_point run_all_timers(std::chrono::steady_clock::time_point now);
+
+    // Configuration changes run by the serving thread between packet batches
+    struct pending_update {
+        const std::function<void()> *changes;
+        bool done;
+        std::exception_ptr error;
+    };
+    std::mutex update_mutex;
+    std::condition_variable update_done;
+    std::vector<pending_update*> updates;
+    File update_event; // watched by the serving thread while started
+    void update(const std::function<void()> &changes);
+    void run_updates();
+
+    // admission stage: socket is drained into per-class queues served by priority,
+    // so renewals of bound clients are not starved by a DISCOVER flood
+    enum packet_class {
+        renewing,    // renew, rebind and init-reboot REQUEST, RELEASE, DECLINE
+        selecting,   // REQUEST answering OFFER
+        discovering, // DISCOVER and unclassified packets, shed first
+        packet_classes
+    };
+    struct queued_packet {
+        struct dhcp_packet packet;
+        size_t len;
+        ndhcpd::packet_info info;
+        struct timespec rx_time;
+    };
+    static const size_t admission_batch = 64;
+    std::vector<queued_packet> admission_buffer;
+    std::array<std::vector<queued_packet*>, packet_classes> admission_queues;
+    uint32_t rxq_overflow; // SO_RXQ_OVFL drop counter
+
+    static packet_class classify_packet(const struct dhcp_packet &packet);
+    bool under_pressure(int fd, uint32_t overflow_before);
+    void serve_queued(int fd, const queued_packet &queued);
+
+    packet_trace trace;
+    void trace_request(const queued_packet &queued, ndhcpd_trace_record_t *record) const;
+    void trace_reply(const struct dhcp_packet &reply, ndhcpd_trace_record_t *record) const;
+
+    // DISCOVERs waiting for conflict probe of the offered address
+    struct pending_offer {
+        std::chrono::steady_clock::time_point deadline;
+        unsigned attempts;
+        struct dhcp_packet request;
+        size_t request_len;
+        ndhcpd::packet_info request_info;
+        struct dhcp_packet reply;
+        size_t reply_len;
+        ndhcpd::packet_info reply_info;
+    };
+    struct pending_deadline {
+        std::chrono::steady_clock::time_point at;
+        uint32_t ip;
+        bool operator>(const pending_deadline &other) const {
+            return at > other.at;
+        }
+    };
+    static const size_t max_pending_offers = 4096;
+    static const unsigned max_probe_attempts = 3;
+    std::unordered_map<uint32_t, pending_offer> pending_offers;
+    std::priority_queue<pending_deadline, std::vector<pending_deadline>, std::greater<pending_deadline>> pending_deadlines;
+    conflict_prober prober;
+
+    void open_prober();
+    bool park_offer(const struct dhcp_packet &request, size_t request_len, const ndhcpd::packet_info &request_info,
+                    const struct dhcp_packet &reply, size_t reply_len, const ndhcpd::packet_info &reply_info,
+                    unsigned attempts);
+    void handle_probe_reply(int fd);
+    std::chrono::steady_clock::time_point run_probe_timers(std::chrono::steady_clock::time_point now);
+
+    // packet engine
+    size_t handle_packet(const void *request, size_t requestLen, const ndhcpd::packet_info &requestInfo,
+                         void *reply, size_t replyLen, ndhcpd::packet_info *replyInfo);
+    void validate_packet(const struct dhcp_packet &packet, size_t len);
+
+    // RFC 3074 hash buckets served by this instance
+    load_balancer balancer;
+    bool is_foreign(const struct dhcp_packet &packet) const;
 
     // packet workflow
-    struct dhcp_packet recieve_packet(int fd);
-    struct dhcp_packet process_packet(const struct dhcp_packet &packet);
-    void send_packet(int fd, const struct dhcp_packet &packet);
+    bool recieve_packet(int fd, int flags, queued_packet *queued);
+    bool receive_ring(queued_packet *queued);
+    void send_ring(const struct dhcp_packet &packet, size_t len, const ndhcpd::packet_info &info);
+    bool process_packet(const struct dhcp_packet &packet, struct dhcp_packet *out_packet);
+    void send_packet(int fd, const struct dhcp_packet &packet, size_t len, const ndhcpd::packet_info &info);
 
     //packet processors
     struct dhcp_packet make_offer(const struct dhcp_packet &packet);
     struct dhcp_packet process_ip_request(const struct dhcp_packet &packet);
+    void process_release(const struct dhcp_packet &packet);
+    void process_decline(const struct dhcp_packet &packet);
+
+    // lease timers
+    std::chrono::seconds granted_lease_time(const ipinfo &ip, const uint8_t *mac) const;
+    void add_lease_options(struct dhcp_packet *out_packet, const ipinfo &ip, std::chrono::seconds lease_time) const;
 
     // output packet generator
     struct dhcp_packet ack_packet(const struct dhcp_packet &packet, leases_t::value_type *lease);
@@ -99,16 +324,31 @@ public:
 
 
 
+    ndhcpd::low_latency_options low_latency;
+    server_stats stats;
+
+    // ndhcpd_private() initializes these in declaration order (-Wreorder)
     std::thread serverThread;
+    ndhcpd::transport_type transport;
+    packet_ring ring; // replaces server socket for packet_ring transport
+    neighbour_cache neighbours; // lets socket replies be unicast to clients without address
     Socket server;
     in_addr server_id;
+    bool fixed_server_id;
     File event;
     bool stop_server;
+    ndhcpd_executor_private *executor; // shared event loop instead of serverThread
+    bool attached;
 
     struct sockaddr_in srcAddr;
     struct sockaddr_in dstAddr;
     std::string ifaceName;
 
+    // time of the packet being processed
+    std::chrono::steady_clock::time_point packet_time;
+    std::unique_ptr<lease_clock> clock;
+    void set_clock(ndhcpd::clock_type type);
+
     log4cpp::Category &log;
 };
 
@@ -0,0 +1,192 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+#include "neighbour_cache.hpp"
+
+#include <system_error>
+
+#include <errno.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/neighbour.h>
+
+namespace {
+// removals sent by one sendto()
+const size_t batch_limit = 256;
+}
+
+const size_t neighbour_cache::max_entries;
+const unsigned neighbour_cache::hold_seconds;
+
+neighbour_cache::neighbour_cache()
+    : seq(0)
+    , batch_count(0)
+{
+}
+
+void neighbour_cache::open()
+{
+    Socket _socket(PF_NETLINK, SOCK_RAW|SOCK_NONBLOCK|SOCK_CLOEXEC, NETLINK_ROUTE);
+    if(!_socket) {
+        throw std::system_error(errno, std::system_category(), "socket(NETLINK_ROUTE)");
+    }
+    struct sockaddr_nl addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    _socket.bind(addr);
+    std::swap(socket, _socket);
+}
+
+void neighbour_cache::close()
+{
+    if(is_open()) {
+        for(const auto &e : entries) {
+            append(RTM_DELNEIGH, NLM_F_REQUEST, e.first, nullptr);
+            if(batch_count == batch_limit) {
+                flush_removals();
+            }
+        }
+        flush_removals();
+    }
+    entries.clear();
+    expiries.clear();
+    socket.close();
+}
+
+bool neighbour_cache::add(int ifindex, uint32_t ip, const uint8_t *mac, std::chrono::steady_clock::time_point now)
+{
+    if(!is_open() || ifindex <= 0) {
+        return false;
+    }
+    uint64_t k = key(ifindex, ip);
+    std::chrono::steady_clock::time_point expires = now + std::chrono::seconds(hold_seconds);
+    auto iter = entries.find(k);
+    if(iter != entries.end() && memcmp(iter->second.mac.data(), mac, iter->second.mac.size()) == 0) {
+        // retransmission or ACK after OFFER, kernel entry is still there
+        iter->second.expires = expires;
+        expiries.push_back(expiry{expires, k});
+        return true;
+    }
+    if(iter == entries.end() && entries.size() >= max_entries) {
+        return false;
+    }
+    // entries of others, e.g. learned by ARP or permanent, are left alone,
+    // only an entry installed here may be replaced for another client
+    uint16_t flags = (iter != entries.end()) ? NLM_F_REPLACE : NLM_F_EXCL;
+    append(RTM_NEWNEIGH, NLM_F_REQUEST|NLM_F_ACK|NLM_F_CREATE|flags, k, mac);
+    int err = send_batch();
+    if(err == EEXIST) {
+        return false;
+    }
+    if(err != 0) {
+        throw std::system_error(err, std::system_category(), "RTM_NEWNEIGH");
+    }
+    entry &e = entries[k];
+    memcpy(e.mac.data(), mac, e.mac.size());
+    e.expires = expires;
+    expiries.push_back(expiry{expires, k});
+    return true;
+}
+
+std::chrono::steady_clock::time_point neighbour_cache::expire(std::chrono::steady_clock::time_point now)
+{
+    while(!expiries.empty() && expiries.front().at <= now) {
+        expiry exp = expiries.front();
+        expiries.pop_front();
+        auto iter = entries.find(exp.key);
+        if(iter == entries.end() || iter->second.expires != exp.at) {
+            // refreshed since
+            continue;
+        }
+        entries.erase(iter);
+        append(RTM_DELNEIGH, NLM_F_REQUEST, exp.key, nullptr);
+        if(batch_count == batch_limit) {
+            flush_removals();
+        }
+    }
+    flush_removals();
+    if(expiries.empty()) {
+        return std::chrono::steady_clock::time_point();
+    }
+    return expiries.front().at;
+}
+
+void neighbour_cache::append(uint16_t type, uint16_t flags, uint64_t key, const uint8_t *mac)
+{
+    struct {
+        struct nlmsghdr hdr;
+        struct ndmsg nd;
+        char attrs[RTA_SPACE(4) + RTA_SPACE(6)];
+    } msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.hdr.nlmsg_len = NLMSG_LENGTH(sizeof(msg.nd));
+    msg.hdr.nlmsg_type = type;
+    msg.hdr.nlmsg_flags = flags;
+    msg.hdr.nlmsg_seq = ++seq;
+    msg.nd.ndm_family = AF_INET;
+    msg.nd.ndm_ifindex = static_cast<int>(key >> 32);
+    // kernel uses it at once, without resolving it by ARP
+    msg.nd.ndm_state = mac ? NUD_REACHABLE : 0;
+
+    struct rtattr *rta = reinterpret_cast<struct rtattr *>(msg.attrs);
+    uint32_t ip = htonl(static_cast<uint32_t>(key));
+    rta->rta_type = NDA_DST;
+    rta->rta_len = RTA_LENGTH(sizeof(ip));
+    memcpy(RTA_DATA(rta), &ip, sizeof(ip));
+    msg.hdr.nlmsg_len += RTA_SPACE(sizeof(ip));
+    if(mac) {
+        rta = reinterpret_cast<struct rtattr *>(msg.attrs + RTA_SPACE(sizeof(ip)));
+        rta->rta_type = NDA_LLADDR;
+        rta->rta_len = RTA_LENGTH(6);
+        memcpy(RTA_DATA(rta), mac, 6);
+        msg.hdr.nlmsg_len += RTA_SPACE(6);
+    }
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&msg);
+    batch.insert(batch.end(), bytes, bytes + NLMSG_ALIGN(msg.hdr.nlmsg_len));
+    ++batch_count;
+}
+
+void neighbour_cache::flush_removals()
+{
+    // entry may be gone already, e.g. with the interface
+    send_batch();
+}
+
+int neighbour_cache::send_batch()
+{
+    if(batch.empty()) {
+        return 0;
+    }
+    struct sockaddr_nl kernel;
+    memset(&kernel, 0, sizeof(kernel));
+    kernel.nl_family = AF_NETLINK;
+    ssize_t ret = sendto(socket, batch.data(), batch.size(), 0, reinterpret_cast<struct sockaddr *>(&kernel), sizeof(kernel));
+    int err = (ret < 0) ? errno : 0;
+    batch.clear();
+    batch_count = 0;
+    if(err != 0) {
+        return err;
+    }
+    // rtnetlink handles requests within sendto(), answers are queued already
+    union {
+        char buf[8192];
+        struct nlmsghdr align;
+    } answer;
+    for(;;) {
+        ssize_t len = recv(socket, answer.buf, sizeof(answer.buf), MSG_DONTWAIT);
+        if(len <= 0) {
+            break;
+        }
+        for(struct nlmsghdr *hdr = &answer.align; NLMSG_OK(hdr, len); hdr = NLMSG_NEXT(hdr, len)) {
+            if(hdr->nlmsg_type != NLMSG_ERROR) {
+                continue;
+            }
+            const struct nlmsgerr *nlerr = static_cast<const struct nlmsgerr *>(NLMSG_DATA(hdr));
+            if(nlerr->error != 0 && err == 0) {
+                err = -nlerr->error;
+            }
+        }
+    }
+    return err;
+}
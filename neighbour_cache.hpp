@@ -0,0 +1,65 @@
+#ifndef NDHCPD_NEIGHBOUR_CACHE_HPP
+#define NDHCPD_NEIGHBOUR_CACHE_HPP
+
+#include <array>
+#include <chrono>
+#include <deque>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+#include "socket.hpp"
+
+// Temporary kernel neighbour entries for clients without address yet, so
+// replies can be unicast to yiaddr and chaddr (RFC 2131 4.1).
+// Entry is installed through rtnetlink right before the reply is sent and
+// removed once it is older than hold time. Removals are sent in batches.
+// Existing kernel entries are never replaced nor removed.
+class neighbour_cache
+{
+public:
+    neighbour_cache();
+
+    neighbour_cache(const neighbour_cache&) = delete;
+    neighbour_cache& operator=(const neighbour_cache&) = delete;
+
+public:
+    static const size_t max_entries = 4096;
+    static const unsigned hold_seconds = 10;
+
+    void open();
+    void close(); // removes installed entries
+    bool is_open() const { return socket.isValid(); }
+    size_t size() const { return entries.size(); }
+
+    // ip in host endiannes. Returns false when entry can not be installed or
+    // the kernel has one of its own, reply has to be broadcast then.
+    bool add(int ifindex, uint32_t ip, const uint8_t *mac, std::chrono::steady_clock::time_point now);
+    // Removes entries older than hold time.
+    // Returns when next entry expires, zero if there is none.
+    std::chrono::steady_clock::time_point expire(std::chrono::steady_clock::time_point now);
+
+private:
+    struct entry {
+        std::array<uint8_t, 6> mac;
+        std::chrono::steady_clock::time_point expires;
+    };
+    struct expiry {
+        std::chrono::steady_clock::time_point at;
+        uint64_t key;
+    };
+    static uint64_t key(int ifindex, uint32_t ip) { return (static_cast<uint64_t>(ifindex) << 32) | ip; }
+
+    void append(uint16_t type, uint16_t flags, uint64_t key, const uint8_t *mac);
+    void flush_removals();
+    int send_batch(); // errno of the first failed message, 0 if all succeeded
+
+    Socket socket;
+    uint32_t seq;
+    std::unordered_map<uint64_t, entry> entries;
+    std::deque<expiry> expiries; // hold time is constant, so ordered by time
+    std::vector<uint8_t> batch;
+    size_t batch_count;
+};
+
+#endif//NDHCPD_NEIGHBOUR_CACHE_HPP
@@ -0,0 +1,137 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+#include "offer_table.hpp"
+
+offer_table::offer_table(size_t _capacity)
+    : capacity(_capacity)
+{
+}
+
+void offer_table::reserve(uint32_t ip, uint64_t mac, time_point expires)
+{
+    auto previous = by_mac.find(mac);
+    if(previous != by_mac.end()) {
+        erase(previous->second);
+    }
+    erase(ip);
+    while(by_ip.size() >= capacity && !order.empty()) {
+        order_entry oldest = order.front();
+        order.pop_front();
+        if(is_live(oldest)) {
+            erase(oldest.ip);
+        }
+    }
+    by_ip[ip] = offer{mac, expires};
+    by_mac[mac] = ip;
+    order.push_back(order_entry{ip, expires});
+    if(order.size() > 2*by_ip.size() + 64) {
+        // too many stale entries after re-offers, keep live ones only
+        std::deque<order_entry> live;
+        for(const order_entry &entry : order) {
+            if(is_live(entry)) {
+                live.push_back(entry);
+            }
+        }
+        std::swap(order, live);
+    }
+}
+
+uint32_t offer_table::find(uint64_t mac, time_point now) const
+{
+    auto index = by_mac.find(mac);
+    if(index == by_mac.end()) {
+        return 0;
+    }
+    auto reservation = by_ip.find(index->second);
+    if(reservation == by_ip.end() || reservation->second.expires < now) {
+        return 0;
+    }
+    return index->second;
+}
+
+bool offer_table::is_reserved(uint32_t ip, time_point now) const
+{
+    auto reservation = by_ip.find(ip);
+    return reservation != by_ip.end() && reservation->second.expires >= now;
+}
+
+void offer_table::release(uint32_t ip)
+{
+    erase(ip);
+}
+
+uint32_t offer_table::reclaim(time_point now)
+{
+    while(!order.empty()) {
+        order_entry oldest = order.front();
+        order.pop_front();
+        if(is_live(oldest)) {
+            erase(oldest.ip);
+            if(oldest.expires >= now) {
+                return oldest.ip;
+            }
+        }
+    }
+    return 0;
+}
+
+uint32_t offer_table::reclaim(time_point now, const std::function<bool(uint32_t)> &usable)
+{
+    for(auto entry = order.begin(); entry != order.end(); ) {
+        if(!is_live(*entry)) {
+            entry = order.erase(entry);
+            continue;
+        }
+        if(entry->expires >= now && usable(entry->ip)) {
+            uint32_t ip = entry->ip;
+            erase(ip);
+            order.erase(entry);
+            return ip;
+        }
+        ++entry;
+    }
+    return 0;
+}
+
+void offer_table::expire(time_point now)
+{
+    // offers differ in TTL by pool, so later ones may expire first;
+    // those are dropped when reached, lookups check expiration anyway
+    while(!order.empty() && (order.front().expires < now || !is_live(order.front()))) {
+        if(is_live(order.front())) {
+            erase(order.front().ip);
+        }
+        order.pop_front();
+    }
+}
+
+size_t offer_table::size() const
+{
+    return by_ip.size();
+}
+
+void offer_table::clear()
+{
+    by_ip.clear();
+    by_mac.clear();
+    order.clear();
+}
+
+bool offer_table::is_live(const order_entry &entry) const
+{
+    auto reservation = by_ip.find(entry.ip);
+    return reservation != by_ip.end() && reservation->second.expires == entry.expires;
+}
+
+void offer_table::erase(uint32_t ip)
+{
+    auto reservation = by_ip.find(ip);
+    if(reservation == by_ip.end()) {
+        return;
+    }
+    auto index = by_mac.find(reservation->second.mac);
+    if(index != by_mac.end() && index->second == ip) {
+        by_mac.erase(index);
+    }
+    by_ip.erase(reservation);
+}
@@ -0,0 +1,53 @@
+#ifndef NDHCPD_OFFER_TABLE_HPP
+#define NDHCPD_OFFER_TABLE_HPP
+
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <unordered_map>
+
+// Addresses offered to clients, but not yet confirmed by REQUEST.
+// Kept apart from leases, so a DISCOVER storm does not take over the pool:
+// reservations are short-lived, bounded, and reclaimed oldest first.
+class offer_table
+{
+public:
+    typedef std::chrono::steady_clock::time_point time_point;
+
+    explicit offer_table(size_t capacity);
+
+    // reserves ip for mac, replacing previous offer to the same mac
+    void reserve(uint32_t ip, uint64_t mac, time_point expires);
+    // offered address of mac, 0 when there is none
+    uint32_t find(uint64_t mac, time_point now) const;
+    bool is_reserved(uint32_t ip, time_point now) const;
+    void release(uint32_t ip);
+    // drops the oldest live reservation and returns its address, 0 when empty
+    uint32_t reclaim(time_point now);
+    // same for the oldest one usable, others are kept
+    uint32_t reclaim(time_point now, const std::function<bool(uint32_t)> &usable);
+
+    void expire(time_point now);
+    size_t size() const;
+    void clear();
+
+private:
+    struct offer {
+        uint64_t mac;
+        time_point expires;
+    };
+    struct order_entry {
+        uint32_t ip;
+        time_point expires;
+    };
+
+    bool is_live(const order_entry &entry) const;
+    void erase(uint32_t ip);
+
+    size_t capacity;
+    std::unordered_map<uint32_t, offer> by_ip;
+    std::unordered_map<uint64_t, uint32_t> by_mac;
+    std::deque<order_entry> order; // reservations in order of offering, stale ones skipped
+};
+
+#endif//NDHCPD_OFFER_TABLE_HPP
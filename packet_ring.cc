@@ -0,0 +1,321 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+#include "packet_ring.hpp"
+
+#include <algorithm>
+#include <system_error>
+
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <net/if.h>
+#include <net/ethernet.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+#include <linux/filter.h>
+#include <linux/if_packet.h>
+
+namespace {
+uint16_t ip_checksum(const void *data, size_t len)
+{
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    uint32_t sum = 0;
+    for(size_t i=0; i+1<len; i+=2) {
+        sum += (bytes[i] << 8) | bytes[i+1];
+    }
+    while(sum >> 16) {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    return htons(~sum);
+}
+}
+
+packet_ring::packet_ring()
+    : index(0)
+    , src_port(0)
+    , map(nullptr)
+    , map_size(0)
+    , tx_ring(nullptr)
+    , rx_current(0)
+    , rx_reading(nullptr)
+    , rx_remaining(0)
+    , rx_packet(nullptr)
+    , tx_head(0)
+    , tx_queued(0)
+{
+    memset(hwaddr, 0, sizeof(hwaddr));
+}
+
+packet_ring::~packet_ring()
+{
+    close();
+}
+
+void packet_ring::open(const std::string &ifaceName, uint16_t port)
+{
+    close();
+    Socket _socket(PF_PACKET, SOCK_RAW|SOCK_NONBLOCK, htons(ETH_P_IP));
+
+    struct ifreq ifr;
+    memset(&ifr, 0, sizeof(ifr));
+    ifaceName.copy(ifr.ifr_name, sizeof(ifr.ifr_name)-1);
+    if(ioctl(_socket, SIOCGIFINDEX, &ifr) != 0) {
+        throw std::system_error(errno, std::system_category(), "ioctl(SIOCGIFINDEX)");
+    }
+    int _index = ifr.ifr_ifindex;
+    if(ioctl(_socket, SIOCGIFHWADDR, &ifr) != 0) {
+        throw std::system_error(errno, std::system_category(), "ioctl(SIOCGIFHWADDR)");
+    }
+    memcpy(hwaddr, ifr.ifr_hwaddr.sa_data, sizeof(hwaddr));
+
+    // ip and udp dst port <port>, not fragmented
+    struct sock_filter code[] = {
+        BPF_STMT(BPF_LD|BPF_H|BPF_ABS, 12),
+        BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, ETH_P_IP, 0, 8),
+        BPF_STMT(BPF_LD|BPF_B|BPF_ABS, 23),
+        BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, IPPROTO_UDP, 0, 6),
+        BPF_STMT(BPF_LD|BPF_H|BPF_ABS, 20),
+        BPF_JUMP(BPF_JMP|BPF_JSET|BPF_K, 0x1fff, 4, 0),
+        BPF_STMT(BPF_LDX|BPF_B|BPF_MSH, 14),
+        BPF_STMT(BPF_LD|BPF_H|BPF_IND, 16),
+        BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, port, 0, 1),
+        BPF_STMT(BPF_RET|BPF_K, 0xffff),
+        BPF_STMT(BPF_RET|BPF_K, 0),
+    };
+    struct sock_fprog filter = { sizeof(code)/sizeof(code[0]), code };
+    _socket.setsockopt(SOL_SOCKET, SO_ATTACH_FILTER, filter);
+
+    _socket.setsockopt(SOL_PACKET, PACKET_VERSION, static_cast<int>(TPACKET_V3));
+    _socket.setsockopt(SOL_PACKET, PACKET_TX_HAS_OFF, true);
+    try {
+        // replies skip qdisc layer, they are few and latency bound
+        _socket.setsockopt(SOL_PACKET, PACKET_QDISC_BYPASS, true);
+    }
+    catch(const std::system_error &) {
+    }
+
+    struct tpacket_req3 rx_req;
+    memset(&rx_req, 0, sizeof(rx_req));
+    rx_req.tp_block_size = rx_block_size;
+    rx_req.tp_block_nr = rx_block_count;
+    rx_req.tp_frame_size = rx_frame_size;
+    rx_req.tp_frame_nr = rx_block_size / rx_frame_size * rx_block_count;
+    rx_req.tp_retire_blk_tov = rx_block_timeout;
+    _socket.setsockopt(SOL_PACKET, PACKET_RX_RING, rx_req);
+
+    struct tpacket_req3 tx_req;
+    memset(&tx_req, 0, sizeof(tx_req));
+    tx_req.tp_block_size = tx_block_size;
+    tx_req.tp_block_nr = tx_frame_count * tx_frame_size / tx_block_size;
+    tx_req.tp_frame_size = tx_frame_size;
+    tx_req.tp_frame_nr = tx_frame_count;
+    _socket.setsockopt(SOL_PACKET, PACKET_TX_RING, tx_req);
+
+    size_t rx_size = rx_block_size * rx_block_count;
+    size_t tx_size = tx_frame_size * tx_frame_count;
+    void *_map = mmap(nullptr, rx_size + tx_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, _socket, 0);
+    if(_map == MAP_FAILED) {
+        throw std::system_error(errno, std::system_category(), "mmap(packet ring)");
+    }
+
+    struct sockaddr_ll addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sll_family = AF_PACKET;
+    addr.sll_protocol = htons(ETH_P_IP);
+    addr.sll_ifindex = _index;
+    try {
+        _socket.bind(addr);
+    }
+    catch(...) {
+        munmap(_map, rx_size + tx_size);
+        throw;
+    }
+
+    std::swap(socket, _socket);
+    index = _index;
+    src_port = port;
+    map = static_cast<uint8_t *>(_map);
+    map_size = rx_size + tx_size;
+    tx_ring = map + rx_size;
+    rx_current = 0;
+    rx_reading = nullptr;
+    tx_head = 0;
+    tx_queued = 0;
+}
+
+void packet_ring::close()
+{
+    if(map) {
+        munmap(map, map_size);
+        map = nullptr;
+        tx_ring = nullptr;
+        map_size = 0;
+    }
+    rx_reading = nullptr;
+    socket.close();
+}
+
+struct tpacket_block_desc *packet_ring::rx_block(size_t i) const
+{
+    return reinterpret_cast<struct tpacket_block_desc *>(map + i * rx_block_size);
+}
+
+struct tpacket3_hdr *packet_ring::tx_frame(size_t i) const
+{
+    return reinterpret_cast<struct tpacket3_hdr *>(tx_ring + i * tx_frame_size);
+}
+
+bool packet_ring::next(request *req)
+{
+    while(true) {
+        if(!rx_reading) {
+            struct tpacket_block_desc *block = rx_block(rx_current);
+            if(!(__atomic_load_n(&block->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER)) {
+                return false;
+            }
+            rx_reading = block;
+            rx_remaining = block->hdr.bh1.num_pkts;
+            rx_packet = reinterpret_cast<uint8_t *>(block) + block->hdr.bh1.offset_to_first_pkt;
+        }
+        if(rx_remaining == 0) {
+            // whole block is read, hand it back to kernel
+            __atomic_store_n(&rx_reading->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+            rx_reading = nullptr;
+            rx_current = (rx_current + 1) % rx_block_count;
+            continue;
+        }
+        const struct tpacket3_hdr *hdr = reinterpret_cast<const struct tpacket3_hdr *>(rx_packet);
+        --rx_remaining;
+        rx_packet += hdr->tp_next_offset;
+
+        const struct sockaddr_ll *sll = reinterpret_cast<const struct sockaddr_ll *>(
+                    reinterpret_cast<const uint8_t *>(hdr) + TPACKET_ALIGN(sizeof(struct tpacket3_hdr)));
+        if(sll->sll_pkttype == PACKET_OUTGOING) {
+            continue;
+        }
+        const uint8_t *frame = reinterpret_cast<const uint8_t *>(hdr) + hdr->tp_mac;
+        size_t len = hdr->tp_snaplen;
+        if(len < sizeof(struct ether_header) + sizeof(struct iphdr)) {
+            continue;
+        }
+        struct iphdr ip;
+        memcpy(&ip, frame + sizeof(struct ether_header), sizeof(ip));
+        size_t ip_len = ip.ihl * 4;
+        size_t udp_offset = sizeof(struct ether_header) + ip_len;
+        if(ip.version != 4 || ip_len < sizeof(struct iphdr) || len < udp_offset + sizeof(struct udphdr)) {
+            continue;
+        }
+        struct udphdr udp;
+        memcpy(&udp, frame + udp_offset, sizeof(udp));
+        size_t payload_len = ntohs(udp.len);
+        if(payload_len < sizeof(struct udphdr)) {
+            continue;
+        }
+        payload_len = std::min(payload_len - sizeof(struct udphdr), len - udp_offset - sizeof(struct udphdr));
+
+        req->data = frame + udp_offset + sizeof(struct udphdr);
+        req->len = payload_len;
+        req->src_addr = ntohl(ip.saddr);
+        req->src_port = ntohs(udp.source);
+        req->dst_addr = ntohl(ip.daddr);
+        req->time.tv_sec = hdr->tp_sec;
+        req->time.tv_nsec = hdr->tp_nsec;
+        return true;
+    }
+}
+
+size_t packet_ring::backlog() const
+{
+    size_t bytes = 0;
+    for(size_t i = 0; i < rx_block_count; ++i) {
+        const struct tpacket_block_desc *block = rx_block((rx_current + i) % rx_block_count);
+        if(block == rx_reading) {
+            continue;
+        }
+        if(!(__atomic_load_n(&block->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER)) {
+            break;
+        }
+        bytes += block->hdr.bh1.blk_len;
+    }
+    return bytes;
+}
+
+uint32_t packet_ring::dropped()
+{
+    // kernel resets counters on every read
+    struct tpacket_stats_v3 stats;
+    memset(&stats, 0, sizeof(stats));
+    socket.getsockopt(SOL_PACKET, PACKET_STATISTICS, &stats);
+    return stats.tp_drops;
+}
+
+void *packet_ring::reply_frame()
+{
+    struct tpacket3_hdr *hdr = tx_frame(tx_head);
+    uint32_t status = __atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE);
+    if(status == TP_STATUS_WRONG_FORMAT) {
+        // kernel refused the frame, do not let it stall the ring
+        status = TP_STATUS_AVAILABLE;
+    }
+    if(status != TP_STATUS_AVAILABLE) {
+        return nullptr;
+    }
+    return reinterpret_cast<uint8_t *>(hdr) + tx_data_offset + headers_size;
+}
+
+size_t packet_ring::reply_capacity() const
+{
+    return tx_frame_size - tx_data_offset - headers_size;
+}
+
+void packet_ring::send_frame(size_t len, const uint8_t *dst_mac, uint32_t src_addr, uint32_t dst_addr, uint16_t dst_port)
+{
+    struct tpacket3_hdr *hdr = tx_frame(tx_head);
+    uint8_t *frame = reinterpret_cast<uint8_t *>(hdr) + tx_data_offset;
+
+    struct ether_header eth;
+    memcpy(eth.ether_dhost, dst_mac, sizeof(eth.ether_dhost));
+    memcpy(eth.ether_shost, hwaddr, sizeof(eth.ether_shost));
+    eth.ether_type = htons(ETH_P_IP);
+    memcpy(frame, &eth, sizeof(eth));
+
+    struct iphdr ip;
+    memset(&ip, 0, sizeof(ip));
+    ip.version = 4;
+    ip.ihl = sizeof(ip) / 4;
+    ip.tos = IPTOS_LOWDELAY;
+    ip.tot_len = htons(sizeof(ip) + sizeof(struct udphdr) + len);
+    ip.ttl = 64;
+    ip.protocol = IPPROTO_UDP;
+    ip.saddr = htonl(src_addr);
+    ip.daddr = htonl(dst_addr);
+    ip.check = ip_checksum(&ip, sizeof(ip));
+    memcpy(frame + sizeof(eth), &ip, sizeof(ip));
+
+    // zero UDP checksum is allowed over IPv4
+    struct udphdr udp;
+    udp.source = htons(src_port);
+    udp.dest = htons(dst_port);
+    udp.len = htons(sizeof(udp) + len);
+    udp.check = 0;
+    memcpy(frame + sizeof(eth) + sizeof(ip), &udp, sizeof(udp));
+
+    hdr->tp_len = headers_size + len;
+    hdr->tp_mac = tx_data_offset;
+    hdr->tp_next_offset = 0;
+    __atomic_store_n(&hdr->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+    tx_head = (tx_head + 1) % tx_frame_count;
+    ++tx_queued;
+}
+
+void packet_ring::flush()
+{
+    if(tx_queued == 0) {
+        return;
+    }
+    tx_queued = 0;
+    if(send(socket, nullptr, 0, MSG_DONTWAIT) < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+        throw std::system_error(errno, std::system_category(), "send(packet ring)");
+    }
+}
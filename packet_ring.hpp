@@ -0,0 +1,86 @@
+#ifndef NDHCPD_PACKET_RING_HPP
+#define NDHCPD_PACKET_RING_HPP
+
+#include <stdint.h>
+#include <string>
+#include <time.h>
+
+#include "socket.hpp"
+
+// AF_PACKET transport with TPACKET_V3 memory-mapped rx and tx rings.
+// Kernel filter passes IPv4 UDP to the server port only. Requests are read in
+// place from rx ring blocks. Replies are written into tx ring frames, which
+// get Ethernet, IP and UDP headers in front and are sent by one flush per batch.
+class packet_ring
+{
+public:
+    packet_ring();
+    ~packet_ring();
+
+    packet_ring(const packet_ring&) = delete;
+    packet_ring& operator=(const packet_ring&) = delete;
+
+public:
+    void open(const std::string &ifaceName, uint16_t port); // port in host endiannes
+    void close();
+    bool is_open() const { return socket.isValid(); }
+    int fd() const { return socket; }
+    int ifindex() const { return index; }
+
+    // addresses and ports in host endiannes
+    struct request {
+        const void *data; // valid until the next call
+        size_t len;
+        uint32_t src_addr;
+        uint16_t src_port;
+        uint32_t dst_addr;
+        struct timespec time; // CLOCK_REALTIME
+    };
+    // next request in rx ring, false when ring is drained
+    bool next(request *req);
+    // bytes in filled rx blocks not read yet
+    size_t backlog() const;
+    size_t capacity() const { return rx_block_size * rx_block_count; }
+    // requests dropped on full ring since last call
+    uint32_t dropped();
+
+    // payload of the next free tx frame, 4-byte aligned, nullptr when ring is full
+    void *reply_frame();
+    size_t reply_capacity() const;
+    // queues payload written into reply_frame(), addresses in host endiannes
+    void send_frame(size_t len, const uint8_t *dst_mac, uint32_t src_addr, uint32_t dst_addr, uint16_t dst_port);
+    void flush();
+
+private:
+    struct tpacket_block_desc *rx_block(size_t i) const;
+    struct tpacket3_hdr *tx_frame(size_t i) const;
+
+    static const size_t rx_block_size = 1 << 16;
+    static const size_t rx_block_count = 32;
+    static const size_t rx_frame_size = 2048;
+    static const unsigned rx_block_timeout = 1; // ms, rx block is handed over when full or after this
+    static const size_t tx_frame_size = 2048;
+    static const size_t tx_frame_count = 256;
+    static const size_t tx_block_size = 1 << 16;
+    // frame data offset, puts DHCP payload behind Ethernet, IP and UDP headers on 4-byte boundary
+    static const size_t tx_data_offset = 50;
+    static const size_t headers_size = 42;
+
+    Socket socket;
+    int index;
+    uint8_t hwaddr[6];
+    uint16_t src_port;
+    uint8_t *map;
+    size_t map_size;
+    uint8_t *tx_ring;
+
+    size_t rx_current; // block being read
+    struct tpacket_block_desc *rx_reading; // nullptr when no block is held
+    uint32_t rx_remaining;
+    uint8_t *rx_packet;
+
+    size_t tx_head;
+    size_t tx_queued;
+};
+
+#endif//NDHCPD_PACKET_RING_HPP
@@ -0,0 +1,96 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+#include "packet_trace.hpp"
+#include "file.hpp"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <system_error>
+#include <vector>
+
+packet_trace::packet_trace()
+    : head(0)
+    , slots(new slot[size])
+{
+    for(size_t i=0; i<size; ++i) {
+        slots[i].seq.store(0, std::memory_order_relaxed);
+        for(auto &word : slots[i].data) {
+            word.store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+void packet_trace::record(const ndhcpd_trace_record_t &record)
+{
+    uint64_t data[words];
+    memcpy(data, &record, sizeof(data));
+
+    uint64_t index = head.load(std::memory_order_relaxed);
+    slot &s = slots[index % size];
+    uint64_t seq = s.seq.load(std::memory_order_relaxed);
+    s.seq.store(seq+1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for(size_t i=0; i<words; ++i) {
+        s.data[i].store(data[i], std::memory_order_relaxed);
+    }
+    s.seq.store(seq+2, std::memory_order_release);
+    head.store(index+1, std::memory_order_release);
+}
+
+void packet_trace::dump(const std::string &path) const
+{
+    uint64_t end = head.load(std::memory_order_acquire);
+    uint64_t begin = end > size ? end - size : 0;
+
+    std::vector<ndhcpd_trace_record_t> records;
+    records.reserve(end - begin);
+    for(uint64_t index = begin; index < end; ++index) {
+        const slot &s = slots[index % size];
+        uint64_t data[words];
+        uint64_t seq;
+        do {
+            seq = s.seq.load(std::memory_order_acquire);
+            for(size_t i=0; i<words; ++i) {
+                data[i] = s.data[i].load(std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+        } while((seq & 1) || seq != s.seq.load(std::memory_order_relaxed));
+        if(head.load(std::memory_order_acquire) - index > size) {
+            // overwritten by a newer packet while dumping
+            continue;
+        }
+        records.emplace_back();
+        memcpy(&records.back(), data, sizeof(data));
+    }
+
+    ndhcpd_trace_header_t header;
+    memset(&header, 0, sizeof(header));
+    header.magic = NDHCPD_TRACE_MAGIC;
+    header.version = NDHCPD_TRACE_VERSION;
+    header.header_size = sizeof(header);
+    header.record_size = sizeof(ndhcpd_trace_record_t);
+    header.count = records.size();
+
+    File fd(::open(path.c_str(), O_WRONLY|O_CREAT|O_TRUNC, S_IRUSR|S_IWUSR|S_IRGRP));
+    if(!fd) {
+        throw std::system_error(errno, std::system_category(), "open(" + path + ")");
+    }
+    if(write(fd, &header, sizeof(header)) != sizeof(header)) {
+        throw std::system_error(errno, std::system_category(), "write(" + path + ")");
+    }
+    ssize_t len = records.size() * sizeof(ndhcpd_trace_record_t);
+    if(len && write(fd, records.data(), len) != len) {
+        throw std::system_error(errno, std::system_category(), "write(" + path + ")");
+    }
+}
+
+uint64_t packet_trace::now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
@@ -0,0 +1,46 @@
+#ifndef NDHCPD_PACKET_TRACE_HPP
+#define NDHCPD_PACKET_TRACE_HPP
+
+#include <ndhcpd_trace.h>
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <string>
+
+// Always-on ring of the last packets, see ndhcpd_trace.h.
+// Packet thread records without locking or allocation, every record is
+// guarded by its own sequence lock, so the ring can be dumped from any thread.
+class packet_trace
+{
+public:
+    static const size_t size = 4096;
+
+    packet_trace();
+
+    packet_trace(const packet_trace&) = delete;
+    packet_trace& operator=(const packet_trace&) = delete;
+
+public:
+    // packet path
+    void record(const ndhcpd_trace_record_t &record);
+
+    // readers
+    void dump(const std::string &path) const;
+
+    static uint64_t now();
+
+private:
+    static const size_t words = sizeof(ndhcpd_trace_record_t) / sizeof(uint64_t);
+    static_assert(sizeof(ndhcpd_trace_record_t) % sizeof(uint64_t) == 0, "trace record is not packed into words");
+
+    struct slot {
+        std::atomic<uint64_t> seq;
+        std::array<std::atomic<uint64_t>, words> data;
+    };
+
+    std::atomic<uint64_t> head; // records written so far
+    std::unique_ptr<slot[]> slots;
+};
+
+#endif//NDHCPD_PACKET_TRACE_HPP
@@ -0,0 +1,14 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+#include "probes.hpp"
+
+#ifdef NDHCPD_USDT
+// probe semaphores, raised by the tracer while a probe is attached
+#define NDHCPD_PROBE_SEMAPHORE(name) \
+    __extension__ unsigned short ndhcpd_##name##_semaphore __attribute__((unused)) __attribute__((section(".probes")))
+NDHCPD_PROBE_SEMAPHORE(packet_received);
+NDHCPD_PROBE_SEMAPHORE(packet_classified);
+NDHCPD_PROBE_SEMAPHORE(lease_chosen);
+NDHCPD_PROBE_SEMAPHORE(packet_sent);
+NDHCPD_PROBE_SEMAPHORE(packet_dropped);
+#endif
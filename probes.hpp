@@ -0,0 +1,47 @@
+#ifndef NDHCPD_PROBES_HPP
+#define NDHCPD_PROBES_HPP
+
+// USDT probes of provider "ndhcpd" for bpftrace and perf, e.g.
+//   bpftrace -e 'usdt:libndhcpd.so:ndhcpd:lease_chosen { printf("%x\n", arg2); }'
+// Probes have semaphores, tracer raises them while attached, so probe
+// arguments are computed only then. Build with -DNDHCPD_USDT=OFF to leave
+// them out.
+//
+//   packet_received   xid, mac, length, source address
+//   packet_classified xid, mac, message type
+//   lease_chosen      xid, mac, address, reply message type
+//   packet_sent       xid, mac, message type, address, destination address
+//   packet_dropped    xid, mac, error code, 0 if shed on overload
+
+#include "config.h"
+
+#ifdef NDHCPD_USDT
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+
+// defined in probes.cc
+#define NDHCPD_PROBE_SEMAPHORE(name) \
+    __extension__ extern unsigned short ndhcpd_##name##_semaphore __attribute__((unused)) __attribute__((section(".probes")))
+NDHCPD_PROBE_SEMAPHORE(packet_received);
+NDHCPD_PROBE_SEMAPHORE(packet_classified);
+NDHCPD_PROBE_SEMAPHORE(lease_chosen);
+NDHCPD_PROBE_SEMAPHORE(packet_sent);
+NDHCPD_PROBE_SEMAPHORE(packet_dropped);
+#undef NDHCPD_PROBE_SEMAPHORE
+
+// guards arguments that take more than the probe macros below compute
+#define NDHCPD_PROBE_ENABLED(name) __builtin_expect(ndhcpd_##name##_semaphore != 0, 0)
+#define NDHCPD_PROBE3(name, a1, a2, a3) \
+    do { if(NDHCPD_PROBE_ENABLED(name)) DTRACE_PROBE3(ndhcpd, name, a1, a2, a3); } while(0)
+#define NDHCPD_PROBE4(name, a1, a2, a3, a4) \
+    do { if(NDHCPD_PROBE_ENABLED(name)) DTRACE_PROBE4(ndhcpd, name, a1, a2, a3, a4); } while(0)
+#define NDHCPD_PROBE5(name, a1, a2, a3, a4, a5) \
+    do { if(NDHCPD_PROBE_ENABLED(name)) DTRACE_PROBE5(ndhcpd, name, a1, a2, a3, a4, a5); } while(0)
+#else
+#define NDHCPD_PROBE_ENABLED(name) false
+#define NDHCPD_PROBE3(name, a1, a2, a3) do {} while(0)
+#define NDHCPD_PROBE4(name, a1, a2, a3, a4) do {} while(0)
+#define NDHCPD_PROBE5(name, a1, a2, a3, a4, a5) do {} while(0)
+#endif
+
+#endif//NDHCPD_PROBES_HPP
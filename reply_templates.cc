@@ -0,0 +1,116 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+#include "reply_templates.hpp"
+
+#include <algorithm>
+#include <system_error>
+
+#include <string.h>
+#include <arpa/inet.h>
+#include <net/if_arp.h>
+
+#include "dhcp_options.hpp"
+
+namespace {
+const char pxe_client[] = "PXEClient";
+}
+
+const int reply_templates::any_architecture;
+
+reply_templates::reply_templates()
+{
+    render_plain(&plain);
+}
+
+void reply_templates::render_plain(dhcp_packet *out)
+{
+    memset(out, 0, sizeof(*out));
+    out->op = dhcp_packet::_op::BOOTREPLY;
+    out->htype = ARPHRD_ETHER;
+    out->hlen = 6;
+    out->cookie = (dhcp_packet::_cookie)htonl(dhcp_packet::cookie_value_he);
+    out->options[0] = (uint8_t)dhcp_option::_code::end;
+    dhcp_put<dhcp_option::_code::message_type>(out, dhcp_message_type::offer);
+    dhcp_put<dhcp_option::_code::server_id>(out, INADDR_ANY);
+}
+
+void reply_templates::set_boot(int architecture, uint32_t next_server, const std::string &server_name, const std::string &boot_file)
+{
+    dhcp_packet tmpl;
+    if(architecture < any_architecture || architecture > UINT16_MAX
+            || server_name.size() >= sizeof(tmpl.sname)
+            || boot_file.size() >= sizeof(tmpl.file)) {
+        throw std::system_error(std::make_error_code(std::errc::invalid_argument), "set_boot()");
+    }
+    render_plain(&tmpl);
+    tmpl.siaddr_nip = htonl(next_server);
+    server_name.copy(reinterpret_cast<char *>(tmpl.sname), sizeof(tmpl.sname)-1);
+    boot_file.copy(reinterpret_cast<char *>(tmpl.file), sizeof(tmpl.file)-1);
+    // PXE clients ignore offers without PXEClient vendor class
+    dhcp_put<dhcp_option::_code::vendor_class>(&tmpl, pxe_client);
+    if(!server_name.empty()) {
+        dhcp_put<dhcp_option::_code::tftp_server>(&tmpl, server_name);
+    }
+    if(!boot_file.empty()) {
+        dhcp_put<dhcp_option::_code::boot_file>(&tmpl, boot_file);
+    }
+
+    auto iter = std::find_if(boot.begin(), boot.end(), [architecture](const std::pair<int, dhcp_packet> &b) {
+        return b.first == architecture;
+    });
+    if(iter != boot.end()) {
+        iter->second = tmpl;
+    }
+    else {
+        boot.emplace_back(architecture, tmpl);
+    }
+}
+
+void reply_templates::clear_boot()
+{
+    boot.clear();
+}
+
+const dhcp_packet *reply_templates::boot_template(const dhcp_packet &request) const
+{
+    if(boot.empty()) {
+        return nullptr;
+    }
+    int architecture = any_architecture;
+    const dhcp_option *option = dhcp_find_option(request, dhcp_option::_code::client_arch);
+    if(option && option->len >= 2) {
+        // first architecture client supports
+        architecture = (static_cast<uint8_t>(option->value[0]) << 8) | static_cast<uint8_t>(option->value[1]);
+    }
+    else {
+        option = dhcp_find_option(request, dhcp_option::_code::vendor_class);
+        if(!option || option->len < sizeof(pxe_client)-1 || memcmp(option->value, pxe_client, sizeof(pxe_client)-1) != 0) {
+            return nullptr;
+        }
+    }
+    const dhcp_packet *any = nullptr;
+    for(const auto &b : boot) {
+        if(b.first == architecture) {
+            return &b.second;
+        }
+        if(b.first == any_architecture) {
+            any = &b.second;
+        }
+    }
+    return any;
+}
+
+void reply_templates::render(const dhcp_packet &request, dhcp_message_type type, in_addr server_id, dhcp_packet *out) const
+{
+    const dhcp_packet *tmpl = nullptr;
+    if(type != dhcp_message_type::nak) {
+        tmpl = boot_template(request);
+    }
+    memcpy(out, tmpl ? tmpl : &plain, sizeof(*out));
+    out->xid = request.xid;
+    memcpy(out->chaddr, request.chaddr, sizeof(out->chaddr));
+    out->flags = request.flags;
+    out->ciaddr = request.ciaddr;
+    out->options[message_type_offset] = static_cast<uint8_t>(type);
+    memcpy(out->options + server_id_offset, &server_id, sizeof(server_id));
+}
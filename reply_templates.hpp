@@ -0,0 +1,44 @@
+#ifndef NDHCPD_REPLY_TEMPLATES_HPP
+#define NDHCPD_REPLY_TEMPLATES_HPP
+
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+#include <netinet/in.h>
+
+#include "dhcp_packet.hpp"
+
+// Pre-rendered reply headers.
+// Plain template has BOOTREPLY header, magic cookie, message type and
+// server id options. Network boot (PXE) templates also have siaddr, sname,
+// file, and vendor class, TFTP server name and boot file options, one per
+// client architecture. Reply is a template copy with transaction fields,
+// message type and server id patched in, lease options are appended later.
+class reply_templates
+{
+public:
+    static const int any_architecture = -1;
+
+    reply_templates();
+
+    // next_server in host endiannes, 0 to leave siaddr empty
+    void set_boot(int architecture, uint32_t next_server, const std::string &server_name, const std::string &boot_file);
+    void clear_boot();
+
+    // NAK and clients not booting from network get plain template
+    void render(const struct dhcp_packet &request, dhcp_message_type type, in_addr server_id, struct dhcp_packet *out) const;
+
+private:
+    // options area starts with message type and server id of every reply
+    static const size_t message_type_offset = 2;
+    static const size_t server_id_offset = 5;
+
+    static void render_plain(struct dhcp_packet *out);
+    const struct dhcp_packet *boot_template(const struct dhcp_packet &request) const;
+
+    struct dhcp_packet plain;
+    std::vector<std::pair<int, struct dhcp_packet>> boot; // by architecture, usually a few
+};
+
+#endif//NDHCPD_REPLY_TEMPLATES_HPP
@@ -0,0 +1,59 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+#include "server_stats.hpp"
+
+server_stats::server_stats()
+    : received(0)
+    , replied(0)
+    , dropped(0)
+    , ignored(0)
+    , shed(0)
+    , kernel_dropped(0)
+    , backlog(0)
+    , latency_count(0)
+    , latency_total(0)
+    , latency_max(0)
+{
+    for(auto &bucket : latency_histogram) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+void server_stats::packet_replied(std::chrono::nanoseconds latency)
+{
+    increment(replied);
+    if(latency.count() <= 0) {
+        return;
+    }
+    uint64_t ns = latency.count();
+    increment(latency_count);
+    increment(latency_total, ns);
+    if(ns > latency_max.load(std::memory_order_relaxed)) {
+        latency_max.store(ns, std::memory_order_relaxed);
+    }
+    // bucket i holds latencies below 2^i microseconds
+    size_t bucket = 0;
+    for(uint64_t us = ns / 1000; us != 0 && bucket < latency_histogram.size()-1; us >>= 1) {
+        ++bucket;
+    }
+    increment(latency_histogram[bucket]);
+}
+
+ndhcpd::statistics server_stats::snapshot() const
+{
+    ndhcpd::statistics stats;
+    stats.received = received.load(std::memory_order_relaxed);
+    stats.replied = replied.load(std::memory_order_relaxed);
+    stats.dropped = dropped.load(std::memory_order_relaxed);
+    stats.ignored = ignored.load(std::memory_order_relaxed);
+    stats.shed = shed.load(std::memory_order_relaxed);
+    stats.kernelDropped = kernel_dropped.load(std::memory_order_relaxed);
+    stats.backlog = backlog.load(std::memory_order_relaxed);
+    stats.latencyCount = latency_count.load(std::memory_order_relaxed);
+    stats.latencyTotal = std::chrono::nanoseconds(latency_total.load(std::memory_order_relaxed));
+    stats.latencyMax = std::chrono::nanoseconds(latency_max.load(std::memory_order_relaxed));
+    for(size_t i=0; i<latency_histogram.size(); ++i) {
+        stats.latencyHistogram[i] = latency_histogram[i].load(std::memory_order_relaxed);
+    }
+    return stats;
+}
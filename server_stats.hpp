@@ -0,0 +1,49 @@
+#ifndef NDHCPD_SERVER_STATS_HPP
+#define NDHCPD_SERVER_STATS_HPP
+
+#include <ndhcpd.hpp>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+
+// Server counters. Written by the packet thread only, so updates are plain
+// relaxed stores without locked instructions. Readable from any thread.
+class server_stats
+{
+public:
+    server_stats();
+
+    server_stats(const server_stats&) = delete;
+    server_stats& operator=(const server_stats&) = delete;
+
+public:
+    void packet_received() { increment(received); }
+    void packet_dropped() { increment(dropped); }
+    void packet_ignored() { increment(ignored); }
+    void packet_shed(uint64_t count) { increment(shed, count); }
+    void set_kernel_dropped(uint32_t count) { kernel_dropped.store(count, std::memory_order_relaxed); }
+    void set_backlog(uint64_t bytes) { backlog.store(bytes, std::memory_order_relaxed); }
+    void packet_replied(std::chrono::nanoseconds latency);
+
+    ndhcpd::statistics snapshot() const;
+
+private:
+    static void increment(std::atomic<uint64_t> &counter, uint64_t value = 1) {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    std::atomic<uint64_t> received;
+    std::atomic<uint64_t> replied;
+    std::atomic<uint64_t> dropped;
+    std::atomic<uint64_t> ignored;
+    std::atomic<uint64_t> shed;
+    std::atomic<uint64_t> kernel_dropped;
+    std::atomic<uint64_t> backlog;
+    std::atomic<uint64_t> latency_count;
+    std::atomic<uint64_t> latency_total;
+    std::atomic<uint64_t> latency_max;
+    std::array<std::atomic<uint64_t>, ndhcpd::statistics::latency_buckets> latency_histogram;
+};
+
+#endif//NDHCPD_SERVER_STATS_HPP
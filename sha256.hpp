@@ -0,0 +1,31 @@
+#ifndef NDHCPD_SHA256_HPP
+#define NDHCPD_SHA256_HPP
+
+#include <array>
+#include <cstddef>
+#include <stdint.h>
+
+// FIPS 180-4 SHA-256, for DHCID records (RFC 4701) only, no crypto library
+// is linked.
+class sha256
+{
+public:
+    typedef std::array<uint8_t, 32> digest_type;
+
+    sha256();
+
+    void update(const uint8_t *data, size_t len);
+    digest_type finish();
+
+    static digest_type digest(const uint8_t *data, size_t len);
+
+private:
+    void transform(const uint8_t *block);
+
+    std::array<uint32_t, 8> state;
+    std::array<uint8_t, 64> buffer;
+    size_t buffered;
+    uint64_t total;
+};
+
+#endif//NDHCPD_SHA256_HPP
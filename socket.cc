@@ -5,6 +5,7 @@
 #include <sys/socket.h>
 #include <system_error>
 #include <netinet/ip.h>
+#include <netdb.h>
 
 Socket::Socket()
     : File()
@@ -85,3 +86,26 @@ void Socket::bind(const sockaddr *addr, socklen_t addrLen)
     }
 
 }
+
+sockaddr_in resolve(const std::string &host, uint16_t port)
+{
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if(host.empty()) {
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        return addr;
+    }
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    struct addrinfo *result = nullptr;
+    int err = getaddrinfo(host.c_str(), nullptr, &hints, &result);
+    if(err != 0 || !result) {
+        throw std::system_error(std::make_error_code(std::errc::host_unreachable), "getaddrinfo(" + host + ")");
+    }
+    addr.sin_addr = reinterpret_cast<const sockaddr_in*>(result->ai_addr)->sin_addr;
+    freeaddrinfo(result);
+    return addr;
+}
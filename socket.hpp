@@ -3,8 +3,14 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+#include <endian.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
 #include <sys/socket.h>
 
+#include <string>
+
 #include "file.hpp"
 
 class Socket;
@@ -73,7 +79,7 @@ inline void sockopt<T>::set(Socket &sock, int level, int optname, const T &optva
 }
 template<typename T>
 inline void sockopt<T>::get(Socket &sock, int level, int optname, T *optval) {
-    socklen_t optlen = sizeof(optval);
+    socklen_t optlen = sizeof(*optval);
     sock.getsockopt(level, optname, optval, &optlen);
 }
 
@@ -87,4 +93,37 @@ inline void sockopt<bool>::get(Socket &sock, int level, int optname, bool *optva
     *optval = (u32val != 0);
 }
 
+// IPv4 address of host name or address, empty host for any address.
+// Throws std::system_error with EHOSTUNREACH when host does not resolve.
+sockaddr_in resolve(const std::string &host, uint16_t port);
+
+// Wire format fields in network byte order, p may be unaligned
+inline void put_u16(uint8_t *p, uint16_t value) {
+    value = htons(value);
+    memcpy(p, &value, sizeof(value));
+}
+inline void put_u32(uint8_t *p, uint32_t value) {
+    value = htonl(value);
+    memcpy(p, &value, sizeof(value));
+}
+inline void put_u64(uint8_t *p, uint64_t value) {
+    value = htobe64(value);
+    memcpy(p, &value, sizeof(value));
+}
+inline uint16_t get_u16(const uint8_t *p) {
+    uint16_t value;
+    memcpy(&value, p, sizeof(value));
+    return ntohs(value);
+}
+inline uint32_t get_u32(const uint8_t *p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return ntohl(value);
+}
+inline uint64_t get_u64(const uint8_t *p) {
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return be64toh(value);
+}
+
 #endif//NDHCPD_SOCKET_HPP
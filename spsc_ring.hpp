@@ -0,0 +1,70 @@
+#ifndef NDHCPD_SPSC_RING_HPP
+#define NDHCPD_SPSC_RING_HPP
+
+#include <atomic>
+#include <vector>
+#include <stddef.h>
+
+// Bounded lock-free single-producer single-consumer ring.
+template<typename T>
+class spsc_ring
+{
+public:
+    explicit spsc_ring(size_t capacity)
+        : head(0)
+        , tail(0)
+    {
+        size_t size = 1;
+        while(size < capacity) {
+            size <<= 1;
+        }
+        buffer.resize(size);
+        mask = size-1;
+    }
+
+    spsc_ring(const spsc_ring&) = delete;
+    spsc_ring& operator=(const spsc_ring&) = delete;
+
+    // producer side, returns false if ring is full
+    bool push(const T &value)
+    {
+        size_t _tail = tail.load(std::memory_order_relaxed);
+        if(_tail - head.load(std::memory_order_acquire) > mask) {
+            return false;
+        }
+        buffer[_tail & mask] = value;
+        tail.store(_tail+1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer side, returns number of popped values
+    size_t pop(T *values, size_t count)
+    {
+        size_t _head = head.load(std::memory_order_relaxed);
+        size_t available = tail.load(std::memory_order_acquire) - _head;
+        if(count > available) {
+            count = available;
+        }
+        for(size_t i=0; i<count; ++i) {
+            values[i] = buffer[(_head+i) & mask];
+        }
+        head.store(_head+count, std::memory_order_release);
+        return count;
+    }
+
+    bool empty() const
+    {
+        return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+    }
+
+private:
+    // keep producer and consumer indices on separate cache lines
+    std::vector<T> buffer;
+    size_t mask;
+    char pad0[64];
+    std::atomic<size_t> head;
+    char pad1[64 - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> tail;
+};
+
+#endif//NDHCPD_SPSC_RING_HPP